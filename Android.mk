@@ -6,15 +6,30 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_C_INCLUDES)
 LOCAL_STATIC_LIBRARIES := libcxx
 LOCAL_CFLAGS := -std=c++17
+ifeq ($(SYSTEM_PROPERTIES_STATS),true)
+LOCAL_CFLAGS += -DSYSTEM_PROPERTIES_STATS
+endif
+ifeq ($(SYSTEM_PROPERTIES_PREFETCH),true)
+LOCAL_CFLAGS += -DSYSTEM_PROPERTIES_PREFETCH
+endif
+ifneq ($(SYSTEM_PROPERTIES_AREA_MAX_SIZE),)
+LOCAL_CFLAGS += -DSYSTEM_PROPERTIES_AREA_MAX_SIZE=$(SYSTEM_PROPERTIES_AREA_MAX_SIZE)
+endif
 LOCAL_SRC_FILES := \
     context_node.cpp \
     contexts_serialized.cpp \
     contexts_split.cpp \
     prop_area.cpp \
     prop_info.cpp \
+    prop_ro_table.cpp \
+    property_handle.cpp \
     system_properties.cpp \
     system_property_api.cpp \
     system_property_set.cpp \
-    property_info_parser.cpp
+    system_property_watch.cpp \
+    property_info_parser.cpp \
+    property_info_serializer.cpp
 
 include $(BUILD_STATIC_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,580 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <api/_system_properties.h>
+#include <property_info_serializer/property_info_serializer.h>
+#include <system_properties/property_handle.h>
+#include <system_properties/system_properties.h>
+
+using android::properties::BuildTrie;
+using android::properties::BuildTrieFromPropertyContexts;
+using android::properties::PropertyInfoEntry;
+
+// 大致按照设备上属性名的分布生成：一半以上是ro.*，其余分布在persist.*、sys.*、vendor.*等前缀下
+static const struct {
+  const char* prefix;
+  int weight;
+} kPrefixes[] = {
+    {"ro.build.", 10}, {"ro.product.", 8}, {"ro.boot.", 6},   {"ro.hardware.", 4},
+    {"ro.vendor.", 8}, {"ro.config.", 4},  {"ro.system.", 4}, {"persist.sys.", 6},
+    {"persist.vendor.", 6}, {"sys.", 8},   {"vendor.", 10},   {"init.svc.", 12},
+    {"dalvik.vm.", 6}, {"debug.", 4},      {"net.", 2},       {"log.tag.", 2},
+};
+
+static const char* const kSegments[] = {
+    "abi",     "audio",   "boot",    "camera", "config", "display", "enabled", "fingerprint",
+    "gpu",     "id",      "media",   "mode",   "model",  "name",    "radio",   "sdk",
+    "secure",  "serial",  "state",   "timeout", "type",  "usb",     "version", "wifi",
+};
+
+// 在临时目录中用AreaInit()创建合成的属性区域。写入者和读取者是两个SystemProperties实例，
+// 读取者像普通进程一样只读映射这些区域
+struct LocalPropertyTestState {
+  explicit LocalPropertyTestState(size_t nprops) {
+    snprintf(dir, sizeof(dir), "%s/properties.XXXXXX", getenv("TMPDIR") ?: "/data/local/tmp");
+    if (mkdtemp(dir) == nullptr) {
+      perror("mkdtemp");
+      return;
+    }
+
+    // 每个前缀一个上下文，另外再加一些只有少数属性的上下文，和设备上几十个上下文的数量相当
+    std::vector<PropertyInfoEntry> entries;
+    for (size_t i = 0; i < sizeof(kPrefixes) / sizeof(kPrefixes[0]); ++i) {
+      entries.emplace_back(kPrefixes[i].prefix, "u:object_r:bench" + std::to_string(i) + "_prop:s0",
+                           "string", false);
+    }
+    for (size_t i = 0; i < 48; ++i) {
+      entries.emplace_back("ro.vendor.x" + std::to_string(i) + ".",
+                           "u:object_r:benchx" + std::to_string(i) + "_prop:s0", "string", false);
+    }
+    entries.emplace_back("ro.property_service.version", "u:object_r:bench_version_prop:s0",
+                         "int", true);
+    std::string serialized, error;
+    if (!BuildTrie(entries, "u:object_r:default_prop:s0", "string", &serialized, &error)) {
+      fprintf(stderr, "BuildTrie failed: %s\n", error.c_str());
+      return;
+    }
+    std::string property_info = std::string(dir) + "/property_info";
+    int fd = open(property_info.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0444);
+    if (fd == -1 || write(fd, serialized.data(), serialized.size()) !=
+                        static_cast<ssize_t>(serialized.size())) {
+      perror("property_info");
+      return;
+    }
+    close(fd);
+
+    bool fsetxattr_failed;
+    if (!writer.AreaInit(dir, &fsetxattr_failed)) {
+      fprintf(stderr, "AreaInit(%s) failed\n", dir);
+      return;
+    }
+    writer.contexts_->rw_ = true;  // AreaInit()不会设置rw_
+
+    int total_weight = 0;
+    for (const auto& p : kPrefixes) total_weight += p.weight;
+    std::mt19937 rng(42);
+    while (names.size() < nprops) {
+      int pick = rng() % total_weight;
+      size_t i = 0;
+      while (pick >= kPrefixes[i].weight) pick -= kPrefixes[i++].weight;
+      std::string name = kPrefixes[i].prefix;
+      for (int depth = 1 + rng() % 3; depth > 0; --depth) {
+        name += kSegments[rng() % (sizeof(kSegments) / sizeof(kSegments[0]))];
+        if (depth > 1) name += '.';
+      }
+      if (writer.Find(name.c_str()) != nullptr) continue;
+
+      // ro.*中大约十分之一是超过PROP_VALUE_MAX的长值
+      std::string value = "value" + std::to_string(names.size());
+      const bool is_long = name.compare(0, 3, "ro.") == 0 && rng() % 10 == 0;
+      if (is_long) value = std::string(PROP_VALUE_MAX + rng() % 256, 'v');
+      if (writer.Add(name.c_str(), name.size(), value.c_str(), value.size()) != 0) {
+        fprintf(stderr, "Add(%s) failed\n", name.c_str());
+        return;
+      }
+      (is_long ? long_names : names).push_back(name);
+    }
+    writer.Add("ro.property_service.version", 27, "2", 1);
+    writer.Add("bench.ping", 10, "0", 1);
+    writer.Add("bench.pong", 10, "0", 1);
+    const std::string config(kConfigSize, '0');
+    writer.Add("bench.config", 12, config.c_str(), config.size());
+
+    if (!reader.Init(dir)) {
+      fprintf(stderr, "Init(%s) failed\n", dir);
+      return;
+    }
+    valid = true;
+  }
+
+  ~LocalPropertyTestState() {
+    writer.contexts_->FreeAndUnmap();
+    reader.contexts_->FreeAndUnmap();
+    std::string command = std::string("rm -rf ") + dir;
+    system(command.c_str());
+  }
+
+  prop_info* WriterFind(const char* name) {
+    return const_cast<prop_info*>(writer.Find(name));
+  }
+
+  static constexpr size_t kConfigSize = 2048;  // bench.config，一个可变的长值属性
+
+  bool valid = false;
+  char dir[PATH_MAX];
+  SystemProperties writer{false};
+  SystemProperties reader{false};
+  std::vector<std::string> names;       // 短值属性
+  std::vector<std::string> long_names;  // ro.*长值属性
+};
+
+// 各个基准共用一个状态，构建区域本身比大部分基准都慢
+static LocalPropertyTestState* g_state = nullptr;
+
+static LocalPropertyTestState* GetState(benchmark::State& state) {
+  if (g_state == nullptr) g_state = new LocalPropertyTestState(1024);
+  LocalPropertyTestState* pa = g_state;
+  if (!pa->valid) {
+    state.SkipWithError("Could not create the property areas");
+    return nullptr;
+  }
+  return pa;
+}
+
+static void BM_property_find(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pa->reader.Find(pa->names[i++ % pa->names.size()].c_str()));
+  }
+}
+BENCHMARK(BM_property_find);
+
+static void BM_property_find_missing(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  size_t i = 0;
+  for (auto _ : state) {
+    std::string& name = pa->names[i++ % pa->names.size()];
+    name.back() ^= 0x20;  // 修改最后一个字符，名字所在的trie路径不变
+    benchmark::DoNotOptimize(pa->reader.Find(name.c_str()));
+    name.back() ^= 0x20;
+  }
+}
+BENCHMARK(BM_property_find_missing);
+
+static void BM_property_get(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  char value[PROP_VALUE_MAX];
+  size_t i = 0;
+  for (auto _ : state) {
+    pa->reader.Get(pa->names[i++ % pa->names.size()].c_str(), value);
+  }
+}
+BENCHMARK(BM_property_get);
+
+static void BM_property_read(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  std::vector<const prop_info*> pis;
+  for (const auto& name : pa->names) pis.push_back(pa->reader.Find(name.c_str()));
+  char value[PROP_VALUE_MAX];
+  size_t i = 0;
+  for (auto _ : state) {
+    pa->reader.Read(pis[i++ % pis.size()], nullptr, value);
+  }
+}
+BENCHMARK(BM_property_read);
+
+static void ReadCallbackBenchmark(benchmark::State& state, const std::vector<std::string>& names,
+                                  SystemProperties* reader) {
+  if (names.empty()) {
+    state.SkipWithError("No properties to read");
+    return;
+  }
+  std::vector<const prop_info*> pis;
+  for (const auto& name : names) pis.push_back(reader->Find(name.c_str()));
+  const char* value = nullptr;
+  size_t i = 0;
+  for (auto _ : state) {
+    reader->ReadCallback(
+        pis[i++ % pis.size()],
+        [](void* cookie, const char*, const char* value, uint32_t) {
+          *static_cast<const char**>(cookie) = value;
+        },
+        &value);
+    benchmark::DoNotOptimize(value);
+  }
+}
+
+static void BM_property_read_callback(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+  ReadCallbackBenchmark(state, pa->names, &pa->reader);
+}
+BENCHMARK(BM_property_read_callback);
+
+static void BM_property_read_callback_long(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+  ReadCallbackBenchmark(state, pa->long_names, &pa->reader);
+}
+BENCHMARK(BM_property_read_callback_long);
+
+// 读取一个不断被更新的可变长值。每次更新都换用新的值块并释放旧块，所以读取者把值复制到
+// 缓冲区，只在复制期间发生更新时重试。写入者每10ms更新一次
+static void BM_property_read_callback_long_updated(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  prop_info* wpi = pa->WriterFind("bench.config");
+  const prop_info* pi = pa->reader.Find("bench.config");
+  std::atomic<bool> done(false);
+  std::thread updater([&]() {
+    std::string value(LocalPropertyTestState::kConfigSize, '0');
+    for (unsigned n = 0; !done; ++n) {
+      value[0] = '0' + n % 10;
+      pa->writer.Update(wpi, value.c_str(), value.size());
+      usleep(10000);
+    }
+  });
+
+  uint64_t updates = 0;
+  uint32_t last_serial = 0;
+  for (auto _ : state) {
+    uint32_t serial = 0;
+    pa->reader.ReadCallback(
+        pi,
+        [](void* cookie, const char*, const char* value, uint32_t serial) {
+          benchmark::DoNotOptimize(value[LocalPropertyTestState::kConfigSize - 1]);
+          *static_cast<uint32_t*>(cookie) = serial;
+        },
+        &serial);
+    if (serial != last_serial) updates++;
+    last_serial = serial;
+  }
+  done = true;
+  updater.join();
+  state.counters["updates_seen"] = benchmark::Counter(updates);
+}
+BENCHMARK(BM_property_read_callback_long_updated)->UseRealTime();
+
+// 一个线程更新，其他线程读取同一个区域中的属性。读取前后序列号不同或者带有脏位的读取
+// 就是需要重试或者从脏备份区域读取的读取
+static void BM_property_update_contended(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  const char* name = pa->names[0].c_str();
+  const prop_info* pi = pa->reader.Find(name);
+  uint64_t reads = 0;
+  uint64_t raced = 0;
+  if (state.thread_index() == 0) {
+    prop_info* wpi = pa->WriterFind(name);
+    char value[PROP_VALUE_MAX];
+    unsigned n = 0;
+    for (auto _ : state) {
+      int len = snprintf(value, sizeof(value), "%u", n++);
+      pa->writer.Update(wpi, value, len);
+    }
+  } else {
+    char value[PROP_VALUE_MAX];
+    for (auto _ : state) {
+      uint32_t before = __system_property_serial(pi);
+      pa->reader.Read(pi, nullptr, value);
+      uint32_t after = __system_property_serial(pi);
+      reads++;
+      if (before != after || (before & 1) != 0) raced++;
+    }
+    state.counters["reads"] = benchmark::Counter(reads);
+    state.counters["raced_reads"] = benchmark::Counter(raced);
+  }
+}
+BENCHMARK(BM_property_update_contended)->ThreadRange(1, 8)->UseRealTime();
+
+// 唤醒延迟：本线程更新bench.ping，另一个线程等到之后更新bench.pong，本线程再等到bench.pong
+// 写入者只允许一个线程修改，而另一个线程在Update()唤醒它之后、返回之前就可能开始更新，
+// 所以两个线程的更新由锁串行化。锁只在被唤醒的线程需要等待对方返回时才有竞争
+static void BM_property_wait_ping_pong(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  prop_info* ping = pa->WriterFind("bench.ping");
+  prop_info* pong = pa->WriterFind("bench.pong");
+  std::mutex writer_lock;
+  std::atomic<bool> done(false);
+  // 在启动线程之前读取序列号，第一次更新不会在它开始等待之前就被错过
+  uint32_t ping_serial = __system_property_serial(ping);
+  std::thread ponger([&, ping_serial]() {
+    uint32_t serial = ping_serial;
+    while (true) {
+      pa->reader.Wait(ping, serial, &serial, nullptr);
+      if (done) break;
+      std::lock_guard<std::mutex> guard(writer_lock);
+      pa->writer.Update(pong, "1", 1);
+    }
+  });
+
+  uint32_t serial = __system_property_serial(pong);
+  for (auto _ : state) {
+    {
+      std::lock_guard<std::mutex> guard(writer_lock);
+      pa->writer.Update(ping, "1", 1);
+    }
+    pa->reader.Wait(pong, serial, &serial, nullptr);
+  }
+  done = true;
+  {
+    std::lock_guard<std::mutex> guard(writer_lock);
+    pa->writer.Update(ping, "2", 1);
+  }
+  ponger.join();
+}
+BENCHMARK(BM_property_wait_ping_pong)->UseRealTime();
+
+static void BM_property_foreach(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  size_t count = 0;
+  for (auto _ : state) {
+    pa->reader.Foreach([](const prop_info*, void* cookie) { ++*static_cast<size_t*>(cookie); },
+                       &count);
+  }
+}
+BENCHMARK(BM_property_foreach);
+
+static void BM_property_find_nth(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  // 按顺序取第n个属性，这是__system_property_find_nth最常见的用法
+  for (auto _ : state) {
+    for (unsigned n = 0; pa->reader.FindNth(n) != nullptr; ++n) {
+    }
+  }
+}
+BENCHMARK(BM_property_find_nth);
+
+// 同一份设备property_contexts在两种实现下查找上下文：ContextsSplit逐个匹配文本前缀，
+// ContextsSerialized查找由它编译成的trie。读取器不会自己编译property_contexts，
+// 所以像init一样把trie写到目录中。只需要一个properties_serial，从合成区域链接一个过来
+template <typename ContextsType>
+static void ContextLookupBenchmark(benchmark::State& state) {
+  LocalPropertyTestState* pa = GetState(state);
+  if (pa == nullptr) return;
+
+  std::string dir = std::string(pa->dir) + "/contexts";
+  if (mkdir(dir.c_str(), 0755) == 0) {
+    link((std::string(pa->dir) + "/properties_serial").c_str(),
+         (dir + "/properties_serial").c_str());
+    std::string serialized, error;
+    if (BuildTrieFromPropertyContexts(&serialized, &error)) {
+      std::string property_info = dir + "/property_info";
+      int fd = open(property_info.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0444);
+      if (fd != -1) {
+        (void)write(fd, serialized.data(), serialized.size());
+        close(fd);
+      }
+    }
+  }
+
+  ContextsType* contexts = new ContextsType();
+  if (!contexts->Initialize(false, dir.c_str(), nullptr)) {
+    state.SkipWithError("Could not load the device's property_contexts");
+    delete contexts;
+    return;
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& name = pa->names[i++ % pa->names.size()];
+    benchmark::DoNotOptimize(contexts->GetContextForName(name.c_str()));
+  }
+  contexts->FreeAndUnmap();
+  delete contexts;
+}
+
+static void BM_contexts_split_lookup(benchmark::State& state) {
+  ContextLookupBenchmark<ContextsSplit>(state);
+}
+BENCHMARK(BM_contexts_split_lookup);
+
+static void BM_contexts_serialized_lookup(benchmark::State& state) {
+  ContextLookupBenchmark<ContextsSerialized>(state);
+}
+BENCHMARK(BM_contexts_serialized_lookup);
+
+// 以下两个基准读取设备本身的属性，比较每次都解析的__system_property_get和缓存解析结果的句柄
+static constexpr char kHandleName[] = "ro.property_service.version";
+
+static void BM_property_get_parse(benchmark::State& state) {
+  char value[PROP_VALUE_MAX];
+  for (auto _ : state) {
+    __system_property_get(kHandleName, value);
+    benchmark::DoNotOptimize(strtoll(value, nullptr, 0));
+  }
+}
+BENCHMARK(BM_property_get_parse);
+
+static void BM_property_handle_get_int(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Property<kHandleName>::GetInt(0));
+  }
+}
+BENCHMARK(BM_property_handle_get_int);
+
+// 属性服务的替身：读取请求并立即应答成功，只测量往返开销，不修改任何属性
+static bool ReadFully(int fd, void* buf, size_t len) {
+  char* p = static_cast<char*>(buf);
+  while (len > 0) {
+    ssize_t n = TEMP_FAILURE_RETRY(read(fd, p, len));
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool SkipString(int fd) {
+  uint32_t len;
+  if (!ReadFully(fd, &len, sizeof(len))) return false;
+  char buf[256];
+  while (len > 0) {
+    size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+    if (!ReadFully(fd, buf, chunk)) return false;
+    len -= chunk;
+  }
+  return true;
+}
+
+static void ServeClient(int fd) {
+  uint32_t cmd;
+  while (ReadFully(fd, &cmd, sizeof(cmd))) {
+    if (cmd == PROP_MSG_SETPROP) {
+      // 旧协议：固定大小的消息，关闭连接就是应答
+      char rest[PROP_NAME_MAX + PROP_VALUE_MAX];
+      ReadFully(fd, rest, sizeof(rest));
+      break;
+    }
+    if (cmd != PROP_MSG_SETPROP2 || !SkipString(fd) || !SkipString(fd)) break;
+    int32_t result = PROP_SUCCESS;
+    if (TEMP_FAILURE_RETRY(write(fd, &result, sizeof(result))) != sizeof(result)) break;
+  }
+  close(fd);
+}
+
+// /dev/socket/property_service的路径是固定的，所以在私有的挂载命名空间里把/dev/socket换成
+// tmpfs，再在上面监听。需要root权限，而且必须在启动任何线程之前调用
+static bool StartStubPropertyService() {
+  if (unshare(CLONE_NEWNS) == -1 ||
+      mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) == -1) {
+    return false;
+  }
+  struct stat st;
+  if (stat("/dev/socket", &st) == -1) {
+    // 主机上没有/dev/socket，连/dev一起换掉
+    if (mount("tmpfs", "/dev", "tmpfs", 0, "mode=0755") == -1 || mkdir("/dev/socket", 0755) == -1) {
+      return false;
+    }
+  } else if (mount("tmpfs", "/dev/socket", "tmpfs", 0, "mode=0755") == -1) {
+    return false;
+  }
+
+  int s = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_LOCAL;
+  strlcpy(addr.sun_path, "/dev/socket/" PROP_SERVICE_NAME, sizeof(addr.sun_path));
+  if (s == -1 || bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+      listen(s, 8) == -1) {
+    return false;
+  }
+  std::thread([s]() {
+    while (true) {
+      int fd = TEMP_FAILURE_RETRY(accept4(s, nullptr, nullptr, SOCK_CLOEXEC));
+      if (fd == -1) break;
+      ServeClient(fd);
+    }
+  }).detach();
+  return true;
+}
+
+static bool g_stub_property_service = false;
+
+static void BM_property_set(benchmark::State& state) {
+  if (!g_stub_property_service) {
+    state.SkipWithError("Could not start the stub property service (needs root)");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (__system_property_set("bench.set", "1") != 0) {
+      state.SkipWithError("__system_property_set failed");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_property_set)->UseRealTime();
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  g_stub_property_service = StartStubPropertyService();
+  __system_properties_init();  // __system_property_set从设备的属性中读取协议版本
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  delete g_state;
+  return 0;
+}
@@ -61,6 +61,9 @@ bool ContextNode::Open(bool access_rw, bool* fsetxattr_failed) {
   } else {  // 只读访问
     pa_ = prop_area::map_prop_area(filename, nullptr);
   }
+  if (pa_ && ranges_) {  // 记录映射的地址范围
+    ranges_->Insert(pa_);
+  }
   lock_.unlock();  // 释放锁
   return pa_;
 }
@@ -75,18 +78,41 @@ bool ContextNode::CheckAccessAndOpen() {
   return pa_;  // 返回属性区域是否存在
 }
 
+// 扩展已经以读写方式打开的属性区域
+bool ContextNode::Grow() {
+  if (!pa_) {
+    return false;
+  }
+
+  char filename[PROP_FILENAME_MAX];
+  int len = async_safe_format_buffer(filename, sizeof(filename), "%s/%s", filename_, context_);
+  if (len < 0 || len >= PROP_FILENAME_MAX) {  // 检查文件名长度
+    return false;
+  }
+
+  return pa_->grow(filename);
+}
+
 // 重置访问权限
-void ContextNode::ResetAccess() {
+// fork之后大部分上下文从未被打开过，它们的检查推迟到第一次CheckAccessAndOpen()时进行
+bool ContextNode::ResetAccess() {
+  if (!pa_) {
+    no_access_ = false;  // 下次打开之前重新检查
+    return false;
+  }
+
   if (!CheckAccess()) {  // 如果没有访问权限
     Unmap();  // 取消映射
     no_access_ = true;  // 标记为无访问权限
   } else {
     no_access_ = false;  // 重置访问权限标志
   }
+  return true;
 }
 
 // 检查访问权限
 bool ContextNode::CheckAccess() {
+  // 总是检查完整路径：libc保存的目录fd可能被进程关闭甚至重用为其他文件
   char filename[PROP_FILENAME_MAX];
   int len = async_safe_format_buffer(filename, sizeof(filename), "%s/%s", filename_, context_);
   if (len < 0 || len >= PROP_FILENAME_MAX) {  // 检查文件名长度
@@ -98,5 +124,112 @@ bool ContextNode::CheckAccess() {
 
 // 取消映射属性区域
 void ContextNode::Unmap() {
+  if (pa_ && ranges_) {  // 取消映射之前从地址范围表中删除
+    ranges_->Remove(pa_);
+  }
   prop_area::unmap_prop_area(&pa_);  // 取消映射并置空指针
 }
+
+// 初始化地址范围表
+void PropAreaRanges::Init(Range* ranges, size_t capacity) {
+  lock_.init(false);
+  atomic_init(&seq_, 0u);
+  atomic_init(&count_, 0u);
+  ranges_ = ranges;
+  capacity_ = capacity;
+}
+
+// 按地址顺序插入区域的地址范围
+void PropAreaRanges::Insert(prop_area* pa) {
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(pa);
+  const uintptr_t end = begin + pa->map_size();
+  LockGuard guard(lock_);
+  const size_t count = atomic_load_explicit(&count_, memory_order_relaxed);
+  if (ranges_ == nullptr || count == capacity_) {
+    return;  // 表不存在或已满，调用者按名称查找
+  }
+
+  // 与seqlock相同：序列号为奇数时读取者重试
+  const uint32_t seq = atomic_load_explicit(&seq_, memory_order_relaxed);
+  atomic_store_explicit(&seq_, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  size_t i = count;
+  for (; i > 0 && atomic_load_explicit(&ranges_[i - 1].begin, memory_order_relaxed) > begin; --i) {
+    atomic_store_explicit(&ranges_[i].begin,
+                          atomic_load_explicit(&ranges_[i - 1].begin, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&ranges_[i].end,
+                          atomic_load_explicit(&ranges_[i - 1].end, memory_order_relaxed),
+                          memory_order_relaxed);
+  }
+  atomic_store_explicit(&ranges_[i].begin, begin, memory_order_relaxed);
+  atomic_store_explicit(&ranges_[i].end, end, memory_order_relaxed);
+  atomic_store_explicit(&count_, count + 1, memory_order_relaxed);
+  atomic_store_explicit(&seq_, seq + 2, memory_order_release);
+}
+
+// 删除区域的地址范围
+void PropAreaRanges::Remove(prop_area* pa) {
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(pa);
+  LockGuard guard(lock_);
+  const size_t count = atomic_load_explicit(&count_, memory_order_relaxed);
+  size_t i = 0;
+  while (i < count && atomic_load_explicit(&ranges_[i].begin, memory_order_relaxed) != begin) {
+    ++i;
+  }
+  if (i == count) {
+    return;
+  }
+
+  const uint32_t seq = atomic_load_explicit(&seq_, memory_order_relaxed);
+  atomic_store_explicit(&seq_, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  for (; i + 1 < count; ++i) {
+    atomic_store_explicit(&ranges_[i].begin,
+                          atomic_load_explicit(&ranges_[i + 1].begin, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&ranges_[i].end,
+                          atomic_load_explicit(&ranges_[i + 1].end, memory_order_relaxed),
+                          memory_order_relaxed);
+  }
+  atomic_store_explicit(&count_, count - 1, memory_order_relaxed);
+  atomic_store_explicit(&seq_, seq + 2, memory_order_release);
+}
+
+// 二分查找包含addr的区域，只读取原子变量，不加锁
+prop_area* PropAreaRanges::Find(const void* addr) {
+  const uintptr_t target = reinterpret_cast<uintptr_t>(addr);
+  for (int attempt = 0; attempt < 4; ++attempt) {
+    const uint32_t seq = atomic_load_explicit(&seq_, memory_order_acquire);
+    if (seq & 1) {
+      continue;  // 正在插入或删除
+    }
+    size_t count = atomic_load_explicit(&count_, memory_order_relaxed);
+    if (count > capacity_) {
+      count = capacity_;
+    }
+
+    // 找到最后一个起始地址不大于target的范围
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (atomic_load_explicit(&ranges_[mid].begin, memory_order_relaxed) <= target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    prop_area* pa = nullptr;
+    if (lo > 0 && target < atomic_load_explicit(&ranges_[lo - 1].end, memory_order_relaxed)) {
+      pa = reinterpret_cast<prop_area*>(
+          atomic_load_explicit(&ranges_[lo - 1].begin, memory_order_relaxed));
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&seq_, memory_order_relaxed) == seq) {
+      return pa;
+    }
+  }
+  return nullptr;
+}
@@ -30,24 +30,47 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/xattr.h>
+#include <unistd.h>
 
 #include <new>
+#include <string>
 
 #include <async_safe/log.h>
+#include <property_info_serializer/property_info_serializer.h>
 
+#include "system_properties/prop_hash.h"
+#include "system_properties/prop_prefetch.h"
+#include "system_properties/prop_stats.h"
 #include "system_properties/system_properties.h"
 
+// 名称到上下文索引缓存中的一项，正好占一个缓存行
+// seq为奇数时表示有线程正在写入，为0时表示还没有使用
+struct ContextsSerialized::ContextCacheEntry {
+  static constexpr size_t kMaxNameLen = 48;
+
+  atomic_uint_least32_t seq;
+  uint32_t hash;
+  uint32_t context_index;
+  uint32_t namelen;
+  char name[kMaxNameLen];
+};
+
+static constexpr size_t kContextCacheSize = 256;  // 必须是2的幂
+
 // 初始化上下文节点数组
 bool ContextsSerialized::InitializeContextNodes() {
   auto num_context_nodes = property_info_area_file_->num_contexts();
   auto context_nodes_mmap_size = sizeof(ContextNode) * num_context_nodes;
   // 我们希望在系统属性中避免malloc，所以我们使用匿名映射代替 (b/31659220)
+  // 下面马上会构造每个节点，启用预取时一次分配全部页面
   void* const map_result = mmap(nullptr, context_nodes_mmap_size, PROT_READ | PROT_WRITE,
-                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                                MAP_PRIVATE | MAP_ANONYMOUS | kPropPrefetchMapFlags, -1, 0);
   if (map_result == MAP_FAILED) {
     return false;
   }
@@ -56,13 +79,38 @@ bool ContextsSerialized::InitializeContextNodes() {
   prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, map_result, context_nodes_mmap_size,
         "System property context nodes");
 
+  // 上下文索引缓存只是加速查找，映射失败时直接查找property_info
+  const size_t context_cache_mmap_size = sizeof(ContextCacheEntry) * kContextCacheSize;
+  void* const cache_map_result =
+      mmap(nullptr, context_cache_mmap_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | kPropPrefetchMapFlags, -1, 0);
+  if (cache_map_result != MAP_FAILED) {
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, cache_map_result, context_cache_mmap_size,
+          "System property context cache");
+    context_cache_ = reinterpret_cast<ContextCacheEntry*>(cache_map_result);
+  }
+
+  // 地址范围表同样只是加速，映射失败时按名称查找属性区域
+  void* const ranges_map_result =
+      mmap(nullptr, sizeof(PropAreaRanges::Range) * num_context_nodes, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | kPropPrefetchMapFlags, -1, 0);
+  if (ranges_map_result != MAP_FAILED) {
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, ranges_map_result,
+          sizeof(PropAreaRanges::Range) * num_context_nodes, "System property area ranges");
+    area_ranges_table_ = reinterpret_cast<PropAreaRanges::Range*>(ranges_map_result);
+    area_ranges_.Init(area_ranges_table_, num_context_nodes);
+  } else {
+    area_ranges_.Init(nullptr, 0);
+  }
+
   context_nodes_ = reinterpret_cast<ContextNode*>(map_result);
   num_context_nodes_ = num_context_nodes;
   context_nodes_mmap_size_ = context_nodes_mmap_size;
 
   // 为每个上下文创建ContextNode对象
   for (size_t i = 0; i < num_context_nodes; ++i) {
-    new (&context_nodes_[i]) ContextNode(property_info_area_file_->context(i), filename_);
+    new (&context_nodes_[i])
+        ContextNode(property_info_area_file_->context(i), filename_, &area_ranges_);
   }
 
   return true;
@@ -91,10 +139,80 @@ bool ContextsSerialized::MapSerialPropertyArea(bool access_rw, bool* fsetxattr_f
   return serial_prop_area_;
 }
 
+// 把序列化的属性信息写入缓存文件，先写临时文件再重命名，读者不会看到写了一半的文件
+// filename: 缓存文件路径
+// data: 序列化数据
+static bool WritePropertyInfoFile(const char* filename, const std::string& data) {
+  char tmp_filename[PROP_FILENAME_MAX];
+  int len = async_safe_format_buffer(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+  if (len < 0 || len >= PROP_FILENAME_MAX) {
+    return false;
+  }
+
+  unlink(tmp_filename);
+  const int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0444);
+  if (fd < 0) {
+    return false;
+  }
+  const char* context = "u:object_r:property_info:s0";
+  if (fsetxattr(fd, XATTR_NAME_SELINUX, context, strlen(context) + 1, 0) != 0) {
+    // 与map_prop_area_rw()一样，测试时的selinux策略不允许设置上下文，这里只记录日志
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc",
+                          "fsetxattr failed to set context (%s) for \"%s\"", context, tmp_filename);
+  }
+
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t result = TEMP_FAILURE_RETRY(write(fd, data.data() + written, data.size() - written));
+    if (result <= 0) {
+      close(fd);
+      unlink(tmp_filename);
+      return false;
+    }
+    written += result;
+  }
+  close(fd);
+
+  if (rename(tmp_filename, filename) != 0) {
+    unlink(tmp_filename);
+    return false;
+  }
+  return true;
+}
+
+// 没有property_info文件时，从文本格式的property_contexts编译出相同的二进制Trie，
+// 写入缓存文件供其它进程直接映射。编译需要分配堆内存，所以只在init中进行
+bool ContextsSerialized::CompilePropertyInfo(const char* property_info_filename) {
+  std::string serialized_trie;
+  std::string error;
+  if (!android::properties::BuildTrieFromPropertyContexts(&serialized_trie, &error)) {
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not compile property contexts: %s",
+                          error.c_str());
+    return false;
+  }
+
+  if (WritePropertyInfoFile(property_info_filename, serialized_trie) &&
+      property_info_area_file_.LoadPath(property_info_filename)) {
+    return true;
+  }
+  // 不能写入或者读回缓存文件时，只在init内使用编译结果，其它进程回退到分割上下文
+  return property_info_area_file_.LoadData(serialized_trie.data(), serialized_trie.size());
+}
+
 // 初始化属性信息和上下文节点
-bool ContextsSerialized::InitializeProperties() {
-  // 加载默认路径的属性信息文件
-  if (!property_info_area_file_.LoadDefaultPath()) {
+// writable: 是否以可写模式初始化
+bool ContextsSerialized::InitializeProperties(bool writable) {
+  char property_info_filename[PROP_FILENAME_MAX];
+  int len = async_safe_format_buffer(property_info_filename, sizeof(property_info_filename),
+                                     "%s/property_info", filename_);
+  if (len < 0 || len >= PROP_FILENAME_MAX) {
+    return false;
+  }
+
+  // 加载属性目录下的属性信息文件，不存在时由init从文本文件编译。读取者在libc初始化期间
+  // 运行，不能使用malloc，所以直接失败，由调用者回退到分割上下文
+  if (!property_info_area_file_.LoadPath(property_info_filename) &&
+      !(writable && CompilePropertyInfo(property_info_filename))) {
     return false;
   }
 
@@ -113,14 +231,17 @@ bool ContextsSerialized::InitializeProperties() {
 // fsetxattr_failed: 返回设置xattr是否失败
 bool ContextsSerialized::Initialize(bool writable, const char* filename, bool* fsetxattr_failed) {
   filename_ = filename;
+  if (writable) {
+    // 创建属性目录，设置适当的权限；编译出的property_info也写在这个目录下
+    mkdir(filename_, S_IRWXU | S_IXGRP | S_IXOTH);
+  }
   // 首先初始化属性信息和上下文节点
-  if (!InitializeProperties()) {
+  if (!InitializeProperties(writable)) {
+    FreeAndUnmap();
     return false;
   }
 
   if (writable) {
-    // 创建属性目录，设置适当的权限
-    mkdir(filename_, S_IRWXU | S_IXGRP | S_IXOTH);
     bool open_failed = false;
     if (fsetxattr_failed) {
       *fsetxattr_failed = false;
@@ -147,12 +268,55 @@ bool ContextsSerialized::Initialize(bool writable, const char* filename, bool* f
   return true;
 }
 
+// 根据属性名获取上下文索引，先查缓存，未命中时查找property_info并填入缓存
+// name: 属性名
+uint32_t ContextsSerialized::GetContextIndexForName(const char* name) {
+  static_assert(sizeof(ContextCacheEntry) == 64, "ContextCacheEntry should fill one cache line");
+
+  uint32_t index;
+  const size_t namelen = strlen(name);
+  if (context_cache_ == nullptr || namelen > ContextCacheEntry::kMaxNameLen) {
+    property_info_area_file_->GetPropertyInfoIndexes(name, &index, nullptr);
+    return index;
+  }
+
+  const uint32_t hash = prop_name_hash(name, namelen);
+  ContextCacheEntry* entry = &context_cache_[hash & (kContextCacheSize - 1)];
+
+  // 读取方：seq为偶数且读取前后没有变化，读到的内容才是完整的
+  uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+  if (seq != 0 && (seq & 1) == 0 && entry->hash == hash && entry->namelen == namelen &&
+      memcmp(entry->name, name, namelen) == 0) {
+    index = entry->context_index;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&entry->seq, memory_order_relaxed) == seq) {
+      PROP_STATS_ADD(kPropStatContextCacheHit, 1);
+      return index;
+    }
+  }
+  PROP_STATS_ADD(kPropStatContextCacheMiss, 1);
+
+  property_info_area_file_->GetPropertyInfoIndexes(name, &index, nullptr);
+
+  // 写入方：把seq改为奇数后再写入内容，其它线程正在写入同一项时直接放弃
+  if ((seq & 1) == 0 && atomic_compare_exchange_strong_explicit(&entry->seq, &seq, seq + 1,
+                                                                memory_order_relaxed,
+                                                                memory_order_relaxed)) {
+    atomic_thread_fence(memory_order_release);
+    entry->hash = hash;
+    entry->context_index = index;
+    entry->namelen = namelen;
+    memcpy(entry->name, name, namelen);
+    atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+  }
+  return index;
+}
+
 // 根据属性名获取对应的属性区域
 // name: 属性名
 prop_area* ContextsSerialized::GetPropAreaForName(const char* name) {
-  uint32_t index;
   // 从属性信息文件中获取上下文索引
-  property_info_area_file_->GetPropertyInfoIndexes(name, &index, nullptr);
+  uint32_t index = GetContextIndexForName(name);
   if (index == ~0u || index >= num_context_nodes_) {
     async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not find context for property \"%s\"",
                           name);
@@ -167,13 +331,43 @@ prop_area* ContextsSerialized::GetPropAreaForName(const char* name) {
   return context_node->pa();
 }
 
+// 根据prop_info的地址获取它所在的属性区域，不需要再查找属性名
+// pi: 已经映射的区域中的属性
+prop_area* ContextsSerialized::GetPropAreaForPropInfo(const prop_info* pi) {
+  prop_area* pa = area_ranges_.Find(pi);
+  return pa != nullptr ? pa : GetPropAreaForName(pi->name);
+}
+
+// 扩展属性所在的区域
+// name: 属性名
+bool ContextsSerialized::GrowPropAreaForName(const char* name) {
+  uint32_t index = GetContextIndexForName(name);
+  if (index == ~0u || index >= num_context_nodes_) {
+    return false;
+  }
+  return context_nodes_[index].Grow();
+}
+
 // 根据属性名获取对应的SELinux上下文
 // name: 属性名
 const char* ContextsSerialized::GetContextForName(const char* name) {
-  const char* context;
+  uint32_t index = GetContextIndexForName(name);
+  if (index == ~0u) {
+    return nullptr;
+  }
   // 从属性信息文件中获取上下文字符串
-  property_info_area_file_->GetPropertyInfo(name, &context, nullptr);
-  return context;
+  return property_info_area_file_->context(index);
+}
+
+// 根据属性名获取property_contexts中声明的类型
+// name: 属性名
+const char* ContextsSerialized::GetTypeForName(const char* name) {
+  uint32_t type_index;
+  property_info_area_file_->GetPropertyInfoIndexes(name, nullptr, &type_index);
+  if (type_index == ~0u) {
+    return nullptr;
+  }
+  return property_info_area_file_->type(type_index);
 }
 
 // 遍历所有属性，对每个属性执行指定的函数
@@ -189,10 +383,74 @@ void ContextsSerialized::ForEach(void (*propfn)(const prop_info* pi, void* cooki
   }
 }
 
+// 遍历名称以prefix开头的属性，跳过这些属性不可能所在的上下文
+// prefix: 属性名前缀
+// propfn: 对每个属性信息执行的函数
+// cookie: 传递给propfn的用户数据
+void ContextsSerialized::ForEachPrefix(const char* prefix,
+                                       void (*propfn)(const prop_info* pi, void* cookie),
+                                       void* cookie) {
+  // 用栈上的位图记录可能的上下文，上下文太多时不做筛选
+  constexpr size_t kMaxFilteredContexts = 4096;
+  uint8_t candidates[kMaxFilteredContexts / 8];
+  const bool filtered = prefix[0] != '\0' && num_context_nodes_ <= kMaxFilteredContexts;
+  if (filtered) {
+    memset(candidates, 0, sizeof(candidates));
+    property_info_area_file_->ForEachContextIndexForPrefix(
+        prefix,
+        [](uint32_t context_index, void* cookie) {
+          if (context_index < kMaxFilteredContexts) {
+            static_cast<uint8_t*>(cookie)[context_index / 8] |= 1 << (context_index % 8);
+          }
+        },
+        candidates);
+  }
+
+  for (size_t i = 0; i < num_context_nodes_; ++i) {
+    if (filtered && (candidates[i / 8] & (1 << (i % 8))) == 0) {
+      continue;  // 不打开不可能包含匹配属性的区域
+    }
+    if (context_nodes_[i].CheckAccessAndOpen()) {
+      context_nodes_[i].pa()->foreach_prefix(prefix, propfn, cookie);
+    }
+  }
+}
+
+// 获取第index个上下文的属性区域
+// index: 上下文索引
+// pa: 返回属性区域，没有访问权限时为nullptr
+bool ContextsSerialized::GetPropAreaForIndex(size_t index, prop_area** pa) {
+  if (index >= num_context_nodes_) {
+    return false;
+  }
+  *pa = context_nodes_[index].CheckAccessAndOpen() ? context_nodes_[index].pa() : nullptr;
+  return true;
+}
+
+// 获取属性所在上下文的索引
+bool ContextsSerialized::GetPropAreaIndexForName(const char* name, size_t* index) {
+  uint32_t context_index = GetContextIndexForName(name);
+  if (context_index == ~0u || context_index >= num_context_nodes_) {
+    return false;
+  }
+  *index = context_index;
+  return true;
+}
+
+// 获取第index个上下文的名字
+const char* ContextsSerialized::GetContextForIndex(size_t index) {
+  if (index >= num_context_nodes_) {
+    return nullptr;
+  }
+  return context_nodes_[index].context();
+}
+
 // 重置所有上下文节点的访问状态
 void ContextsSerialized::ResetAccess() {
   for (size_t i = 0; i < num_context_nodes_; ++i) {
-    context_nodes_[i].ResetAccess();
+    if (!context_nodes_[i].ResetAccess()) {
+      ++access_checks_deferred_;
+    }
   }
 }
 
@@ -208,6 +466,17 @@ void ContextsSerialized::FreeAndUnmap() {
     munmap(context_nodes_, context_nodes_mmap_size_);
     context_nodes_ = nullptr;
   }
+  if (area_ranges_table_ != nullptr) {
+    // 所有区域都已经从表中删除
+    munmap(area_ranges_table_, sizeof(PropAreaRanges::Range) * num_context_nodes_);
+    area_ranges_table_ = nullptr;
+    area_ranges_.Init(nullptr, 0);
+  }
+  if (context_cache_ != nullptr) {
+    // 缓存的索引只对当前映射的property_info有效
+    munmap(context_cache_, sizeof(ContextCacheEntry) * kContextCacheSize);
+    context_cache_ = nullptr;
+  }
   // 取消映射序列化属性区域
   prop_area::unmap_prop_area(&serial_prop_area_);
   serial_prop_area_ = nullptr;
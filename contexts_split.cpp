@@ -33,6 +33,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
 
 #include <async_safe/log.h>
 
@@ -77,6 +80,24 @@ struct PrefixNode {
   PrefixNode* next;          // 指向链表中下一个节点
 };
 
+// 前缀索引中的条目
+struct PrefixIndexEntry {
+  static constexpr uint32_t kNoParent = ~0u;
+
+  PrefixNode* node;  // 对应的前缀节点
+  uint32_t order;    // 在prefixes_链表中的位置，前缀重复时保留靠前的那个
+  uint32_t parent;   // 本身也是此前缀的前缀中最长的那个条目，没有时为kNoParent
+};
+
+// 按前缀字符串排序，相同的前缀按在链表中的位置排序
+static int compare_prefix_index_entries(const void* lhs, const void* rhs) {
+  auto l = reinterpret_cast<const PrefixIndexEntry*>(lhs);
+  auto r = reinterpret_cast<const PrefixIndexEntry*>(rhs);
+  int result = strcmp(l->node->prefix, r->node->prefix);
+  if (result != 0) return result;
+  return l->order < r->order ? -1 : (l->order > r->order ? 1 : 0);
+}
+
 // 模板函数：向链表头部添加新节点
 // List: 链表类型
 // Args: 构造函数参数类型
@@ -334,20 +355,73 @@ bool ContextsSplit::InitializeProperties() {
   return true;
 }
 
+// 根据prefixes_链表构建排序的前缀索引
+// 对于任意名称，所有是它前缀的条目都不大于最后一个不大于该名称的条目e，
+// 并且也是e的前缀，所以沿着e的parent链就能找到最长的匹配前缀
+bool ContextsSplit::BuildPrefixIndex() {
+  size_t count = 0;
+  ListForEach(prefixes_, [&count](PrefixNode* l) {
+    if (l->prefix[0] != '*') count++;
+  });
+
+  auto index = new (std::nothrow) PrefixIndexEntry[count ? count : 1];
+  if (!index) {
+    return false;
+  }
+
+  uint32_t order = 0;
+  size_t n = 0;
+  wildcard_prefix_ = nullptr;
+  ListForEach(prefixes_, [&](PrefixNode* l) {
+    if (l->prefix[0] == '*') {  // 通配符只在没有前缀匹配时使用，链表中的第一个生效
+      if (!wildcard_prefix_) wildcard_prefix_ = l;
+    } else {
+      index[n++] = {l, order, PrefixIndexEntry::kNoParent};
+    }
+    order++;
+  });
+  qsort(index, n, sizeof(*index), compare_prefix_index_entries);
+
+  // 去掉重复的前缀（ListFind总是先找到链表中靠前的那个），同时计算parent
+  size_t unique = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (unique > 0 && !strcmp(index[unique - 1].node->prefix, index[i].node->prefix)) {
+      continue;
+    }
+    index[unique] = index[i];
+    uint32_t parent = unique > 0 ? unique - 1 : PrefixIndexEntry::kNoParent;
+    while (parent != PrefixIndexEntry::kNoParent &&
+           strncmp(index[parent].node->prefix, index[unique].node->prefix,
+                   index[parent].node->prefix_len) != 0) {
+      parent = index[parent].parent;
+    }
+    index[unique].parent = parent;
+    unique++;
+  }
+
+  prefix_index_ = index;
+  num_prefix_index_ = unique;
+  return true;
+}
+
 // 初始化ContextsSplit实例
 // writable: 是否以可写模式初始化
 // filename: 属性文件目录路径
 // fsetxattr_failed: 返回设置xattr是否失败
 bool ContextsSplit::Initialize(bool writable, const char* filename, bool* fsetxattr_failed) {
   filename_ = filename;
+  if (writable) {
+    // 创建属性目录，设置适当的权限
+    mkdir(filename_, S_IRWXU | S_IXGRP | S_IXOTH);
+  }
   // 首先初始化属性上下文映射
   if (!InitializeProperties()) {
+    FreeAndUnmap();
     return false;
   }
+  BuildPrefixIndex();  // 失败时GetPrefixNodeForName()回退到遍历链表
 
   if (writable) {
-    // 创建属性目录，设置适当的权限
-    mkdir(filename_, S_IRWXU | S_IXGRP | S_IXOTH);
     bool open_failed = false;
     if (fsetxattr_failed) {
       *fsetxattr_failed = false;
@@ -377,12 +451,37 @@ bool ContextsSplit::Initialize(bool writable, const char* filename, bool* fsetxa
 // 根据属性名获取对应的前缀节点
 // name: 属性名
 PrefixNode* ContextsSplit::GetPrefixNodeForName(const char* name) {
-  // 查找匹配的前缀节点，支持通配符(*)或前缀匹配
-  auto entry = ListFind(prefixes_, [name](PrefixNode* l) {
-    return l->prefix[0] == '*' || !strncmp(l->prefix, name, l->prefix_len);
-  });
+  if (!prefix_index_) {
+    // 查找匹配的前缀节点，支持通配符(*)或前缀匹配
+    auto entry = ListFind(prefixes_, [name](PrefixNode* l) {
+      return l->prefix[0] == '*' || !strncmp(l->prefix, name, l->prefix_len);
+    });
+
+    return entry;
+  }
+
+  // 二分查找最后一个不大于name的前缀
+  size_t low = 0;
+  size_t high = num_prefix_index_;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (strcmp(prefix_index_[mid].node->prefix, name) <= 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
 
-  return entry;
+  // 沿着parent链找到第一个是name前缀的条目，即最长的匹配前缀
+  uint32_t i = low > 0 ? low - 1 : PrefixIndexEntry::kNoParent;
+  while (i != PrefixIndexEntry::kNoParent) {
+    const PrefixNode* node = prefix_index_[i].node;
+    if (!strncmp(node->prefix, name, node->prefix_len)) {
+      return prefix_index_[i].node;
+    }
+    i = prefix_index_[i].parent;
+  }
+  return wildcard_prefix_;
 }
 
 // 根据属性名获取对应的属性区域
@@ -402,6 +501,16 @@ prop_area* ContextsSplit::GetPropAreaForName(const char* name) {
   return cnode->pa();
 }
 
+// 扩展属性所在的区域
+// name: 属性名
+bool ContextsSplit::GrowPropAreaForName(const char* name) {
+  auto entry = GetPrefixNodeForName(name);
+  if (!entry) {
+    return false;
+  }
+  return entry->context->Grow();
+}
+
 // 根据属性名获取对应的SELinux上下文
 // name: 属性名
 const char* ContextsSplit::GetContextForName(const char* name) {
@@ -425,13 +534,76 @@ void ContextsSplit::ForEach(void (*propfn)(const prop_info* pi, void* cookie), v
   });
 }
 
+// 遍历名称以prefix开头的属性
+// prefix: 属性名前缀
+// propfn: 对每个属性信息执行的函数
+// cookie: 传递给propfn的用户数据
+void ContextsSplit::ForEachPrefix(const char* prefix,
+                                  void (*propfn)(const prop_info* pi, void* cookie), void* cookie) {
+  // 链表中没有上下文到属性名的反向映射，所以每个可访问的区域都要查看，但只遍历匹配的子树
+  ListForEach(contexts_, [prefix, propfn, cookie](ContextListNode* l) {
+    if (l->CheckAccessAndOpen()) {
+      l->pa()->foreach_prefix(prefix, propfn, cookie);
+    }
+  });
+}
+
+// 获取第index个上下文的属性区域
+// index: 上下文在链表中的位置
+// pa: 返回属性区域，没有访问权限时为nullptr
+bool ContextsSplit::GetPropAreaForIndex(size_t index, prop_area** pa) {
+  ContextListNode* l = contexts_;
+  for (; l != nullptr && index > 0; --index) {
+    l = l->next;
+  }
+  if (l == nullptr) {
+    return false;
+  }
+  *pa = l->CheckAccessAndOpen() ? l->pa() : nullptr;
+  return true;
+}
+
+// 获取属性所在上下文在链表中的位置
+bool ContextsSplit::GetPropAreaIndexForName(const char* name, size_t* index) {
+  auto entry = GetPrefixNodeForName(name);
+  if (!entry) {
+    return false;
+  }
+
+  size_t i = 0;
+  for (ContextListNode* l = contexts_; l != nullptr; l = l->next, ++i) {
+    if (l == entry->context) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 获取链表中第index个上下文的名字
+const char* ContextsSplit::GetContextForIndex(size_t index) {
+  ContextListNode* l = contexts_;
+  for (; l != nullptr && index > 0; --index) {
+    l = l->next;
+  }
+  return l != nullptr ? l->context() : nullptr;
+}
+
 // 重置所有上下文节点的访问状态
 void ContextsSplit::ResetAccess() {
-  ListForEach(contexts_, [](ContextListNode* l) { l->ResetAccess(); });
+  ListForEach(contexts_, [this](ContextListNode* l) {
+    if (!l->ResetAccess()) {
+      ++access_checks_deferred_;
+    }
+  });
 }
 
 // 释放内存并取消映射所有资源
 void ContextsSplit::FreeAndUnmap() {
+  delete[] prefix_index_;                              // 释放前缀索引
+  prefix_index_ = nullptr;
+  num_prefix_index_ = 0;
+  wildcard_prefix_ = nullptr;
   ListFree(&prefixes_);                                // 释放前缀节点链表
   ListFree(&contexts_);                                // 释放上下文节点链表
   prop_area::unmap_prop_area(&serial_prop_area_);      // 取消映射序列化属性区域
@@ -31,6 +31,7 @@
 
 #include <sys/cdefs.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #ifndef _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #error you should #include <sys/system_properties.h> instead
@@ -94,6 +95,25 @@ int __system_property_area_init(void);
 */
 uint32_t __system_property_area_serial(void);
 
+/* Read the serial number of the context that holds a property.
+**
+** Like __system_property_area_serial, but only changes when a property in
+** the same SELinux context as name is added, updated or deleted, so that a
+** cache of one context's properties isn't invalidated by unrelated changes.
+** name doesn't need to exist; any name that maps to the context will do.
+**
+** Returns the serial number on success, -1 on error.
+*/
+uint32_t __system_property_context_serial(const char* __name);
+
+/* Wait for the serial number returned by __system_property_context_serial
+** for name to differ from old_serial.
+**
+** Returns true and updates *new_serial_ptr on success, false on timeout or
+** error.
+*/
+bool __system_property_context_wait(const char* __name, uint32_t __old_serial, uint32_t* __new_serial_ptr, const struct timespec* __relative_timeout);
+
 /* Add a new system property.  Can only be done by a single
 ** process that has write access to the property area, and
 ** that process must handle sequencing to ensure the property
@@ -104,22 +124,103 @@ uint32_t __system_property_area_serial(void);
 */
 int __system_property_add(const char* __name, unsigned int __name_length, const char* __value, unsigned int __value_length);
 
+/* One property for __system_property_add_many.  The fields starting with
+** two underscores are scratch space for the call.
+*/
+typedef struct prop_bulk_entry {
+  const char* name;
+  const char* value;
+  int result;                /* set to 0 if the property was added, -1 otherwise */
+  uint32_t __context_index;
+  size_t __position;
+} prop_bulk_entry;
+
+/* Add many new system properties at once, such as those of the build.prop
+** files at boot.  Can only be done by the process that has write access to
+** the property area.
+**
+** Equivalent to calling __system_property_add for each entry in order
+** within one batch (see __system_property_batch_begin), but the entries are
+** first sorted by context and name, which lets each area's trie be built in
+** one pass with the properties of every subtree next to each other, and
+** each area's serial and the global serial are only incremented once.  The
+** entries are left in that sorted order; if a name is listed more than
+** once, the first entry for it is the one whose value is used.
+**
+** Returns 0 if every property was added, -1 otherwise.
+*/
+int __system_property_add_many(prop_bulk_entry* __entries, size_t __count);
+
 /* Update the value of a system property returned by
 ** __system_property_find.  Can only be done by a single process
 ** that has write access to the property area, and that process
 ** must handle sequencing to ensure that only one property is
 ** updated at a time.
 **
+** Values of PROP_VALUE_MAX bytes or more are stored out of line, and so is
+** every later value of a property once it has had one.  Each such update
+** writes the new value to a fresh block, swaps it in and frees the old one,
+** so __system_property_read_callback copies the value before using it and
+** retries if it was updated meanwhile.  The values of properties other than
+** ro.* ones are therefore limited to 4095 bytes, and ro.* properties, whose
+** long values are read in place, can't be updated to or from a long value.
+**
 ** Returns 0 on success, -1 if the parameters are incorrect.
 */
 int __system_property_update(prop_info* __pi, const char* __value, unsigned int __value_length);
 
 /* Delete a system property.
 **
+** A prop_info returned by __system_property_find for it stays valid and keeps
+** naming the same property: it reads as an empty value, and if the property is
+** added again, the same prop_info gets the new value.
+**
 ** Returns 0 on success, -1 if the property area is full.
 */
 int __system_property_delete(const char *__name, bool __prune);
 
+/* Seal the ro.* properties into a read-only perfect hash table in each
+** property area.  Can only be done once, by the process that has write
+** access to the property area, typically once boot has completed.
+**
+** Afterwards __system_property_find locates the sealed properties through
+** the table without walking the property tries. ro.* properties added later
+** are still found, and ro.* properties can no longer be deleted.
+**
+** Returns 0 on success, -1 if some area could not be sealed; its
+** properties are still found the usual way.
+*/
+int __system_property_seal_read_only(void);
+
+/* Start a batch of changes.  Can only be done by the process that has
+** write access to the property area.
+**
+** Until the matching __system_property_batch_commit, __system_property_add
+** and __system_property_update still publish each property as usual, but
+** leave the global serial alone, so that waiters in
+** __system_property_wait_any are woken once for the whole batch instead of
+** once per change.  __system_property_delete still increments the global
+** serial, so that no thread's lookup cache keeps returning the deleted
+** property.  Batches may be nested; only the outermost commit counts.
+**
+** Returns 0 on success, -1 on error.
+*/
+int __system_property_batch_begin(void);
+
+/* Finish a batch started by __system_property_batch_begin, incrementing the
+** global serial once if anything changed.
+**
+** Returns 0 on success, -1 on error or if no batch was started.
+*/
+int __system_property_batch_commit(void);
+
+/* Check whether the writer is in the middle of a batch of changes.
+**
+** A caller that has seen an individual property change can use this to
+** tell whether more related changes are still to come; the global serial
+** changes once the batch has been applied as a whole.
+*/
+bool __system_property_batch_in_progress(void);
 
 /* Get context of a property.
 **
@@ -127,6 +228,140 @@ int __system_property_delete(const char *__name, bool __prune);
 **/
 const char* __system_property_get_context(const char* __name);
 
+/* Get the type property_contexts declares for a property.
+**
+** Returns a string such as "bool", "int" or "enum a b c", or nullptr if the
+** property_contexts in use don't record a type for the property.
+**/
+const char* __system_property_get_type(const char* __name);
+
+/* Look up several system properties in one call.
+**
+** For each i < count, copies the value of names[i] into values[i], which
+** must point to a buffer of at least PROP_VALUE_MAX bytes. Properties that
+** don't exist (or can't be accessed) get an empty string, as with
+** __system_property_get. Names are grouped by property area internally, so
+** passing names with shared prefixes in one call is cheaper than looking
+** them up one at a time.
+**
+** Returns the number of properties found, -1 on error.
+*/
+int __system_property_get_many(const char* const __names[], char* const __values[], size_t __count);
+
+/* Like __system_property_foreach, but only passes the properties whose
+** names start with prefix. Areas that can't hold such properties are not
+** opened, and only the part of each area's trie below the prefix is walked,
+** so this is much cheaper than filtering the output of
+** __system_property_foreach. An empty prefix passes every property.
+**
+** Returns 0 on success, -1 if the property area is not initialized.
+*/
+int __system_property_foreach_prefix(const char* __prefix,
+                                     void (*__callback)(const prop_info* __pi, void* __cookie),
+                                     void* __cookie);
+
+/* Copy a consistent snapshot of every accessible system property into
+** buffer, which needs to be len bytes long. The snapshot is a copy of the
+** used part of each property area, so taking one costs a few memcpys rather
+** than a callback and a read loop per property. If a writer changes any
+** property while the areas are being copied, the copy is retried.
+**
+** If serial_ptr is non-NULL, it is set to the value __system_property_area_serial
+** had while the snapshot was taken.
+**
+** Returns the size of the snapshot. If that is more than len, no snapshot was
+** written and the call should be repeated with a larger buffer. Returns -1
+** on error, with errno set to EAGAIN if properties kept changing.
+*/
+ssize_t __system_property_snapshot(void* __buffer, size_t __len, uint32_t* __serial_ptr);
+
+/* Call callback with the name, value and serial of every property in a
+** snapshot taken by __system_property_snapshot. This only reads the snapshot,
+** so the values are those from when the snapshot was taken.
+**
+** Returns 0 on success, -1 if the buffer doesn't hold a valid snapshot.
+*/
+int __system_property_snapshot_foreach(const void* __snapshot, size_t __len,
+    void (*__callback)(void* __cookie, const char* __name, const char* __value, uint32_t __serial),
+    void* __cookie);
+
+/* The position of a walk over all system properties. Its contents are
+** private; it is only meant to be passed to the functions below, and it
+** lives in caller memory so that walking the properties never allocates.
+*/
+typedef struct prop_cursor {
+  uint64_t __private[36];
+} prop_cursor;
+
+/* Start walking all system properties, in the same order as
+** __system_property_foreach, one at a time with
+** __system_property_cursor_next. Unlike calling __system_property_find_nth
+** with increasing n, each step takes amortized constant time.
+*/
+void __system_property_cursor_begin(prop_cursor* __cursor);
+
+/* Return the next property of the walk started by
+** __system_property_cursor_begin, or NULL once every property has been
+** returned. Properties added during the walk may or may not be returned.
+*/
+const prop_info* __system_property_cursor_next(prop_cursor* __cursor);
+
+/* Find out which system properties changed after the global serial was
+** serial, without walking all of them.
+**
+** serial is a value previously returned by __system_property_area_serial
+** or __system_property_wait_any. The property service keeps a log of its
+** most recent changes, and the properties changed since then are stored in
+** out, at most max of them, each once, in the order of their last change.
+** Read __system_property_area_serial before calling this to know what to
+** pass next time; a change made in between may be reported twice.
+**
+** Returns the number of properties stored in out, or -1 if the log can't
+** tell, because it no longer goes back that far, a property was deleted,
+** more than max properties changed, or this process numbers the property
+** contexts differently from the property service, which happens if it
+** couldn't read the serialized property_info. The caller then has to fall back to
+** __system_property_foreach.
+*/
+int __system_property_changes_since(uint32_t __serial, const prop_info* __out[], size_t __max);
+
+/* Start setting a system property without waiting for the property service.
+**
+** Sends the same request as __system_property_set and returns at once with
+** a socket (O_CLOEXEC | O_NONBLOCK) that becomes readable when the property
+** service has handled the request, so that it can be added to a poll or epoll
+** loop. The caller must pass it to __system_property_set_finish exactly once.
+** If the property service is too busy to accept the connection or the
+** request, this waits for at most 250ms rather than blocking.
+**
+** Returns the socket on success, -1 if the request couldn't be sent.
+*/
+int __system_property_set_async(const char* __key, const char* __value);
+
+/* Collect the result of __system_property_set_async and close its socket.
+** Blocks if the property service hasn't replied yet. With the old property
+** service protocol, which has no reply, it waits for at most 250ms, like
+** __system_property_set, and reports success if the service is slower.
+**
+** Returns 0 if the property was set, -1 otherwise.
+*/
+int __system_property_set_finish(int __fd);
+
+/* Set several system properties.
+**
+** Equivalent to calling __system_property_set for each keys[i]/values[i]
+** pair in order, but if the property service supports it (protocol version
+** 3), the requests are pipelined over one connection that is kept open and
+** reused by later calls in the same process. A request is only sent again
+** on a new connection if the kept one was closed before any of it was sent;
+** once a request is sent, a failed reply makes it fail rather than repeat it.
+** If results is not NULL, results[i] is set to 0 if keys[i] was set and -1
+** otherwise, so -1 may also mean that the service never replied.
+**
+** Returns 0 if every property was set, -1 otherwise.
+*/
+int __system_property_set_many(const char* const __keys[], const char* const __values[], size_t __count, int __results[]);
+
 /* Read the serial number of a system property returned by
 ** __system_property_find.
 **
@@ -142,6 +377,109 @@ uint32_t __system_property_serial(const prop_info* __pi);
  */
 int __system_properties_init(void);
 
+/* Wait for any one of several system properties to change.
+**
+** Like __system_property_wait, but for count (at most 128) properties at
+** once: pis[i] is either a prop_info returned by __system_property_find or
+** NULL for the global serial, and old_serials[i] is the serial the caller
+** last saw for it.  On kernels with futex_waitv(2) this sleeps on exactly
+** those serials; on older kernels it wakes on every change to the global
+** serial and rechecks them.
+**
+** Returns true and sets *index_ptr to the index of a property whose serial
+** differs from old_serials[i], false on timeout or error.
+*/
+bool __system_property_wait_many(const prop_info* const __pis[], const uint32_t __old_serials[], size_t __count, const struct timespec* __relative_timeout, size_t* __index_ptr);
+
+/* Counters for this process's use of system properties, for monitoring
+** contention and lookups in production. They only count while libc was
+** built with SYSTEM_PROPERTIES_STATS.
+*/
+#define PROP_STATS_LATENCY_BUCKETS 16
+typedef struct prop_stats {
+  uint64_t finds;                  /* __system_property_find and the lookups of _get */
+  uint64_t find_cache_hits;        /* finds answered by the per-thread cache */
+  uint64_t find_misses;            /* finds that returned NULL */
+  uint64_t reads;                  /* value reads */
+  uint64_t read_retries;           /* reads repeated because the value changed meanwhile */
+  uint64_t read_backup_copies;     /* reads taken from the dirty backup area */
+  uint64_t updates;                /* __system_property_update, in the property service */
+  uint64_t futex_wakes;            /* wake-ups issued by updates and serial changes */
+  uint64_t context_cache_hits;     /* name to context lookups answered by the cache */
+  uint64_t context_cache_misses;
+  uint64_t access_checks_deferred; /* access checks skipped by re-initialization */
+  uint64_t sets;                   /* __system_property_set calls */
+  uint64_t set_failures;
+  /* __system_property_set round trips: bucket 0 counts those under 1us,
+  ** bucket i those from 2^(i-1) up to 2^i us, and the last one the rest. */
+  uint64_t set_latency_us[PROP_STATS_LATENCY_BUCKETS];
+} prop_stats;
+
+/* Copy this process's property counters into stats.
+**
+** Returns 0 on success, -1 if libc was built without them.
+*/
+int __system_property_get_stats(prop_stats* __stats);
+
+/* Call callback with the fill level of every property area this process can
+** read: bytes_used is how much of the area's data has been handed out,
+** bytes_free how much of that was freed again and can be reused, and
+** bytes_max the size the area can grow to. An area is close to exhaustion
+** when bytes_used - bytes_free approaches bytes_max. The values are read
+** without synchronization, so they can be slightly stale.
+**
+** Returns 0 on success, -1 on error.
+*/
+int __system_property_area_usage(void (*__callback)(void* __cookie, const char* __context, uint32_t __bytes_used, uint32_t __bytes_free, uint32_t __bytes_max), void* __cookie);
+
+/* A watch on several serials that can be added to a poll, epoll or io_uring
+** loop instead of blocking a thread in __system_property_wait.
+*/
+typedef struct prop_watch prop_watch;
+
+/* Start watching for changes to any of count properties, where pis[i] is
+** either a prop_info returned by __system_property_find or NULL for the
+** global serial, and to the context serials (see
+** __system_property_context_serial) of the context_count properties named
+** in context_names. A watch can have at most 127 serials.
+**
+** All the watches of a process are served by one thread with a small stack,
+** started by the first watch and stopped after the last one is destroyed. It
+** sleeps on exactly the watched serials with futex_waitv(2) while they total
+** at most 127, and otherwise, or on kernels before 5.16, wakes on every change
+** to the global serial and rechecks them. The thread isn't inherited by
+** fork(): in the child, an inherited watch's fd never becomes readable again,
+** and the watch can only be destroyed.
+**
+** Returns the watch, or NULL on error.
+*/
+prop_watch* __system_property_watch_create(const prop_info* const __pis[], size_t __count, const char* const __context_names[], size_t __context_count);
+
+/* Return the eventfd (O_CLOEXEC, O_NONBLOCK) of a watch. It becomes readable
+** once any watched serial has changed since the watch was created or the fd
+** was last read; reading it returns the number of changes seen and resets
+** it. The caller then has to check which serials changed.
+*/
+int __system_property_watch_fd(const prop_watch* __watch);
+
+/* Stop a watch, close its fd and free it. This may also be called in a child
+** process for a watch inherited from its parent. */
+void __system_property_watch_destroy(prop_watch* __watch);
+
+typedef struct prop_name prop_name;
+
+/* Look up a property name described by make_prop_name() in
+** <system_properties/prop_name.h>, without scanning the name again.
+**
+** context_index holds the index of the property's context, or ~0u to
+** have it looked up and stored there. Passing the stored index back on
+** later calls for the same name skips the property_contexts lookup.
+**
+** Returns the prop_info, or NULL if the property doesn't exist or its
+** context can't be accessed.
+*/
+const prop_info* __system_property_find_name(const prop_name* __name, uint32_t* __context_index);
+
 /* Deprecated: use __system_property_wait instead. */
 uint32_t __system_property_wait_any(uint32_t __old_serial);
 
@@ -57,6 +57,12 @@ class ScopedFd final {
     return fd_;
   }
 
+  int release() {
+    int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
+
  private:
   int fd_;
 
@@ -32,8 +32,10 @@
 #include <linux/futex.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/cdefs.h>
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 struct timespec;
@@ -70,6 +72,38 @@ static inline int __futex_wait_ex(volatile void* ftx, bool shared, int value) {
 __LIBC_HIDDEN__ int __futex_wait_ex(volatile void* ftx, bool shared, int value,
                                     bool use_realtime_clock, const timespec* abs_timeout);
 
+// futex_waitv(2) was added in Linux 5.16, so older uapi headers may not have it.
+#if !defined(__NR_futex_waitv)
+#define __NR_futex_waitv 449
+#endif
+
+// Matches the kernel's struct futex_waitv. It is declared here under a different name so that
+// this header works with uapi headers both with and without it.
+struct __futex_waitv_entry {
+  uint64_t val;
+  uint64_t uaddr;
+  uint32_t flags;
+  uint32_t __reserved;
+};
+
+#define __FUTEX_WAITV_MAX 128
+#define __FUTEX2_SIZE_U32 0x02
+#define __FUTEX2_PRIVATE 128
+
+// Waits until any one of |count| 32-bit shared futexes no longer holds its expected value, or until
+// |abs_timeout| (CLOCK_MONOTONIC) passes. Returns the index of a futex that was woken, or a negative
+// errno: -EAGAIN if a value had already changed, -ETIMEDOUT, or -ENOSYS on kernels before 5.16.
+static inline int __futex_waitv(struct __futex_waitv_entry* waiters, unsigned int count,
+                                const timespec* abs_timeout) {
+  int saved_errno = errno;
+  int result = syscall(__NR_futex_waitv, waiters, count, 0, abs_timeout, CLOCK_MONOTONIC);
+  if (__predict_false(result == -1)) {
+    result = -errno;
+    errno = saved_errno;
+  }
+  return result;
+}
+
 static inline int __futex_pi_unlock(volatile void* ftx, bool shared) {
   return __futex(ftx, shared ? FUTEX_UNLOCK_PI : FUTEX_UNLOCK_PI_PRIVATE, 0, nullptr, 0);
 }
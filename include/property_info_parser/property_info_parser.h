@@ -52,6 +52,17 @@ struct TrieNodeInternal {
   // Exact matches are a sorted list of exact matches at this node_; binary search them.
   uint32_t num_exact_matches;
   uint32_t exact_match_entries;
+
+  // Only present from version 2. These only add to the node, so version 1 readers, which never
+  // look past exact_match_entries, can still parse the data and minimum_supported_version stays 1.
+
+  // The lengths of the child node names, in the same order as child_nodes. The binary search over
+  // the children compares names with memcmp() up to the shorter length, so it doesn't have to look
+  // for the end of either name.
+  uint32_t child_lengths;
+
+  // The lengths of the prefixes, in the same order as prefix_entries.
+  uint32_t prefix_lengths;
 };
 
 struct PropertyInfoAreaHeader {
@@ -71,6 +82,10 @@ class SerializedData {
     return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base_)->size;
   }
 
+  uint32_t current_version() const {
+    return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base_)->current_version;
+  }
+
   const char* c_string(uint32_t offset) const {
     if (offset != 0 && offset > size()) return nullptr;
     return static_cast<const char*>(data_base_ + offset);
@@ -115,6 +130,15 @@ class TrieNode {
 
   bool FindChildForString(const char* input, uint32_t namelen, TrieNode* child) const;
 
+  // Whether the node has the version 2 child_lengths and prefix_lengths arrays.
+  bool has_lengths() const { return serialized_data_->current_version() >= 2; }
+  const uint32_t* child_lengths() const {
+    return serialized_data_->uint32_array(trie_node_base_->child_lengths);
+  }
+  const uint32_t* prefix_lengths() const {
+    return serialized_data_->uint32_array(trie_node_base_->prefix_lengths);
+  }
+
   uint32_t num_prefixes() const { return trie_node_base_->num_prefixes; }
   const PropertyEntry* prefix(int n) const {
     uint32_t prefix_entry_offset =
@@ -145,6 +169,11 @@ class PropertyInfoArea : private SerializedData {
  public:
   void GetPropertyInfoIndexes(const char* name, uint32_t* context_index, uint32_t* type_index) const;
   void GetPropertyInfo(const char* property, const char** context, const char** type) const;
+  // Calls |fn| with the index of every context that a property whose name starts with |prefix|
+  // could be in, so that callers can skip the rest. An index may be reported more than once.
+  void ForEachContextIndexForPrefix(const char* prefix,
+                                    void (*fn)(uint32_t context_index, void* cookie),
+                                    void* cookie) const;
 
   int FindContextIndex(const char* context) const;
   int FindTypeIndex(const char* type) const;
@@ -172,8 +201,12 @@ class PropertyInfoArea : private SerializedData {
   TrieNode root_node() const { return trie(header()->root_offset); }
 
  private:
-  void CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                        uint32_t* context_index, uint32_t* type_index) const;
+  void CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                        const TrieNode& trie_node, uint32_t* context_index,
+                        uint32_t* type_index) const;
+  void ForEachContextIndexInSubtree(const TrieNode& trie_node,
+                                    void (*fn)(uint32_t context_index, void* cookie),
+                                    void* cookie) const;
 
   const PropertyInfoAreaHeader* header() const {
     return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base());
@@ -204,6 +237,9 @@ class PropertyInfoAreaFile {
 
   bool LoadDefaultPath();
   bool LoadPath(const char* filename);
+  // Copies serialized data built in this process, such as the output of BuildTrie(), into a
+  // private anonymous mapping, so that it can be used without first being written to a file.
+  bool LoadData(const void* data, size_t size);
 
   const PropertyInfoArea* operator->() const {
     return reinterpret_cast<const PropertyInfoArea*>(mmap_base_);
@@ -0,0 +1,59 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PROPERTY_INFO_SERIALIZER_H
+#define PROPERTY_INFO_SERIALIZER_H
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace properties {
+
+struct PropertyInfoEntry {
+  PropertyInfoEntry() {}
+  PropertyInfoEntry(const std::string& name, const std::string& context, const std::string& type,
+                    bool exact_match)
+      : name(name), context(context), type(type), exact_match(exact_match) {}
+  std::string name;
+  std::string context;
+  std::string type;
+  bool exact_match = false;
+};
+
+// Builds the binary trie that PropertyInfoArea reads out of the given entries. Entries are
+// matched the same way ContextsSplit matches its prefixes: the longest matching prefix wins, and
+// if the same name is listed more than once, the first entry is used. default_context and
+// default_type apply to names that match no entry; either may be empty.
+bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
+               const std::string& default_context, const std::string& default_type,
+               std::string* serialized_trie, std::string* error);
+
+// Appends the entries of a text property_contexts file, in the "<prefix> <context>" format that
+// ContextsSplit parses, to property_infos. ctl.* entries are skipped as init never creates
+// properties for them, and wildcard ("*") entries replace *default_context instead of being
+// appended, as the most recently listed one is the one ContextsSplit uses.
+bool ParsePropertyContextsFile(const char* filename, std::vector<PropertyInfoEntry>* property_infos,
+                               std::string* default_context);
+
+// Reads the text property_contexts files from the same locations ContextsSplit does and builds
+// their serialized trie.
+bool BuildTrieFromPropertyContexts(std::string* serialized_trie, std::string* error);
+
+}  // namespace properties
+}  // namespace android
+
+#endif
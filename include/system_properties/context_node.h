@@ -32,10 +32,39 @@
 
 #include "prop_area.h"
 
+// The address ranges reserved by a set of mapped areas, sorted by address, so that the area a
+// prop_info lies in can be found with a binary search instead of looking its name up in
+// property_info again. ContextNodes insert their area when they map it and remove it before they
+// unmap it. Changes are serialized by a lock and published through a seqlock; Find() retries a few
+// times if it overlaps one and then gives up, in which case callers fall back to the name.
+class PropAreaRanges {
+ public:
+  struct Range {
+    atomic_uintptr_t begin;
+    atomic_uintptr_t end;
+  };
+
+  // |ranges| must have room for |capacity| entries, one for each ContextNode that may insert.
+  void Init(Range* ranges, size_t capacity);
+  void Insert(prop_area* pa);
+  void Remove(prop_area* pa);
+  // Returns the area whose reserved range contains |addr|, or nullptr if there is none or the
+  // table kept changing during the lookup.
+  prop_area* Find(const void* addr);
+
+ private:
+  Lock lock_;
+  atomic_uint_least32_t seq_ = 0;
+  atomic_size_t count_ = 0;
+  Range* ranges_ = nullptr;
+  size_t capacity_ = 0;
+};
+
 class ContextNode {
  public:
-  ContextNode(const char* context, const char* filename)
-      : context_(context), pa_(nullptr), no_access_(false), filename_(filename) {
+  // |ranges|, if not null, tracks the area while it is mapped.
+  ContextNode(const char* context, const char* filename, PropAreaRanges* ranges = nullptr)
+      : context_(context), pa_(nullptr), no_access_(false), filename_(filename), ranges_(ranges) {
     lock_.init(false);
   }
   ~ContextNode() {
@@ -46,7 +75,10 @@ class ContextNode {
 
   bool Open(bool access_rw, bool* fsetxattr_failed);
   bool CheckAccessAndOpen();
-  void ResetAccess();
+  bool Grow();
+  // Rechecks access to a mapped area, and unmaps it if it is no longer readable. An area that isn't
+  // mapped is only checked by the next CheckAccessAndOpen(), and false is returned for it.
+  bool ResetAccess();
   void Unmap();
 
   const char* context() const {
@@ -64,4 +96,5 @@ class ContextNode {
   prop_area* pa_;
   bool no_access_;
   const char* filename_;
+  PropAreaRanges* ranges_;
 };
@@ -38,10 +38,36 @@ class Contexts {
 
   virtual bool Initialize(bool writable, const char* filename, bool* fsetxattr_failed) = 0;
   virtual prop_area* GetPropAreaForName(const char* name) = 0;
+  // The area |pi| lies in. Contexts that can tell from its address skip the lookup by name.
+  virtual prop_area* GetPropAreaForPropInfo(const prop_info* pi) {
+    return GetPropAreaForName(pi->name);
+  }
+  // Grows the area that GetPropAreaForName() returns for |name| after it ran out of space.
+  virtual bool GrowPropAreaForName(const char* name) = 0;
   virtual prop_area* GetSerialPropArea() = 0;
   virtual const char* GetContextForName(const char* name) = 0;
+  // The type property_contexts declares for |name|, or nullptr if the format doesn't keep types.
+  virtual const char* GetTypeForName(const char*) {
+    return nullptr;
+  }
   virtual void ForEach(void (*propfn)(const prop_info* pi, void* cookie), void* cookie) = 0;
+  // Like ForEach(), but only for properties whose names start with |prefix|. Contexts that no such
+  // property can be in may be skipped without being opened.
+  virtual void ForEachPrefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                             void* cookie) = 0;
+  // Returns false if |index| is past the last context. Otherwise sets |*pa| to the area of the
+  // index'th context, or to nullptr if it can't be accessed, so that callers can walk the areas in
+  // the same order as ForEach() does, one at a time.
+  virtual bool GetPropAreaForIndex(size_t index, prop_area** pa) = 0;
+  // Sets |*index| to the index GetPropAreaForIndex() takes for the context |name| belongs to.
+  // Returns false if it doesn't belong to any.
+  virtual bool GetPropAreaIndexForName(const char* name, size_t* index) = 0;
+  // The SELinux context of the index'th area, or nullptr if |index| is past the last one.
+  virtual const char* GetContextForIndex(size_t index) = 0;
   virtual void ResetAccess() = 0;
   virtual void FreeAndUnmap() = 0;
   bool rw_ = false;
+  // Access checks that ResetAccess() left to the first CheckAccessAndOpen() of a context because
+  // it wasn't mapped. Most of them are never made at all after a fork.
+  uint64_t access_checks_deferred_ = 0;
 };
@@ -47,6 +47,11 @@ class ContextsPreSplit : public Contexts {
     return pre_split_prop_area_;
   }
 
+  // The pre-split property file is only ever mapped read only.
+  virtual bool GrowPropAreaForName(const char*) override {
+    return false;
+  }
+
   virtual prop_area* GetSerialPropArea() override {
     return pre_split_prop_area_;
   }
@@ -59,6 +64,26 @@ class ContextsPreSplit : public Contexts {
     pre_split_prop_area_->foreach (propfn, cookie);
   }
 
+  virtual void ForEachPrefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                             void* cookie) override {
+    pre_split_prop_area_->foreach_prefix(prefix, propfn, cookie);
+  }
+
+  virtual bool GetPropAreaForIndex(size_t index, prop_area** pa) override {
+    if (index != 0) return false;
+    *pa = pre_split_prop_area_;
+    return true;
+  }
+
+  virtual bool GetPropAreaIndexForName(const char*, size_t* index) override {
+    *index = 0;
+    return true;
+  }
+
+  virtual const char* GetContextForIndex(size_t index) override {
+    return index == 0 ? GetContextForName(nullptr) : nullptr;
+  }
+
   // This is a no-op for pre-split properties as there is only one property file and it is
   // accessible by all domains
   virtual void ResetAccess() override {
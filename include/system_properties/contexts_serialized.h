@@ -40,17 +40,29 @@ class ContextsSerialized : public Contexts {
 
   virtual bool Initialize(bool writable, const char* filename, bool* fsetxattr_failed) override;
   virtual prop_area* GetPropAreaForName(const char* name) override;
+  virtual prop_area* GetPropAreaForPropInfo(const prop_info* pi) override;
+  virtual bool GrowPropAreaForName(const char* name) override;
   virtual prop_area* GetSerialPropArea() override {
     return serial_prop_area_;
   }
   virtual const char* GetContextForName(const char* name) override;
+  virtual const char* GetTypeForName(const char* name) override;
   virtual void ForEach(void (*propfn)(const prop_info* pi, void* cookie), void* cookie) override;
+  virtual void ForEachPrefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                             void* cookie) override;
+  virtual bool GetPropAreaForIndex(size_t index, prop_area** pa) override;
+  virtual bool GetPropAreaIndexForName(const char* name, size_t* index) override;
+  virtual const char* GetContextForIndex(size_t index) override;
   virtual void ResetAccess() override;
   virtual void FreeAndUnmap() override;
 
  private:
+  struct ContextCacheEntry;
+
+  uint32_t GetContextIndexForName(const char* name);
   bool InitializeContextNodes();
-  bool InitializeProperties();
+  bool InitializeProperties(bool writable);
+  bool CompilePropertyInfo(const char* property_info_filename);
   bool MapSerialPropertyArea(bool access_rw, bool* fsetxattr_failed);
 
   const char* filename_;
@@ -58,5 +70,12 @@ class ContextsSerialized : public Contexts {
   ContextNode* context_nodes_ = nullptr;
   size_t num_context_nodes_ = 0;
   size_t context_nodes_mmap_size_ = 0;
+  // The mapped areas of context_nodes_ by address, in a table mapped alongside them.
+  PropAreaRanges area_ranges_;
+  PropAreaRanges::Range* area_ranges_table_ = nullptr;
   prop_area* serial_prop_area_ = nullptr;
+  // property_info never changes once mapped, so the result of GetPropertyInfoIndexes() for a name
+  // can be cached for as long as it stays mapped. A fixed size table, mapped anonymously like
+  // context_nodes_, with one seqlocked entry per slot, so lookups never allocate or take a lock.
+  ContextCacheEntry* context_cache_ = nullptr;
 };
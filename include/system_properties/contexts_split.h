@@ -31,6 +31,7 @@
 #include "contexts.h"
 
 struct PrefixNode;
+struct PrefixIndexEntry;
 class ContextListNode;
 
 class ContextsSplit : public Contexts {
@@ -40,11 +41,17 @@ class ContextsSplit : public Contexts {
 
   virtual bool Initialize(bool writable, const char* filename, bool* fsetxattr_failed) override;
   virtual prop_area* GetPropAreaForName(const char* name) override;
+  virtual bool GrowPropAreaForName(const char* name) override;
   virtual prop_area* GetSerialPropArea() override {
     return serial_prop_area_;
   }
   virtual const char* GetContextForName(const char* name) override;
   virtual void ForEach(void (*propfn)(const prop_info* pi, void* cookie), void* cookie) override;
+  virtual void ForEachPrefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                             void* cookie) override;
+  virtual bool GetPropAreaForIndex(size_t index, prop_area** pa) override;
+  virtual bool GetPropAreaIndexForName(const char* name, size_t* index) override;
+  virtual const char* GetContextForIndex(size_t index) override;
   virtual void ResetAccess() override;
   virtual void FreeAndUnmap() override;
 
@@ -54,8 +61,16 @@ class ContextsSplit : public Contexts {
   bool MapSerialPropertyArea(bool access_rw, bool* fsetxattr_failed);
   bool InitializePropertiesFromFile(const char* filename);
   bool InitializeProperties();
+  bool BuildPrefixIndex();
 
   PrefixNode* prefixes_ = nullptr;
+  // The non-wildcard entries of prefixes_ sorted with strcmp(), each linked to the longest other
+  // entry that is a prefix of it, so that GetPrefixNodeForName() can binary search instead of
+  // scanning prefixes_. Wildcard ("*") entries only apply when no prefix matches, so only the first
+  // one is kept, in wildcard_prefix_. If the index couldn't be built, prefixes_ is scanned instead.
+  PrefixIndexEntry* prefix_index_ = nullptr;
+  size_t num_prefix_index_ = 0;
+  PrefixNode* wildcard_prefix_ = nullptr;
   ContextListNode* contexts_ = nullptr;
   prop_area* serial_prop_area_ = nullptr;
   const char* filename_ = nullptr;
@@ -36,6 +36,7 @@
 #include "platform/bionic/macros.h"
 
 #include "prop_info.h"
+#include "prop_name.h"
 
 // Properties are stored in a hybrid trie/binary tree structure.
 // Each property's name is delimited at '.' characters, and the tokens are put
@@ -89,6 +90,153 @@ struct prop_bt {
   BIONIC_DISALLOW_COPY_AND_ASSIGN(prop_bt);
 };
 
+// Since PROP_AREA_VERSION 2, every prop_bt is followed, after its name padded to 4 bytes, by a
+// prop_bt_children. Once a node has a few children, the writer also keeps them in a prop_bt_array
+// sorted the same way as the binary tree, so that readers can binary search one contiguous array
+// instead of walking a chain of siblings scattered over the area; short names are inline in the
+// array, so most comparisons don't touch the sibling at all. The binary tree is still maintained
+// and remains what foreach(), cursors, snapshots and readers of version 1 areas walk.
+//
+// Arrays are immutable once published. A new child is linked into the binary tree first and
+// counted in prop_bt_children::count; the array is only rebuilt once it is missing more than a
+// quarter of the children, so until then a reader that doesn't find a name in it falls back to
+// the binary tree. A replaced array is freed, so readers check that the array they searched is
+// still the published one before trusting a miss.
+struct prop_bt_array {
+  static constexpr uint32_t kInlineName = 8;
+
+  struct entry {
+    uint32_t namelen;
+    char name[kInlineName];  // The first kInlineName bytes of the name, zero padded.
+    uint32_t offset;         // Of the child's prop_bt.
+  };
+
+  uint32_t count;
+  uint32_t reserved;
+  entry entries[0];
+};
+
+struct prop_bt_children {
+  atomic_uint_least32_t array;  // Offset of the current prop_bt_array, or 0.
+  atomic_uint_least32_t count;  // Children in the binary tree.
+};
+
+// In addition to the trie, each area keeps an open addressing hash table from the hash of a
+// property's full name to the offset of its prop_info, so that readers can find a property with
+// O(1) probes instead of walking one binary tree per name segment. The trie is still the source
+// of truth: it defines foreach() ordering, it is all that readers which predate the index look at,
+// and readers fall back to it whenever the index is marked incomplete.
+//
+// Like the trie, the index is only written by the single writer. A slot is published by storing
+// its offset with release ordering after its hash has been written, and readers load the offset
+// with acquire ordering before looking at the hash. Readers always compare the full name of the
+// prop_info they find, so hash collisions and stale slots are harmless. The table is never
+// resized in place: a larger table is built from the trie and then published by swapping
+// index_offset_.
+struct prop_index {
+  static constexpr uint32_t kTombstone = ~0u;
+
+  struct slot {
+    atomic_uint_least32_t hash;
+    atomic_uint_least32_t offset;  // 0 if the slot is empty, kTombstone if it was removed from.
+  };
+
+  uint32_t capacity;  // Always a power of 2.
+  uint32_t used;      // Non-empty slots, including tombstones. Only used by the writer.
+  // Non-zero if a property could not be added to this table, in which case a miss doesn't mean
+  // that the property doesn't exist.
+  atomic_uint_least32_t incomplete;
+  uint32_t reserved;
+  slot slots[0];
+
+ private:
+  BIONIC_DISALLOW_IMPLICIT_CONSTRUCTORS(prop_index);
+};
+
+// The position of a walk over one area's properties, one prop_info at a time, in the same order
+// as foreach(). Only offsets are kept, so it can live in caller memory and be copied freely. The
+// stack holds the offsets of the prop_bt nodes still to be visited, with the low bit set on the
+// ones whose left subtree is done. If the trie is too deep for the stack, the cursor instead finds
+// each next property by walking down from the root with the name of the one it returned last,
+// which takes time proportional to the depth of the trie rather than to the number of properties.
+struct prop_area_cursor {
+  static constexpr uint32_t kStackSize = 60;
+
+  uint32_t depth;
+  uint_least32_t last;  // The offset of the prop_info returned last, or 0 if there was none.
+  uint32_t overflowed;
+  uint_least32_t stack[kStackSize];
+};
+
+// The state of a bulk load of properties into one area, which add_bulk() is given in strcmp()
+// order. Like find_many(), it keeps the trie nodes of the previous name's first kMaxDepth segments,
+// so each name only walks the segments it doesn't share with the one before. Nodes stay on the
+// path for as long as names below them are being added, and their sorted child arrays are only
+// rebuilt once they leave it, so that each array is usually built once instead of every time a
+// quarter more children have been added. Only valid until bulk_end(), and only in the writer.
+struct prop_area_bulk {
+  static constexpr uint32_t kMaxDepth = 16;
+
+  const char* prev;
+  uint32_t depth;
+  prop_bt* path[kMaxDepth];
+};
+
+// The serial area also keeps a ring of the most recent changes, each recorded as the global serial
+// it is published with, the context index of the area the property lives in, and the offset of
+// its prop_info in that area, so that a reader who remembers a global serial can find out which
+// properties changed since then without walking all of them. A change that can't be described this
+// way, such as a removal, is recorded with an offset of 0, which tells readers to walk everything.
+//
+// The context indexes are those of the writer's Contexts. A reader whose Contexts number the
+// contexts differently, such as one that fell back to ContextsSplit, can't resolve them, so the
+// serial area also records a hash of the writer's context names in index order, which readers
+// compare with their own before trusting any entry.
+//
+// Only the writer appends to the ring. Each entry is a seqlock: its sequence is its position in
+// the log once it is complete, and one more than that while it is being written, which is never
+// the position of an entry in the same slot. head is only advanced after that, so readers can tell
+// entries that were overwritten while they read them. Positions wrap around at 2^32.
+struct prop_changelog {
+  friend class SystemPropertiesTest;
+
+  static constexpr uint32_t kSize = 128;  // Must divide 2^32.
+  struct change {
+    uint32_t serial;
+    uint32_t area_index;
+    uint32_t offset;
+  };
+  struct entry {
+    atomic_uint_least32_t sequence;
+    atomic_uint_least32_t serial;
+    atomic_uint_least32_t area_index;
+    atomic_uint_least32_t offset;
+  };
+
+  // The number of changes ever appended, modulo 2^32.
+  uint32_t head() {
+    return atomic_load_explicit(&head_, memory_order_acquire);
+  }
+  // The number of changes before |head| that are still in the ring. It is less than kSize only if
+  // there have been no changes before those.
+  uint32_t available(uint32_t head) {
+    return atomic_load_explicit(&wrapped_, memory_order_relaxed) != 0 || head >= kSize ? kSize
+                                                                                     : head;
+  }
+  void append(uint32_t serial, uint32_t area_index, uint_least32_t offset);
+  // Reads the change at |position|, which must be below head(). Returns false if it has already
+  // been overwritten.
+  bool read(uint32_t position, change* out);
+
+ private:
+  atomic_uint_least32_t head_;
+  atomic_uint_least32_t wrapped_;  // Set once head_ has wrapped around.
+  uint32_t reserved_[2];
+  entry entries_[kSize];
+
+  BIONIC_DISALLOW_IMPLICIT_CONSTRUCTORS(prop_changelog);
+};
+
 class prop_area {
  public:
   static prop_area* map_prop_area_rw(const char* filename, const char* context,
@@ -96,16 +244,28 @@ class prop_area {
   static prop_area* map_prop_area(const char* filename, bool *is_rw);
   static void unmap_prop_area(prop_area** pa) {
     if (*pa) {
-      munmap(*pa, pa_size_);
+      munmap(*pa, (*pa)->map_size());
       *pa = nullptr;
     }
   }
 
-  prop_area(const uint32_t magic, const uint32_t version) : magic_(magic), version_(version) {
+  prop_area(const uint32_t magic, const uint32_t version, const uint32_t size,
+            const uint32_t max_size)
+      : magic_(magic), version_(version), max_size_(max_size) {
     atomic_init(&serial_, 0u);
+    atomic_init(&index_offset_, 0u);
+    atomic_init(&size_, size);
+    atomic_init(&serial_flags_, 0u);
+    atomic_init(&changelog_offset_, 0u);
+    atomic_init(&ro_table_offset_, 0u);
+    memset(free_lists_, 0, sizeof(free_lists_));
+    bytes_free_ = 0;
+    free_infos_ = 0;
+    index_rebuild_space_ = 0;
+    contexts_hash_ = 0;
     memset(reserved_, 0, sizeof(reserved_));
     // Allocate enough space for the root node.
-    bytes_used_ = sizeof(prop_bt);
+    bytes_used_ = __BIONIC_ALIGN(prop_bt_size(version, 0), sizeof(uint_least32_t));
     // To make property reads wait-free, we reserve a
     // PROP_VALUE_MAX-sized block of memory, the "dirty backup area",
     // just after the root node. When we're about to modify a
@@ -123,14 +283,70 @@ class prop_area {
   }
 
   const prop_info* find(const char* name);
+  // Like find(), but uses the precomputed hash and segments of |name| instead of scanning it.
+  const prop_info* find(const prop_name& name);
+  // Looks up |count| names that the caller has sorted with strcmp(). Adjacent names share the
+  // trie nodes of their common '.'-separated prefix, so those segments are only walked once.
+  void find_many(const char* const names[], size_t count, const prop_info* results[]);
+  // Whether |name| can be added at all: it must be made of non-empty '.'-separated segments. For
+  // a valid name, add() and bulk_add() only fail because the area is full, so callers check this
+  // first and only grow the area when one of them fails for a name that passed.
+  static bool is_valid_name(const char* name);
   bool add(const char* name, unsigned int namelen, const char* value, unsigned int valuelen);
+  // Adds properties in strcmp() order of their names, with the same result as add(), but sharing
+  // trie walks and sorted child array rebuilds between adjacent names. As the trie nodes and
+  // prop_infos are allocated in name order, the properties of each subtree end up next to each
+  // other in the area. Names that are out of order are still added correctly, only more slowly.
+  // Returns the new or existing prop_info, or nullptr if the area is full, in which case the same
+  // name can be added again once the area has grown. bulk_end() must be called before anything
+  // else changes the area, and likewise returns false if it should be retried after growing it.
+  void bulk_begin(prop_area_bulk* bulk);
+  const prop_info* bulk_add(prop_area_bulk* bulk, const char* name, unsigned int namelen,
+                            const char* value, unsigned int valuelen);
+  bool bulk_end(prop_area_bulk* bulk);
   bool remove(const char* name, bool prune);
+  // Updating a mutable long value never writes to the current one: the new value is written to a
+  // fresh block after |pi|, and the offset in |pi| is swapped to it before the serial changes.
+  // new_long_value() allocates and fills that block, and returns its offset relative to |pi| for
+  // prop_info::set_long_value(), or 0 if the area is full. Once the new serial is published, the
+  // replaced value is freed right away with free_long_value(), so readers of a mutable long value
+  // must copy it with read_long_value() and check the serial before using the copy.
+  uint32_t new_long_value(const prop_info* pi, const char* value, uint32_t valuelen);
+  void free_long_value(const char* value);
+  // Copies the long value of the mutable property |pi| in this area to |value|, which must hold
+  // prop_info::kMutableLongValueMax bytes. The copy stays within the area and is always
+  // terminated, but it is torn or garbage if |pi| was updated meanwhile.
+  void read_long_value(const prop_info* pi, char* value);
+  // Extends the file backing this area, which must have been created by map_prop_area_rw(), so
+  // that a failed add() can be retried. Returns false if the area is already at its maximum size.
+  bool grow(const char* filename);
 
   bool foreach (void (*propfn)(const prop_info* pi, void* cookie), void* cookie);
+  // Like foreach(), but only for the properties whose names start with |prefix|. Only the prop_bt
+  // subtree below the prefix's complete '.'-separated segments is walked.
+  bool foreach_prefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                      void* cookie);
+  // Starts a walk over the area's properties, whose next() returns them one at a time and nullptr
+  // once there are none left.
+  void cursor_begin(prop_area_cursor* cursor);
+  const prop_info* cursor_next(prop_area_cursor* cursor);
 
+  // In the serial area this is the global serial. In every other area it counts the changes made
+  // to the properties of that area's context, so watchers of one context can ignore the rest.
   atomic_uint_least32_t* serial() {
     return &serial_;
   }
+  // Flags describing the global serial. Only meaningful in the serial area.
+  static constexpr uint32_t kSerialFlagBatch = 1 << 0;  // A batch of changes is being applied.
+  // The ro.* properties have been sealed into a prop_ro_table in each area.
+  static constexpr uint32_t kSerialFlagReadOnlySealed = 1 << 1;
+  // The writer is changing some area. It is set, followed by a release fence, before the first
+  // change, and only cleared once the serials have been bumped, so a reader that copied any part
+  // of a change sees either this flag or the new global serial once it has reloaded both.
+  static constexpr uint32_t kSerialFlagWriting = 1 << 2;
+  atomic_uint_least32_t* serial_flags() {
+    return &serial_flags_;
+  }
   uint32_t magic() const {
     return magic_;
   }
@@ -138,37 +354,121 @@ class prop_area {
     return version_;
   }
   char* dirty_backup_area() {
-    return data_ + sizeof (prop_bt);
+    return data_ + dirty_backup_offset(version_);
+  }
+  // The offset in data() of the dirty backup area of an area of |version|, just after the root
+  // node, so that a copy of data() can be decoded without the prop_area.
+  static size_t dirty_backup_offset(uint32_t version);
+  // Every object in the area lies in the first bytes_used() bytes of data(), and objects only refer
+  // to each other by offsets into data(), so a copy of those bytes can be decoded on its own.
+  const char* data() const {
+    return data_;
+  }
+  uint32_t bytes_used() const {
+    return bytes_used_;
+  }
+  // How much of bytes_used() is in blocks that were freed and can be allocated again.
+  uint32_t bytes_free() const {
+    return bytes_free_;
+  }
+  // The most data the area can hold once its file has grown to the full reserved size.
+  size_t max_data_size() const {
+    return map_size() - sizeof(prop_area);
+  }
+
+  // The change log of the serial area, or nullptr if the area doesn't have one.
+  prop_changelog* changelog();
+  // Allocates an empty change log in the serial area, unless it already has one.
+  bool init_changelog();
+  // The hash of the writer's context names that the change log's context indexes refer to.
+  uint32_t contexts_hash() const {
+    return contexts_hash_;
+  }
+  void set_contexts_hash(uint32_t hash) {
+    contexts_hash_ = hash;
+  }
+  // Converts between prop_info pointers and the offsets the change log records. prop_info_at()
+  // returns nullptr for offsets outside the area.
+  uint_least32_t offset_of(const prop_info* pi) const {
+    return reinterpret_cast<const char*>(pi) - data_;
+  }
+  const prop_info* prop_info_at(uint_least32_t off);
+
+  // Stores a prop_ro_table of |size| bytes, built by prop_ro_table::seal(), in this area. The
+  // table can only be set once. Only the writer calls this.
+  bool set_ro_table(const void* table, uint32_t size);
+  // Looks |name| up in this area's prop_ro_table. Returns nullptr if the area has no valid table
+  // or |name| isn't in it, in which case callers should use find().
+  const prop_info* find_sealed(const char* name, uint32_t hash);
+  // The size of the address range reserved for this area, which the file can grow into.
+  size_t map_size() const {
+    return max_size_ != 0 ? max_size_ : pa_size_;
   }
 
  private:
   static prop_area* map_fd_ro(const int fd, bool rw);
 
-  void* allocate_obj(const size_t size, uint_least32_t* const off);
+  // Blocks are only taken from the free lists if they start after |min_offset|.
+  void* allocate_obj(const size_t size, uint_least32_t* const off, uint_least32_t min_offset = 0);
+  void* allocate_free_obj(const size_t aligned, uint_least32_t* const off,
+                          uint_least32_t min_offset);
+  void free_obj(uint_least32_t off, const size_t size);
+  void free_prop_info(uint_least32_t off, const size_t size);
+  prop_info* revive_prop_info(uint32_t* const link, const char* value, uint32_t valuelen,
+                              uint_least32_t* const off);
+  bool coalesce_free_blocks();
+  static size_t free_list_index(size_t size);
   prop_bt* new_prop_bt(const char* name, uint32_t namelen, uint_least32_t* const off);
   prop_info* new_prop_info(const char* name, uint32_t namelen, const char* value, uint32_t valuelen,
                            uint_least32_t* const off);
+  size_t data_size();
   void* to_prop_obj(uint_least32_t off);
   prop_bt* to_prop_bt(atomic_uint_least32_t* off_p);
   prop_info* to_prop_info(atomic_uint_least32_t* off_p);
 
   prop_bt* root_node();
 
-  prop_bt* find_prop_bt(prop_bt* const bt, const char* name, uint32_t namelen, bool alloc_if_needed);
+  static size_t prop_bt_size(uint32_t version, uint32_t namelen);
+  prop_bt_children* children_of(prop_bt* const bt);
+  prop_bt* find_prop_bt(prop_bt* const bt, const char* name, uint32_t namelen, bool alloc_if_needed,
+                        bool* created);
+  prop_bt* find_child(prop_bt* const parent, const char* name, uint32_t namelen,
+                      bool alloc_if_needed, bool rebuild_sorted = true);
+  prop_bt* find_sorted_child(prop_bt_children* const children, const char* name, uint32_t namelen,
+                             bool* conclusive);
+  uint32_t collect_siblings(prop_bt* const bt, prop_bt_array* array, uint32_t count);
+  bool rebuild_sorted_children(prop_bt* const parent, prop_bt_children* const children);
+  void free_sorted_children(prop_bt_children* const children);
+  uint32_t sorted_children_count(prop_bt_children* const children);
+  bool update_sorted_children(prop_bt* const parent);
   prop_bt* traverse_trie(prop_bt* const trie, const char* name, bool alloc_if_needed);
 
   const prop_info* find_property(prop_bt* const trie, const char* name, uint32_t namelen,
                                  const char* value, uint32_t valuelen, bool alloc_if_needed);
+  const prop_info* node_property(prop_bt* const node, const char* name, uint32_t namelen,
+                                 const char* value, uint32_t valuelen, bool alloc_if_needed);
 
   bool foreach_property(prop_bt* const trie, void (*propfn)(const prop_info* pi, void* cookie),
                         void* cookie);
+  bool foreach_subtree(prop_bt* const trie, const char* segment, uint32_t segment_len,
+                       void (*propfn)(const prop_info* pi, void* cookie), void* cookie);
+  prop_bt* sibling(atomic_uint_least32_t* off_p);
+  const prop_info* first_property(prop_bt* const bt);
+  const prop_info* next_property(prop_bt* const bt, const char* name);
 
   bool prune_trie(prop_bt* const node);
 
-  // The original design doesn't include pa_size or pa_data_size in the prop_area struct itself.
-  // Since we'll need to be backwards compatible with that design, we don't gain much by adding it
-  // now, especially since we don't have any plans to make different property areas different sizes,
-  // and thus we share these two variables among all instances.
+  prop_index* index();
+  const prop_info* index_find(prop_index* const index, const char* name, uint32_t hash,
+                              bool* found);
+  bool index_insert(prop_index* const index, uint32_t hash, uint_least32_t offset);
+  void index_add(const prop_info* pi, uint32_t namelen);
+  void index_remove(const prop_info* pi);
+  bool rebuild_index();
+
+  // The original design doesn't include pa_size or pa_data_size in the prop_area struct itself,
+  // and all areas had the same size. These two variables are still used for areas written that
+  // way, which leave size_ and max_size_ below as zero.
   static size_t pa_size_;
   static size_t pa_data_size_;
 
@@ -176,8 +476,46 @@ class prop_area {
   atomic_uint_least32_t serial_;
   uint32_t magic_;
   uint32_t version_;
-  uint32_t reserved_[28];
+  // Offset of the prop_index for this area in data_, or 0 if there is none.
+  atomic_uint_least32_t index_offset_;
+  // Blocks released by remove(), prune_trie() and index rebuilds, kept in singly linked lists
+  // by size class, and only handed out again once the bump allocator has used up the current size
+  // of the area. Only the writer changes these fields; readers only look at bytes_free_ for
+  // usage reports.
+  static constexpr size_t kFreeListCount = 8;
+  uint32_t free_lists_[kFreeListCount];
+  uint32_t bytes_free_;
+  // The current size of the file, including this header. Every process maps max_size_ bytes up
+  // front, so growing the file never moves the area and readers never need to remap it; they only
+  // need this to bounds check offsets. The writer updates it before publishing anything that lives
+  // in the new space. Only areas of the current version can grow: readers that predate it would
+  // only map the file as it was when they opened it, and reject the area by its version instead.
+  atomic_uint_least32_t size_;
+  uint32_t max_size_;
+  atomic_uint_least32_t serial_flags_;
+  // Offset of the prop_changelog in data_, or 0 if there is none. Only used in the serial area.
+  atomic_uint_least32_t changelog_offset_;
+  // The prop_infos of removed properties, linked at the end of their value. A prop_info pointer
+  // always names the same property, as readers, property handles and app caches keep them
+  // forever, so these keep their name and an empty value with a still increasing serial, and are
+  // only reused when a property of the same name is added again. Removed trie nodes are never
+  // reused either. Only used by the writer.
+  uint32_t free_infos_;
+  // If rebuild_index() last failed for lack of space, the data size plus bytes_free_ at the time,
+  // otherwise 0. index_add() doesn't walk the trie to try again until the area has grown or space
+  // has been freed. Only used by the writer.
+  uint32_t index_rebuild_space_;
+  // A hash of the writer's context names in index order, or 0 if the writer didn't record one.
+  // Only used in the serial area.
+  uint32_t contexts_hash_;
+  // Offset of the prop_ro_table in data_, or 0 if the ro.* properties of this area haven't been
+  // sealed. Keeping the table in the area gives it the area's SELinux label, so it reveals nothing
+  // to processes that can't read the properties themselves.
+  atomic_uint_least32_t ro_table_offset_;
+  uint32_t reserved_[10];
   char data_[0];
 
   BIONIC_DISALLOW_COPY_AND_ASSIGN(prop_area);
 };
+
+static_assert(sizeof(prop_area) == 128, "sizeof struct prop_area must be 128 bytes");
@@ -54,6 +54,11 @@ struct prop_info {
   // break compatibility.
   constexpr static size_t kLongLegacyErrorBufferSize = 56;
 
+  // Mutable long values are copied to a buffer on the reader's stack, since the writer frees the
+  // block of a replaced value as soon as the update is published, so they must fit in this many
+  // bytes with their terminating NUL. Long ro.* values are read in place and have no such limit.
+  constexpr static size_t kMutableLongValueMax = 4096;
+
  public:
   atomic_uint_least32_t serial;
   // we need to keep this buffer around because the property
@@ -67,6 +72,15 @@ struct prop_info {
   };
   char name[0];
 
+  // The serial to publish after a change to a value of |len| bytes, where |serial| is the current
+  // serial with its dirty bit set. The counter skips kLongFlag, so that is_long() stays reliable
+  // for mutable properties.
+  static uint32_t next_serial(uint32_t serial, uint32_t len, bool is_long) {
+    uint32_t counter = (serial & 0x00feffff) + 1;
+    if (counter & kLongFlag) counter += kLongFlag;
+    return (len << 24) | (counter & 0x00feffff) | (is_long ? kLongFlag : 0);
+  }
+
   bool is_long() const {
     return (load_const_atomic(&serial, memory_order_relaxed) & kLongFlag) != 0;
   }
@@ -76,8 +90,22 @@ struct prop_info {
     // pointers in different processes.  We don't have data_ from prop_area, but since we know
     // `this` is data_ + some offset and long_value is data_ + some other offset, we calculate the
     // offset from `this` to long_value and store it as long_property.offset.
-    return reinterpret_cast<const char*>(this) + long_property.offset;
+    //
+    // The offset of a mutable property's value is replaced by updates, so it is loaded with
+    // acquire ordering to pair with set_long_value(). The block it pointed to before may have been
+    // freed since, so see prop_area::read_long_value().
+    return reinterpret_cast<const char*>(this) +
+           __atomic_load_n(&long_property.offset, __ATOMIC_ACQUIRE);
+  }
+
+  // Points a long property at a new value, which must lie after this prop_info in the same area.
+  void set_long_value(uint32_t long_offset) {
+    __atomic_store_n(&long_property.offset, long_offset, __ATOMIC_RELEASE);
   }
+  // Turns a property whose value is inline into a long one, for an update that sets a value of
+  // PROP_VALUE_MAX or more. Only the writer may do this, with the serial marked dirty. Returns the
+  // length of the legacy error message now in value, which the new serial has to carry.
+  uint32_t make_long(uint32_t long_offset);
 
   prop_info(const char* name, uint32_t namelen, const char* value, uint32_t valuelen);
   prop_info(const char* name, uint32_t namelen, uint32_t long_offset);
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "prop_hash.h"
+
+// A property name with its length, hash and '.'-separated segments worked out ahead of time, so
+// that looking it up doesn't have to scan it again. make_prop_name() is constexpr: for names known
+// at compile time none of this costs anything at run time.
+static constexpr size_t kPropNameMaxSegments = 16;
+
+struct prop_name {
+  const char* name;
+  uint32_t namelen;
+  uint32_t hash;
+  // 0 if the segments weren't recorded: the name has an empty segment, and so can't exist, or has
+  // more than kPropNameMaxSegments of them, or is too long for segment_ends.
+  uint32_t num_segments;
+  uint16_t segment_ends[kPropNameMaxSegments];  // The offset of the '.' or '\0' after each segment.
+};
+
+static constexpr prop_name make_prop_name(const char* name) {
+  prop_name result = {};
+  result.name = name;
+  while (name[result.namelen] != '\0') ++result.namelen;
+  result.hash = prop_name_hash(name, result.namelen);
+  if (result.namelen > UINT16_MAX) {
+    return result;
+  }
+
+  uint32_t start = 0;
+  uint32_t num_segments = 0;
+  for (uint32_t i = 0; i <= result.namelen; ++i) {
+    if (name[i] != '.' && name[i] != '\0') continue;
+    if (i == start || num_segments == kPropNameMaxSegments) {
+      return result;
+    }
+    result.segment_ends[num_segments++] = i;
+    start = i + 1;
+  }
+  result.num_segments = num_segments;
+  return result;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+// Prefetching of the mappings every process makes when it starts reading properties, compiled in
+// when SYSTEM_PROPERTIES_PREFETCH is defined. The property files live on tmpfs, so their pages are
+// always in memory, but each page still takes a minor fault the first time a process touches it.
+// With the flag, the page tables of property_info, the context node array and each property area
+// are filled when they are mapped, so the first reads of a starting process don't fault. Areas are
+// only populated up to the current size of their file, not the whole range reserved for growth.
+
+#if !defined(MADV_POPULATE_READ)
+#define MADV_POPULATE_READ 22
+#endif
+
+#if defined(SYSTEM_PROPERTIES_PREFETCH)
+static constexpr int kPropPrefetchMapFlags = MAP_POPULATE;
+#else
+static constexpr int kPropPrefetchMapFlags = 0;
+#endif
+
+// Fills the page tables for [addr, addr + len) of a mapping made without kPropPrefetchMapFlags.
+static inline void prop_prefetch(void* addr, size_t len) {
+#if defined(SYSTEM_PROPERTIES_PREFETCH)
+  // MADV_POPULATE_READ needs Linux 5.14; older kernels at least get the readahead hint.
+  if (madvise(addr, len, MADV_POPULATE_READ) != 0) {
+    madvise(addr, len, MADV_WILLNEED);
+  }
+#else
+  (void)addr;
+  (void)len;
+#endif
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class prop_area;
+struct prop_info;
+
+// Once boot has completed, the writer can seal the ro.* properties of each area into a table
+// stored in that area: a minimal perfect hash from the hash of a name to the offset of its
+// prop_info. Looking up a sealed name is then a hash of the name, one seed from the displacement
+// table and one slot, instead of a prop_bt walk. The table lives in the same file as the
+// properties it locates, so it has the area's SELinux label and can only be read by processes
+// that can read those properties anyway.
+//
+// The hash is the CHD scheme: names are grouped into buckets of about four by their hash, and
+// each bucket has a seed chosen when the table is built such that prop_ro_table_mix() sends every
+// name in it to a distinct free slot. A name that isn't in the table still lands on some slot, so
+// callers compare the slot's full hash and then the name of the prop_info it leads to. Names
+// whose hash collides with another ro.* name of the same area are left out and found the usual
+// way.
+//
+// The table is written completely before prop_area::set_ro_table() publishes its offset, so
+// readers never see it half written, and it is never changed or freed afterwards.
+struct prop_ro_table {
+  static constexpr uint32_t kMagic = 0x54524f50;  // "PORT"
+  static constexpr uint32_t kVersion = 2;
+
+  struct slot {
+    uint32_t hash;
+    uint32_t offset;  // Of the prop_info in the area's data, 0 for an empty slot.
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;         // Of the whole table.
+  uint32_t num_buckets;  // Followed by num_buckets uint32_t seeds,
+  uint32_t num_slots;    // then num_slots slots.
+  uint32_t reserved;
+
+  // Sets |*offset| from the slot |hash| maps to, if that slot holds |hash|.
+  bool find(uint32_t hash, uint32_t* offset) const;
+
+  // Returns |data| as a table if it holds a valid one within its first |size| bytes, or nullptr.
+  static const prop_ro_table* validate(const void* data, size_t size);
+  // Builds the table for the ro.* properties currently in |pa| and stores it there. If the area
+  // is too full to hold the table, sets |*full| to one of those properties, whose name
+  // Contexts::GrowPropAreaForName() takes to grow the area before trying again. Only the writer
+  // calls this.
+  static bool seal(prop_area* pa, const prop_info** full);
+
+ private:
+  const uint32_t* seeds() const {
+    return reinterpret_cast<const uint32_t*>(this + 1);
+  }
+  const slot* slots() const {
+    return reinterpret_cast<const slot*>(seeds() + num_buckets);
+  }
+};
+
+static inline uint32_t prop_ro_table_mix(uint32_t hash, uint32_t seed) {
+  uint32_t x = hash ^ (seed * 0x9e3779b9u);
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
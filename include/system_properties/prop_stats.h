@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+// Process-local counters for the stats API, compiled in when SYSTEM_PROPERTIES_STATS is defined.
+// Readers on many threads hit the same counters, so each counter is sharded by cache line and a
+// thread picks its shard from the address of its stack. Every update is a relaxed fetch_add, and
+// the counters are only summed when the stats are read. Without the flag, PROP_STATS_ADD() and
+// prop_stats_record_set() compile to nothing.
+
+enum prop_stat {
+  kPropStatFind,
+  kPropStatFindCacheHit,
+  kPropStatFindMiss,
+  kPropStatRead,
+  kPropStatReadRetry,   // memcpys repeated because the serial changed during the read.
+  kPropStatReadBackup,  // Copies from the dirty backup area.
+  kPropStatUpdate,
+  kPropStatFutexWake,
+  kPropStatContextCacheHit,   // Name to context lookups answered by ContextsSerialized's cache.
+  kPropStatContextCacheMiss,
+  kPropStatSet,
+  kPropStatSetFailure,
+  kPropStatCount,
+};
+
+// Round trips of __system_property_set are counted in power of 2 microsecond buckets.
+static constexpr size_t kPropStatsLatencyBuckets = 16;
+
+#if defined(SYSTEM_PROPERTIES_STATS)
+
+struct prop_stats_shard {
+  atomic_uint_least64_t counters[kPropStatCount];
+  atomic_uint_least64_t set_latency[kPropStatsLatencyBuckets];
+} __attribute__((aligned(64)));
+
+static constexpr size_t kPropStatsShards = 8;
+__LIBC_HIDDEN__ extern prop_stats_shard g_prop_stats[kPropStatsShards];
+
+static inline prop_stats_shard* prop_stats_shard_for_thread() {
+  // Thread stacks are at least a megabyte apart, so the address of the current frame divided by
+  // that tells most threads apart without a TLS slot or a syscall.
+  uintptr_t sp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  return &g_prop_stats[(sp >> 20) & (kPropStatsShards - 1)];
+}
+
+static inline void prop_stats_add(prop_stat stat, uint64_t n) {
+  atomic_fetch_add_explicit(&prop_stats_shard_for_thread()->counters[stat], n,
+                            memory_order_relaxed);
+}
+
+static inline void prop_stats_record_set(uint64_t latency_us, bool failed) {
+  size_t bucket = 0;
+  while (bucket + 1 < kPropStatsLatencyBuckets && latency_us >= (1ull << bucket)) ++bucket;
+  prop_stats_shard* shard = prop_stats_shard_for_thread();
+  atomic_fetch_add_explicit(&shard->counters[kPropStatSet], 1, memory_order_relaxed);
+  if (failed) {
+    atomic_fetch_add_explicit(&shard->counters[kPropStatSetFailure], 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&shard->set_latency[bucket], 1, memory_order_relaxed);
+}
+
+#define PROP_STATS_ADD(stat, n) prop_stats_add(stat, n)
+
+#else
+
+#define PROP_STATS_ADD(stat, n) \
+  do {                          \
+  } while (0)
+
+#endif
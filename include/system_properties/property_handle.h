@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include <limits>
+
+#include "prop_name.h"
+
+struct prop_info;
+
+// A handle to one property that caches its prop_info* and the last value parsed out of it. The
+// cached value is keyed by the property's serial, which changes on every update, so a repeated
+// Get*() is a couple of acquire loads and a compare; the value is only read and parsed again once
+// the serial has moved. While the property doesn't exist, the area serial is used instead, so the
+// lookup is only retried after some property has been added.
+//
+// Values are parsed the way android::base does: GetBool() takes 1/y/yes/on/true and
+// 0/n/no/off/false, and the numeric getters require the whole value to be a number in range. A
+// property whose type in property_contexts can't hold the requested kind of value (an "int"
+// property read with GetBool(), say) is treated as unset. Anything that fails to parse returns
+// |default_value|.
+//
+// Handles are meant to be long lived, typically static, and may be shared between threads.
+class PropertyHandle {
+ public:
+  explicit constexpr PropertyHandle(const char* name) : name_(name) {}
+  // A handle for a precomputed name, which |name| must outlive. Besides the prop_info*, it pins the
+  // index of the property's context, so that looking a missing property up again after the area
+  // serial has moved skips both the property_contexts lookup and the scan of the name.
+  explicit constexpr PropertyHandle(const prop_name* name) : name_(name->name), prop_name_(name) {}
+  PropertyHandle(const PropertyHandle&) = delete;
+  void operator=(const PropertyHandle&) = delete;
+
+  const char* name() const {
+    return name_;
+  }
+  // The type property_contexts gives the property, or nullptr if none is known.
+  const char* type();
+
+  bool GetBool(bool default_value);
+  int64_t GetInt(int64_t default_value, int64_t min = std::numeric_limits<int64_t>::min(),
+                 int64_t max = std::numeric_limits<int64_t>::max());
+  uint64_t GetUint(uint64_t default_value, uint64_t max = std::numeric_limits<uint64_t>::max());
+  double GetDouble(double default_value);
+
+ private:
+  enum Kind : uint32_t {
+    kNone,
+    kBool,
+    kInt,
+    kUint,
+    kDouble,
+  };
+  // Set in kind_ alongside the Kind when the value parsed; bits_ is only meaningful then.
+  static constexpr uint32_t kParsed = 0x80000000;
+
+  bool Lookup(Kind kind, uint64_t* bits);
+  uint32_t Parse(Kind kind, const char* value, uint64_t* bits);
+  bool TypeAllows(Kind kind);
+
+  const char* const name_;
+  const prop_name* const prop_name_ = nullptr;
+  atomic_uint_least32_t context_index_ = ~0u;
+  _Atomic(const char*) type_ = nullptr;
+  atomic_bool type_resolved_ = false;
+
+  // The cache is a seqlock: seq_ is odd while a thread is storing a new pi_/serial_/kind_/bits_.
+  atomic_uint_least32_t seq_ = 0;
+  _Atomic(const prop_info*) pi_ = nullptr;
+  atomic_uint_least32_t serial_ = 0;
+  atomic_uint_least32_t kind_ = kNone;
+  atomic_uint_least64_t bits_ = 0;
+};
+
+// A handle for a property whose name is known at compile time. The name's length, hash and
+// segments are computed by the compiler, and there is only one handle per name in the process, so
+// every caller shares the prop_info* and context index it pins:
+//
+//   static constexpr char kFooEnabled[] = "persist.sys.foo.enabled";
+//   if (Property<kFooEnabled>::GetBool(false)) ...
+template <const char* kName>
+class Property {
+ public:
+  static bool GetBool(bool default_value) {
+    return handle_.GetBool(default_value);
+  }
+  static int64_t GetInt(int64_t default_value, int64_t min = std::numeric_limits<int64_t>::min(),
+                        int64_t max = std::numeric_limits<int64_t>::max()) {
+    return handle_.GetInt(default_value, min, max);
+  }
+  static uint64_t GetUint(uint64_t default_value,
+                          uint64_t max = std::numeric_limits<uint64_t>::max()) {
+    return handle_.GetUint(default_value, max);
+  }
+  static double GetDouble(double default_value) {
+    return handle_.GetDouble(default_value);
+  }
+  static PropertyHandle& handle() {
+    return handle_;
+  }
+
+ private:
+  static constexpr prop_name kPropName = make_prop_name(kName);
+  static_assert(kPropName.num_segments != 0,
+                "property names need 1 to kPropNameMaxSegments non-empty segments");
+
+  // Constant-initialized, so using it never has to check whether it has been constructed yet.
+  static inline PropertyHandle handle_{&kPropName};
+};
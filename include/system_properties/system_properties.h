@@ -39,6 +39,10 @@
 
 constexpr int PROP_FILENAME_MAX = 1024;
 
+struct prop_bulk_entry;
+struct prop_stats;
+struct prop_watch;
+
 class SystemProperties {
  public:
   friend struct LocalPropertyTestState;
@@ -49,33 +53,98 @@ class SystemProperties {
   // We rely on the static SystemProperties in libc to be placed in .bss and zero initialized.
   SystemProperties() = default;
   // Special constructor for testing that also zero initializes the important members.
-  explicit SystemProperties(bool initialized) : initialized_(initialized) {
+  explicit SystemProperties(bool initialized)
+      : initialized_(initialized),
+        find_cache_generation_(0),
+        batch_depth_(0),
+        batch_dirty_(false),
+        num_batch_areas_(0),
+        find_nth_next_(0),
+        contexts_hash_(0) {
   }
 
   BIONIC_DISALLOW_COPY_AND_ASSIGN(SystemProperties);
 
+  // What an opaque prop_cursor from __system_property_cursor_begin() holds: the index of the
+  // context being walked and the position within its area. The area pointer is only a cache,
+  // valid while generation matches find_cache_generation_; the position itself is made of offsets,
+  // so it stays valid when the area is mapped again.
+  struct Cursor {
+    uint32_t context_index;
+    uint32_t area_started;
+    uint32_t generation;
+    prop_area* pa;
+    prop_area_cursor area_cursor;
+  };
+
   bool Init(const char* filename);
   bool AreaInit(const char* filename, bool* fsetxattr_failed);
   uint32_t AreaSerial();
   const prop_info* Find(const char* name);
+  // Finds a precomputed name. |*context_index| is the index of its context, or ~0u to have it
+  // resolved and stored there, so that callers can pin it for later lookups of the same name.
+  const prop_info* Find(const prop_name& name, uint32_t* context_index);
   int Read(const prop_info* pi, char* name, char* value);
   void ReadCallback(const prop_info* pi,
                     void (*callback)(void* cookie, const char* name, const char* value,
                                      uint32_t serial),
                     void* cookie);
   int Get(const char* name, char* value);
+  int GetMany(const char* const names[], char* const values[], size_t count);
   int Update(prop_info* pi, const char* value, unsigned int len);
   int Add(const char* name, unsigned int namelen, const char* value, unsigned int valuelen);
+  // Sorts |entries| by context index and name, then adds each context's properties in one bulk
+  // pass over its area, all within one batch.
+  int AddMany(prop_bulk_entry* entries, size_t count);
   int Delete(const char* name, bool prune);
+  // Seals the ro.* properties that exist now into a prop_ro_table in each area, which Find()
+  // checks first for ro.* names. Meant to be called by init once boot has completed; ro.*
+  // properties can't be deleted afterwards. Returns -1 if some area couldn't be sealed, whose
+  // properties are then still found the usual way.
+  int SealReadOnly();
+  int BatchBegin();
+  int BatchCommit();
+  bool BatchInProgress();
   const char* GetContext(const char* name);
+  const char* GetType(const char* name);
   uint32_t WaitAny(uint32_t old_serial);
   bool Wait(const prop_info* pi, uint32_t old_serial, uint32_t* new_serial_ptr,
             const timespec* relative_timeout);
+  uint32_t ContextSerial(const char* name);
+  bool ContextWait(const char* name, uint32_t old_serial, uint32_t* new_serial_ptr,
+                   const timespec* relative_timeout);
+  bool WaitMany(const prop_info* const pis[], const uint32_t old_serials[], size_t count,
+                const timespec* relative_timeout, size_t* index_ptr);
+  void CursorBegin(Cursor* cursor);
+  const prop_info* CursorNext(Cursor* cursor);
   const prop_info* FindNth(unsigned n);
   int Foreach(void (*propfn)(const prop_info* pi, void* cookie), void* cookie);
+  ssize_t Snapshot(void* buffer, size_t len, uint32_t* serial_ptr);
+  static int SnapshotForeach(const void* snapshot, size_t len,
+                             void (*callback)(void* cookie, const char* name, const char* value,
+                                              uint32_t serial),
+                             void* cookie);
+  int ForeachPrefix(const char* prefix, void (*propfn)(const prop_info* pi, void* cookie),
+                    void* cookie);
+  int ChangesSince(uint32_t serial, const prop_info* out[], size_t max);
+  int GetStats(prop_stats* stats);
+  int AreaUsage(void (*callback)(void* cookie, const char* context, uint32_t bytes_used,
+                                 uint32_t bytes_free, uint32_t bytes_max),
+                void* cookie);
+  // Watches are implemented in system_property_watch.cpp.
+  prop_watch* WatchCreate(const prop_info* const pis[], size_t count,
+                          const char* const context_names[], size_t context_count);
+  static int WatchFd(const prop_watch* watch);
+  static void WatchDestroy(prop_watch* watch);
 
  private:
   uint32_t ReadMutablePropertyValue(const prop_info* pi, char* value);
+  bool Sealed();
+  void LogChange(prop_area* pa, prop_area* serial_pa, const char* name, const prop_info* pi);
+  void NotifySerials(prop_area* pa, prop_area* serial_pa);
+  bool BatchRecordArea(prop_area* pa);
+  bool WaitForSerialChange(atomic_uint_least32_t* serial_ptr, uint32_t old_serial,
+                           uint32_t* new_serial_ptr, const timespec* relative_timeout);
 
   // We don't want to use new or malloc in properties (b/31659220), and we don't want to waste a
   // full page by using mmap(), so we set aside enough space to create any context of the three
@@ -88,5 +157,26 @@ class SystemProperties {
   Contexts* contexts_;
 
   bool initialized_;
+  // Bumped whenever access is reset, so that per-thread Find() cache entries made before a fork
+  // can't hand out prop_info pointers into areas that have since been unmapped.
+  uint32_t find_cache_generation_;
+  // Nesting depth of BatchBegin() calls, and whether anything changed since the outermost one.
+  // While a batch is open, Add/Update/Delete leave the global serial alone, and the serials of the
+  // areas they touch, as far as they fit in batch_areas_.
+  static constexpr size_t kMaxBatchAreas = 16;
+  uint32_t batch_depth_;
+  bool batch_dirty_;
+  size_t num_batch_areas_;
+  prop_area* batch_areas_[kMaxBatchAreas];
+  // FindNth() continues from where the previous call left off, so that callers looping over n
+  // don't walk every property each time. find_nth_next_ is the number of properties the cursor
+  // has returned, and 0 when it hasn't been started. Guarded by a lock in system_properties.cpp,
+  // as a Lock member would make this class non-trivially constructible with newer standards.
+  Cursor find_nth_cursor_;
+  unsigned find_nth_next_;
+  const prop_info* find_nth_last_;
   char property_filename_[PROP_FILENAME_MAX];
+  // The hash of the context names of contexts_, which ChangesSince() compares with the one the
+  // writer recorded in the serial area.
+  uint32_t contexts_hash_;
 };
@@ -30,6 +30,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <sys/cdefs.h>
 #include <sys/stat.h>
@@ -41,9 +42,89 @@
 
 #include <async_safe/log.h>
 
-constexpr size_t PA_SIZE = 128 * 1024;  // 属性区域大小：128KB
+#include "private/bionic_futex.h"
+#include "system_properties/prop_hash.h"
+#include "system_properties/prop_prefetch.h"
+#include "system_properties/prop_ro_table.h"
+
+constexpr size_t PA_INITIAL_SIZE = 4 * 1024;  // 新属性区域的初始大小：一个页面
+// 写入者创建的属性区域可以扩展到的最大大小。每个区域在每个进程中都预留这么大的地址空间，
+// 但只有文件已有的页面占用内存。哈希索引、排序的子节点数组和可变的长值都放在区域中，
+// 所以预留的比原来的固定大小（128KB）多。可以在编译时用SYSTEM_PROPERTIES_AREA_MAX_SIZE指定
+#if defined(SYSTEM_PROPERTIES_AREA_MAX_SIZE)
+constexpr size_t PA_MAX_SIZE = SYSTEM_PROPERTIES_AREA_MAX_SIZE;
+#else
+constexpr size_t PA_MAX_SIZE = 1024 * 1024;
+#endif
+// 读取器接受的最大预留大小。32位读取器也要能映射64位写入者创建的区域，
+// 所以不使用PA_MAX_SIZE，只拒绝明显损坏的头部
+constexpr size_t PA_MAX_SIZE_LIMIT = 64 * 1024 * 1024;
+static_assert(PA_MAX_SIZE % PA_INITIAL_SIZE == 0 && PA_MAX_SIZE <= PA_MAX_SIZE_LIMIT,
+              "the maximum area size must be a multiple of pages of at most 64MB");
 constexpr uint32_t PROP_AREA_MAGIC = 0x504f5250;  // 属性区域魔数
-constexpr uint32_t PROP_AREA_VERSION = 0xfc6ed0ab;  // 属性区域版本号
+constexpr uint32_t PROP_AREA_VERSION = 0xfc6ed0ac;  // 属性区域版本号：节点带有排序的子节点数组
+constexpr uint32_t PROP_AREA_VERSION_1 = 0xfc6ed0ab;  // 兄弟节点只组成二叉树的旧版本，仍然可以读取
+
+constexpr uint32_t kMinIndexCapacity = 16;  // 哈希索引的最小槽数
+constexpr uint32_t kMinSortedChildren = 4;  // 子节点少于这个数时二叉树已经足够快，不建立排序数组
+
+// 空闲块的头部，写在已释放的内存开头
+struct free_block {
+  uint32_t next;  // 同一大小类中下一个空闲块的偏移量，0表示链表结束
+  uint32_t size;  // 块的大小（已对齐）
+};
+
+constexpr size_t kFreeListGranularity = 32;  // 每个大小类覆盖的字节数
+
+// 已释放的prop_info的链表块头放在值缓冲区的末尾，序列号保持为零，值的长度为零，读取器不会读到它
+constexpr size_t kFreeInfoLinkOffset =
+    offsetof(prop_info, value) + PROP_VALUE_MAX - sizeof(free_block);
+
+// 获取偏移量处的空闲块头部
+static inline free_block* to_free_block(char* data, uint_least32_t off) {
+  return reinterpret_cast<free_block*>(data + off);
+}
+
+// 获取偏移量处已释放的prop_info的链表块头
+static inline free_block* to_free_info(char* data, uint_least32_t off) {
+  return reinterpret_cast<free_block*>(data + off + kFreeInfoLinkOffset);
+}
+
+// 按偏移量对空闲块链表进行归并排序，返回新的链表头
+static uint_least32_t sort_free_blocks(char* data, uint_least32_t head) {
+  if (head == 0 || to_free_block(data, head)->next == 0) return head;
+
+  // 用快慢指针将链表从中间分成两半
+  uint_least32_t slow = head;
+  uint_least32_t fast = to_free_block(data, head)->next;
+  while (fast != 0 && to_free_block(data, fast)->next != 0) {
+    slow = to_free_block(data, slow)->next;
+    fast = to_free_block(data, to_free_block(data, fast)->next)->next;
+  }
+  uint_least32_t second = to_free_block(data, slow)->next;
+  to_free_block(data, slow)->next = 0;
+
+  uint_least32_t first = sort_free_blocks(data, head);
+  second = sort_free_blocks(data, second);
+
+  // 合并两个有序链表
+  uint_least32_t result = 0;
+  uint32_t* tail = &result;
+  while (first != 0 && second != 0) {
+    uint_least32_t* smaller = first < second ? &first : &second;
+    *tail = *smaller;
+    tail = &to_free_block(data, *smaller)->next;
+    *smaller = *tail;
+  }
+  *tail = first != 0 ? first : second;
+  return result;
+}
+
+// 计算块大小对应的空闲链表，最后一个链表保存所有更大的块
+size_t prop_area::free_list_index(size_t size) {
+  const size_t index = (size - 1) / kFreeListGranularity;
+  return index < kFreeListCount - 1 ? index : kFreeListCount - 1;
+}
 
 size_t prop_area::pa_size_ = 0;  // 属性区域总大小
 size_t prop_area::pa_data_size_ = 0;  // 属性数据区大小
@@ -82,21 +163,20 @@ prop_area* prop_area::map_prop_area_rw(const char* filename, const char* context
     }
   }
 
-  if (ftruncate(fd, PA_SIZE) < 0) {  // 设置文件大小
+  if (ftruncate(fd, PA_INITIAL_SIZE) < 0) {  // 设置文件的初始大小
     close(fd);
     return nullptr;
   }
 
-  pa_size_ = PA_SIZE;  // 设置属性区域大小
-  pa_data_size_ = pa_size_ - sizeof(prop_area);  // 计算数据区大小
-
-  void* const memory_area = mmap(nullptr, pa_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // 预留最大大小的地址空间，这样扩展文件时不需要移动映射
+  void* const memory_area = mmap(nullptr, PA_MAX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
   if (memory_area == MAP_FAILED) {  // 内存映射失败
     close(fd);
     return nullptr;
   }
 
-  prop_area* pa = new (memory_area) prop_area(PROP_AREA_MAGIC, PROP_AREA_VERSION);
+  prop_area* pa = new (memory_area) prop_area(PROP_AREA_MAGIC, PROP_AREA_VERSION, PA_INITIAL_SIZE,
+                                              PA_MAX_SIZE);
 
   close(fd);  // 关闭文件描述符
   return pa;  // 返回属性区域指针
@@ -116,22 +196,42 @@ prop_area* prop_area::map_fd_ro(const int fd, bool rw) {
     return nullptr;
   }
 
-  pa_size_ = fd_stat.st_size;  // 设置属性区域大小
-  pa_data_size_ = pa_size_ - sizeof(prop_area);  // 计算数据区大小
-
+  const size_t file_size = fd_stat.st_size;
   int prot = rw ? PROT_READ | PROT_WRITE : PROT_READ;  // 设置内存保护标志
-  void* const map_result = mmap(nullptr, pa_size_, prot, MAP_SHARED, fd, 0);
+  void* map_result = mmap(nullptr, file_size, prot, MAP_SHARED, fd, 0);
   if (map_result == MAP_FAILED) {  // 内存映射失败
     return nullptr;
   }
 
   prop_area* pa = reinterpret_cast<prop_area*>(map_result);
-  if ((pa->magic() != PROP_AREA_MAGIC) || (pa->version() != PROP_AREA_VERSION)) {
-    munmap(pa, pa_size_);  // 验证失败，取消映射
+  if ((pa->magic() != PROP_AREA_MAGIC) ||
+      (pa->version() != PROP_AREA_VERSION && pa->version() != PROP_AREA_VERSION_1)) {
+    munmap(pa, file_size);  // 验证失败，取消映射
     return nullptr;
   }
 
-  return pa;  // 返回属性区域指针
+  const size_t max_size = pa->max_size_;
+  const uint32_t size = atomic_load_explicit(&pa->size_, memory_order_relaxed);
+  if (max_size == 0 && size == 0) {  // 旧格式的区域没有记录大小，所有区域共享同一个大小
+    pa_size_ = file_size;  // 设置属性区域大小
+    pa_data_size_ = pa_size_ - sizeof(prop_area);  // 计算数据区大小
+    prop_prefetch(pa, file_size);
+    return pa;
+  }
+
+  // 可扩展的区域：重新映射写入者预留的整个地址范围，以后文件扩展时不需要重新映射
+  // 只有PROP_AREA_VERSION的区域可以扩展，只映射文件现有部分的旧读取器会因为版本号拒绝它们
+  const uint32_t version = pa->version();
+  munmap(pa, file_size);
+  if (version != PROP_AREA_VERSION || max_size < file_size || max_size > PA_MAX_SIZE_LIMIT) {
+    return nullptr;
+  }
+  map_result = mmap(nullptr, max_size, prot, MAP_SHARED, fd, 0);
+  if (map_result == MAP_FAILED) {
+    return nullptr;
+  }
+  prop_prefetch(map_result, file_size);  // 只预取文件现有的部分，预留的地址范围还没有页面
+  return reinterpret_cast<prop_area*>(map_result);  // 返回属性区域指针
 }
 
 // 映射属性区域文件
@@ -155,10 +255,17 @@ prop_area* prop_area::map_prop_area(const char* filename, bool *is_rw) {
 }
 
 // 分配对象内存
-void* prop_area::allocate_obj(const size_t size, uint_least32_t* const off) {
+// min_offset: 只使用起始偏移量大于它的空闲块，线性分配的内存总是在所有对象之后
+void* prop_area::allocate_obj(const size_t size, uint_least32_t* const off,
+                              uint_least32_t min_offset) {
   const size_t aligned = __BIONIC_ALIGN(size, sizeof(uint_least32_t));  // 对齐到32位边界
-  if (bytes_used_ + aligned > pa_data_size_) {  // 检查空间是否足够
-    return nullptr;
+  if (bytes_used_ + aligned > data_size()) {  // 检查空间是否足够
+    // 线性空间用尽后才重用已释放的块，尽量推迟重用
+    void* p = allocate_free_obj(aligned, off, min_offset);
+    if (p == nullptr && coalesce_free_blocks()) {  // 合并相邻的空闲块后重试
+      return allocate_obj(size, off, min_offset);
+    }
+    return p;
   }
 
   *off = bytes_used_;  // 返回偏移量
@@ -166,10 +273,180 @@ void* prop_area::allocate_obj(const size_t size, uint_least32_t* const off) {
   return data_ + *off;  // 返回分配的内存地址
 }
 
+// 从空闲链表中分配内存（首次适配），返回的内存已清零
+void* prop_area::allocate_free_obj(const size_t aligned, uint_least32_t* const off,
+                                   uint_least32_t min_offset) {
+  for (size_t i = free_list_index(aligned); i < kFreeListCount; ++i) {
+    uint32_t* link = &free_lists_[i];
+    while (*link != 0) {
+      const uint_least32_t block_offset = *link;
+      free_block* block = reinterpret_cast<free_block*>(data_ + block_offset);
+      const uint32_t block_size = block->size;
+      if (block_size < aligned || block_offset <= min_offset) {  // 过小或位置不合适的块
+        link = &block->next;
+        continue;
+      }
+
+      *link = block->next;  // 从链表中摘除
+      bytes_free_ -= block_size;
+      memset(block, 0, aligned);  // 块中可能残留被合并的块头或旧的索引槽
+      if (block_size - aligned >= sizeof(free_block)) {  // 剩余部分足够大时拆分
+        free_obj(block_offset + aligned, block_size - aligned);
+      }
+
+      *off = block_offset;
+      return data_ + block_offset;
+    }
+  }
+  return nullptr;
+}
+
+// 合并地址相邻的空闲块，与线性空间末尾相邻的块直接还给线性分配器
+// 如果合并后可能满足更大的分配请求，返回true
+bool prop_area::coalesce_free_blocks() {
+  // 把所有大小类串成一个链表，再按偏移量排序，已释放的prop_info不参与合并
+  uint_least32_t head = 0;
+  for (size_t i = 0; i < kFreeListCount; ++i) {
+    uint_least32_t list = free_lists_[i];
+    free_lists_[i] = 0;
+    while (list != 0) {
+      free_block* block = to_free_block(data_, list);
+      const uint_least32_t next = block->next;
+      bytes_free_ -= block->size;
+      block->next = head;
+      head = list;
+      list = next;
+    }
+  }
+  head = sort_free_blocks(data_, head);
+
+  bool merged = false;
+  uint_least32_t last = 0;  // 最后一个合并后的块，留到最后处理
+  while (head != 0) {
+    free_block* block = to_free_block(data_, head);
+    const uint_least32_t next = block->next;
+    // 小于空闲块头部的间隙不可能是存活的对象，而是拆分块时剩下的零头，可以一起合并
+    if (last != 0 && head - (last + to_free_block(data_, last)->size) < sizeof(free_block)) {
+      to_free_block(data_, last)->size = head + block->size - last;
+      merged = true;
+    } else {
+      if (last != 0) free_obj(last, to_free_block(data_, last)->size);
+      last = head;
+    }
+    head = next;
+  }
+
+  if (last != 0) {
+    free_block* block = to_free_block(data_, last);
+    if (bytes_used_ - (last + block->size) < sizeof(free_block)) {
+      // 线性分配器假定未使用的空间全为零
+      bytes_used_ = last;
+      memset(block, 0, block->size);
+      merged = true;
+    } else {
+      free_obj(last, block->size);
+    }
+  }
+  return merged;
+}
+
+// 释放对象内存，调用者负责事先清除对象内容
+void prop_area::free_obj(uint_least32_t off, const size_t size) {
+  const size_t aligned = __BIONIC_ALIGN(size, sizeof(uint_least32_t));
+  if (off == 0 || aligned < sizeof(free_block)) {  // 根节点永远不会被释放
+    return;
+  }
+
+  free_block* block = reinterpret_cast<free_block*>(data_ + off);
+  const size_t list = free_list_index(aligned);
+  block->next = free_lists_[list];
+  block->size = aligned;
+  free_lists_[list] = off;
+  bytes_free_ += aligned;
+}
+
+// 记录已删除属性的prop_info，调用者负责事先清除它的值
+// 读取器和缓存可能一直持有这个指针，所以它保留名称，只会再交给同名的属性（见new_prop_info()），
+// 不算作可以重用的空闲空间
+void prop_area::free_prop_info(uint_least32_t off, const size_t size) {
+  const size_t aligned = __BIONIC_ALIGN(size, sizeof(uint_least32_t));
+  free_block* info = to_free_info(data_, off);
+  info->next = free_infos_;
+  info->size = aligned;
+  free_infos_ = off;
+}
+
+// 同名属性被再次添加时重新使用它被删除时留下的prop_info，按照脏备份区域的约定写入新值，
+// 序列号接着删除时的值递增，持有旧指针的读取器看到的是同一个属性的新值
+// 区域已满、无法为长值分配空间时返回nullptr，prop_info留在链表中
+prop_info* prop_area::revive_prop_info(uint32_t* const link, const char* value,
+                                       uint32_t valuelen, uint_least32_t* const off) {
+  const uint_least32_t info_offset = *link;
+  prop_info* info = reinterpret_cast<prop_info*>(data_ + info_offset);
+  uint32_t long_offset = 0;
+  if (valuelen >= PROP_VALUE_MAX) {
+    long_offset = new_long_value(info, value, valuelen);
+    if (long_offset == 0) {
+      return nullptr;
+    }
+  }
+
+  free_block* block = to_free_info(data_, info_offset);
+  *link = block->next;  // 从链表中摘除
+  memset(block, 0, sizeof(*block));
+
+  uint32_t serial = atomic_load_explicit(&info->serial, memory_order_relaxed);
+  dirty_backup_area()[0] = '\0';  // 删除后的值为空
+  atomic_thread_fence(memory_order_release);
+  serial |= 1;  // 设置脏位
+  atomic_store_explicit(&info->serial, serial, memory_order_relaxed);
+  uint32_t len = valuelen;
+  if (long_offset != 0) {
+    len = info->make_long(long_offset);
+  } else {
+    memcpy(info->value, value, valuelen);
+    info->value[valuelen] = '\0';
+  }
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&info->serial, prop_info::next_serial(serial, len, long_offset != 0),
+                        memory_order_relaxed);
+  __futex_wake(&info->serial, INT32_MAX);
+
+  *off = info_offset;
+  return info;
+}
+
+// 名称长度为namelen的节点在version版本的区域中占用的字节数
+size_t prop_area::prop_bt_size(uint32_t version, uint32_t namelen) {
+  if (version != PROP_AREA_VERSION) {
+    return sizeof(prop_bt) + namelen + 1;
+  }
+  return sizeof(prop_bt) + __BIONIC_ALIGN(namelen + 1, sizeof(uint_least32_t)) +
+         sizeof(prop_bt_children);
+}
+
+// 脏备份区域紧跟在根节点之后。版本2的根节点之后还有prop_bt_children，
+// 版本1的写入者没有为根节点的名称留出空间，备份区域从sizeof(prop_bt)开始
+size_t prop_area::dirty_backup_offset(uint32_t version) {
+  if (version != PROP_AREA_VERSION) {
+    return sizeof(prop_bt);
+  }
+  return __BIONIC_ALIGN(prop_bt_size(version, 0), sizeof(uint_least32_t));
+}
+
+// 获取节点名称之后的prop_bt_children，旧版本的区域中没有
+prop_bt_children* prop_area::children_of(prop_bt* const bt) {
+  if (version_ != PROP_AREA_VERSION) {
+    return nullptr;
+  }
+  return reinterpret_cast<prop_bt_children*>(
+      bt->name + __BIONIC_ALIGN(bt->namelen + 1, sizeof(uint_least32_t)));
+}
+
 // 创建新的属性二叉树节点
 prop_bt* prop_area::new_prop_bt(const char* name, uint32_t namelen, uint_least32_t* const off) {
   uint_least32_t new_offset;
-  void* const p = allocate_obj(sizeof(prop_bt) + namelen + 1, &new_offset);  // 分配内存
+  void* const p = allocate_obj(prop_bt_size(version_, namelen), &new_offset);  // 分配内存
   if (p != nullptr) {
     prop_bt* bt = new (p) prop_bt(name, namelen);  // 在分配的内存中构造对象
     *off = new_offset;  // 返回偏移量
@@ -182,24 +459,32 @@ prop_bt* prop_area::new_prop_bt(const char* name, uint32_t namelen, uint_least32
 // 创建新的属性信息对象
 prop_info* prop_area::new_prop_info(const char* name, uint32_t namelen, const char* value,
                                     uint32_t valuelen, uint_least32_t* const off) {
+  // 同名属性以前被删除过时，读取器可能还持有它的prop_info，只能重新使用那一个
+  for (uint32_t* link = &free_infos_; *link != 0; link = &to_free_info(data_, *link)->next) {
+    const prop_info* freed = reinterpret_cast<prop_info*>(data_ + *link);
+    if (strncmp(freed->name, name, namelen) == 0 && freed->name[namelen] == '\0') {
+      return revive_prop_info(link, value, valuelen, off);
+    }
+  }
+
+  const size_t info_size = __BIONIC_ALIGN(sizeof(prop_info) + namelen + 1, sizeof(uint_least32_t));
+  const bool is_long = valuelen >= PROP_VALUE_MAX;  // 如果值长度超过最大值，创建长属性
+
+  // 长值与prop_info分配在同一个块中并紧随其后：prop_info中保存的是无符号的相对偏移量，
+  // 而从空闲链表分配的两个独立块之间没有先后顺序的保证
   uint_least32_t new_offset;
-  void* const p = allocate_obj(sizeof(prop_info) + namelen + 1, &new_offset);  // 分配内存
+  const size_t long_size = is_long ? __BIONIC_ALIGN(valuelen + 1, sizeof(uint_least32_t)) : 0;
+  void* const p = allocate_obj(info_size + long_size, &new_offset);
   if (p == nullptr) return nullptr;
 
   prop_info* info;
-  if (valuelen >= PROP_VALUE_MAX) {  // 如果值长度超过最大值，创建长属性
-    uint32_t long_value_offset = 0;
-    char* long_location = reinterpret_cast<char*>(allocate_obj(valuelen + 1, &long_value_offset));
-    if (!long_location) return nullptr;
-
+  if (is_long) {
+    char* long_location = reinterpret_cast<char*>(p) + info_size;
     memcpy(long_location, value, valuelen);  // 复制长值
     long_location[valuelen] = '\0';  // 添加null终止符
 
-    // new_offset和long_value_offset都是基于data_的偏移量，但是prop_info
-    // 不知道data_是什么，所以我们将此偏移量更改为从包含它的prop_info指针的偏移量
-    long_value_offset -= new_offset;
-
-    info = new (p) prop_info(name, namelen, long_value_offset);  // 构造长属性对象
+    // 偏移量是从包含它的prop_info指针开始计算的，因为prop_info不知道data_是什么
+    info = new (p) prop_info(name, namelen, info_size);  // 构造长属性对象
   } else {
     info = new (p) prop_info(name, namelen, value, valuelen);  // 构造普通属性对象
   }
@@ -207,9 +492,16 @@ prop_info* prop_area::new_prop_info(const char* name, uint32_t namelen, const ch
   return info;
 }
 
+// 获取当前数据区大小
+inline size_t prop_area::data_size() {
+  // 偏移量总是在更新大小之后才以release顺序发布，所以这里使用relaxed加载即可
+  const uint32_t size = atomic_load_explicit(&size_, memory_order_relaxed);
+  return size != 0 ? size - sizeof(prop_area) : pa_data_size_;  // 旧格式的区域使用共享的大小
+}
+
 // 偏移量转换为对象指针
 void* prop_area::to_prop_obj(uint_least32_t off) {
-  if (off > pa_data_size_) return nullptr;  // 检查偏移量是否有效
+  if (off > data_size()) return nullptr;  // 检查偏移量是否有效
 
   return (data_ + off);  // 返回对象指针
 }
@@ -242,8 +534,9 @@ static int cmp_prop_name(const char* one, uint32_t one_len, const char* two, uin
 }
 
 // 在二叉树中查找或创建属性节点
+// created: 创建了新节点时设置为true
 prop_bt* prop_area::find_prop_bt(prop_bt* const bt, const char* name, uint32_t namelen,
-                                 bool alloc_if_needed) {
+                                 bool alloc_if_needed, bool* created) {
   prop_bt* current = bt;
   while (true) {
     if (!current) {  // 当前节点为空
@@ -268,6 +561,7 @@ prop_bt* prop_area::find_prop_bt(prop_bt* const bt, const char* name, uint32_t n
         prop_bt* new_bt = new_prop_bt(name, namelen, &new_offset);  // 创建新节点
         if (new_bt) {
           atomic_store_explicit(&current->left, new_offset, memory_order_release);  // 链接新节点
+          *created = true;
         }
         return new_bt;
       }
@@ -284,6 +578,7 @@ prop_bt* prop_area::find_prop_bt(prop_bt* const bt, const char* name, uint32_t n
         prop_bt* new_bt = new_prop_bt(name, namelen, &new_offset);  // 创建新节点
         if (new_bt) {
           atomic_store_explicit(&current->right, new_offset, memory_order_release);  // 链接新节点
+          *created = true;
         }
         return new_bt;
       }
@@ -291,6 +586,227 @@ prop_bt* prop_area::find_prop_bt(prop_bt* const bt, const char* name, uint32_t n
   }
 }
 
+// 在父节点的子树中查找或创建名称片段对应的节点
+// rebuild_sorted: 为false时只计数新的子节点，由调用者之后调用update_sorted_children()
+prop_bt* prop_area::find_child(prop_bt* const parent, const char* name, uint32_t namelen,
+                               bool alloc_if_needed, bool rebuild_sorted) {
+  prop_bt_children* children = children_of(parent);
+  if (children != nullptr) {  // 先在排序数组中二分查找
+    bool conclusive;
+    prop_bt* bt = find_sorted_child(children, name, namelen, &conclusive);
+    if (bt != nullptr || (conclusive && !alloc_if_needed)) {
+      return bt;
+    }
+  }
+
+  bool created = false;
+  prop_bt* root = nullptr;
+  uint_least32_t children_offset = atomic_load_explicit(&parent->children, memory_order_relaxed);
+  if (children_offset != 0) {  // 如果有子节点
+    root = to_prop_bt(&parent->children);
+  } else if (alloc_if_needed) {  // 如果需要分配新节点
+    uint_least32_t new_offset;
+    root = new_prop_bt(name, namelen, &new_offset);  // 创建新子节点
+    if (root) {
+      atomic_store_explicit(&parent->children, new_offset, memory_order_release);  // 链接子节点
+      created = true;
+    }
+  }
+
+  if (!root) {  // 无法获取或创建根节点
+    return nullptr;
+  }
+
+  prop_bt* bt = find_prop_bt(root, name, namelen, alloc_if_needed, &created);  // 在子树中查找
+  if (created && children != nullptr) {
+    // 新节点已经链接到二叉树中，之后才计数，读取器看到计数变化时会回退到二叉树
+    const uint32_t count = atomic_load_explicit(&children->count, memory_order_relaxed) + 1;
+    atomic_store_explicit(&children->count, count, memory_order_release);
+    if (!rebuild_sorted) {
+      return bt;
+    }
+    const uint32_t sorted = sorted_children_count(children);
+    // 数组缺少超过四分之一的子节点时才重建，重建的总开销与子节点数成线性关系
+    if (count >= kMinSortedChildren && count - sorted > sorted / 4) {
+      rebuild_sorted_children(parent, children);
+    }
+  }
+  return bt;
+}
+
+// 比较名称片段与排序数组中的一项，顺序与cmp_prop_name()相同
+static int cmp_sorted_entry(const char* name, uint32_t namelen, const prop_bt_array::entry& e,
+                            const prop_bt* bt) {
+  if (namelen != e.namelen) {
+    return namelen < e.namelen ? -1 : 1;
+  }
+  const uint32_t inline_len =
+      namelen < prop_bt_array::kInlineName ? namelen : prop_bt_array::kInlineName;
+  const int ret = memcmp(name, e.name, inline_len);
+  if (ret != 0 || namelen <= prop_bt_array::kInlineName) {
+    return ret;
+  }
+  if (bt == nullptr) {  // 偏移量无效，数组已经被替换
+    return -1;
+  }
+  return strncmp(name + inline_len, bt->name + inline_len, namelen - inline_len);
+}
+
+// 在排序数组中查找子节点
+// conclusive: 没有找到时，如果数组包含全部子节点，设置为true，否则调用者需要再查找二叉树
+prop_bt* prop_area::find_sorted_child(prop_bt_children* const children, const char* name,
+                                      uint32_t namelen, bool* conclusive) {
+  *conclusive = false;
+  const uint_least32_t off = atomic_load_explicit(&children->array, memory_order_acquire);
+  if (off == 0) {
+    return nullptr;
+  }
+  const prop_bt_array* array = reinterpret_cast<prop_bt_array*>(to_prop_obj(off));
+  if (array == nullptr || data_size() - off < sizeof(prop_bt_array)) {
+    return nullptr;
+  }
+  const uint32_t count = array->count;
+  if (count > (data_size() - off - sizeof(prop_bt_array)) / sizeof(prop_bt_array::entry)) {
+    return nullptr;  // 旧数组被释放后内存被重用
+  }
+
+  prop_bt* found = nullptr;
+  uint32_t lo = 0;
+  uint32_t hi = count;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const prop_bt_array::entry& e = array->entries[mid];
+    prop_bt* bt = nullptr;
+    if (namelen > prop_bt_array::kInlineName || namelen == e.namelen) {
+      bt = reinterpret_cast<prop_bt*>(to_prop_obj(e.offset));
+    }
+    const int ret = cmp_sorted_entry(name, namelen, e, bt);
+    if (ret == 0) {
+      // 确认节点确实是这个名称，数组的内容可能已经过时
+      if (bt != nullptr && bt->namelen == namelen && strncmp(bt->name, name, namelen) == 0) {
+        found = bt;
+      }
+      break;
+    }
+    if (ret < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  // 与seqlock相同：数组在查找期间没有被替换，结果才可信
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&children->array, memory_order_relaxed) != off) {
+    return nullptr;
+  }
+  if (found == nullptr) {
+    *conclusive = count == atomic_load_explicit(&children->count, memory_order_acquire);
+  }
+  return found;
+}
+
+// 按中序（与cmp_prop_name()的顺序相同）把兄弟二叉树中的节点写入array，返回节点总数
+// array为nullptr时只计数；count是已经写入的项数
+uint32_t prop_area::collect_siblings(prop_bt* const bt, prop_bt_array* array, uint32_t count) {
+  if (bt == nullptr) {
+    return count;
+  }
+  if (atomic_load_explicit(&bt->left, memory_order_relaxed) != 0) {
+    count = collect_siblings(to_prop_bt(&bt->left), array, count);
+  }
+  if (array != nullptr) {
+    prop_bt_array::entry* e = &array->entries[count];
+    e->namelen = bt->namelen;
+    memcpy(e->name, bt->name,
+           bt->namelen < prop_bt_array::kInlineName ? bt->namelen : prop_bt_array::kInlineName);
+    e->offset = reinterpret_cast<char*>(bt) - data_;
+  }
+  ++count;
+  if (atomic_load_explicit(&bt->right, memory_order_relaxed) != 0) {
+    count = collect_siblings(to_prop_bt(&bt->right), array, count);
+  }
+  return count;
+}
+
+// 按当前的兄弟二叉树重建父节点的排序数组并发布，只有写入者调用
+// 区域已满、无法分配新数组时返回false
+bool prop_area::rebuild_sorted_children(prop_bt* const parent, prop_bt_children* const children) {
+  prop_bt* root = nullptr;
+  if (atomic_load_explicit(&parent->children, memory_order_relaxed) != 0) {
+    root = to_prop_bt(&parent->children);
+  }
+  const uint32_t count = collect_siblings(root, nullptr, 0);
+
+  prop_bt_array* array = nullptr;
+  uint_least32_t new_offset = 0;
+  if (count >= kMinSortedChildren) {
+    array = reinterpret_cast<prop_bt_array*>(
+        allocate_obj(sizeof(prop_bt_array) + count * sizeof(prop_bt_array::entry), &new_offset));
+    if (array == nullptr) {  // 区域已满，保留旧数组，读取器会回退到二叉树
+      atomic_store_explicit(&children->count, count, memory_order_release);
+      return false;
+    }
+    array->count = collect_siblings(root, array, 0);
+  }
+
+  // 先更新计数再发布数组，读取器先加载数组再加载计数，不会认为旧数组是完整的
+  atomic_store_explicit(&children->count, count, memory_order_release);
+  const uint_least32_t old_offset = atomic_load_explicit(&children->array, memory_order_relaxed);
+  atomic_store_explicit(&children->array, new_offset, memory_order_release);
+  prop_bt_array* old =
+      old_offset != 0 ? reinterpret_cast<prop_bt_array*>(to_prop_obj(old_offset)) : nullptr;
+  if (old != nullptr) {
+    const size_t size = sizeof(prop_bt_array) + old->count * sizeof(prop_bt_array::entry);
+    memset(old, 0, size);
+    free_obj(old_offset, size);
+  }
+  return true;
+}
+
+// 释放节点的排序数组，只有写入者在释放节点之前调用
+void prop_area::free_sorted_children(prop_bt_children* const children) {
+  const uint_least32_t off = atomic_load_explicit(&children->array, memory_order_relaxed);
+  if (off == 0) {
+    return;
+  }
+  atomic_store_explicit(&children->array, 0u, memory_order_release);
+  prop_bt_array* array = reinterpret_cast<prop_bt_array*>(to_prop_obj(off));
+  if (array == nullptr) {
+    return;
+  }
+  const size_t size = sizeof(prop_bt_array) + array->count * sizeof(prop_bt_array::entry);
+  memset(array, 0, size);
+  free_obj(off, size);
+}
+
+// 排序数组中的子节点数，没有数组或者偏移量无效时为0，只有写入者调用
+uint32_t prop_area::sorted_children_count(prop_bt_children* const children) {
+  const uint_least32_t off = atomic_load_explicit(&children->array, memory_order_relaxed);
+  if (off == 0) {
+    return 0;
+  }
+  const prop_bt_array* array = reinterpret_cast<prop_bt_array*>(to_prop_obj(off));
+  return array != nullptr ? array->count : 0;
+}
+
+// 排序数组没有包含全部子节点时重建，批量添加中的节点离开路径时调用
+// 重建失败并且区域还可以扩展时返回false，扩展之后值得重试
+bool prop_area::update_sorted_children(prop_bt* const parent) {
+  prop_bt_children* children = children_of(parent);
+  if (children == nullptr) {
+    return true;
+  }
+  const uint32_t count = atomic_load_explicit(&children->count, memory_order_relaxed);
+  const uint32_t sorted = sorted_children_count(children);
+  if (count >= kMinSortedChildren && count != sorted &&
+      !rebuild_sorted_children(parent, children)) {
+    const uint32_t size = atomic_load_explicit(&size_, memory_order_relaxed);
+    return size == 0 || size >= max_size_;  // 不能扩展时只使用二叉树
+  }
+  return true;
+}
+
 // 遍历属性树路径
 prop_bt* prop_area::traverse_trie(prop_bt* const trie, const char* name, bool alloc_if_needed) {
   if (!trie) return nullptr;  // 树为空
@@ -306,23 +822,7 @@ prop_bt* prop_area::traverse_trie(prop_bt* const trie, const char* name, bool al
       return nullptr;
     }
 
-    prop_bt* root = nullptr;
-    uint_least32_t children_offset = atomic_load_explicit(&current->children, memory_order_relaxed);
-    if (children_offset != 0) {  // 如果有子节点
-      root = to_prop_bt(&current->children);
-    } else if (alloc_if_needed) {  // 如果需要分配新节点
-      uint_least32_t new_offset;
-      root = new_prop_bt(remaining_name, substr_size, &new_offset);  // 创建新子节点
-      if (root) {
-        atomic_store_explicit(&current->children, new_offset, memory_order_release);  // 链接子节点
-      }
-    }
-
-    if (!root) {  // 无法获取或创建根节点
-      return nullptr;
-    }
-
-    current = find_prop_bt(root, remaining_name, substr_size, alloc_if_needed);  // 在子树中查找
+    current = find_child(current, remaining_name, substr_size, alloc_if_needed);
     if (!current) {
       return nullptr;
     }
@@ -341,10 +841,21 @@ const prop_info* prop_area::find_property(prop_bt* const trie, const char* name,
                                           bool alloc_if_needed) {
   prop_bt* current = traverse_trie(trie, name, alloc_if_needed);  // 遍历到目标节点
   if (!current) return nullptr;
+  return node_property(current, name, namelen, value, valuelen, alloc_if_needed);
+}
 
+// 返回节点上的属性，需要时创建
+const prop_info* prop_area::node_property(prop_bt* const current, const char* name,
+                                          uint32_t namelen, const char* value, uint32_t valuelen,
+                                          bool alloc_if_needed) {
   uint_least32_t prop_offset = atomic_load_explicit(&current->prop, memory_order_relaxed);
   if (prop_offset != 0) {  // 如果节点已有属性
-    return to_prop_info(&current->prop);
+    const prop_info* pi = to_prop_info(&current->prop);
+    // 节点可能在遍历期间被修剪并清零，因此需要确认名称
+    if (pi != nullptr && strncmp(pi->name, name, namelen) == 0 && pi->name[namelen] == '\0') {
+      return pi;
+    }
+    return nullptr;
   } else if (alloc_if_needed) {  // 如果需要创建新属性
     uint_least32_t new_offset;
     prop_info* new_info = new_prop_info(name, namelen, value, valuelen, &new_offset);
@@ -392,15 +903,446 @@ bool prop_area::foreach_property(prop_bt* const trie,
   return true;
 }
 
+// 不使用递归遍历trie中的一棵子树，顺序与foreach_property()不同
+// trie: 兄弟二叉树的根节点
+// segment: 非nullptr时，这一层兄弟节点中只有名称以segment开头的节点及其后代会被遍历
+// segment_len: segment的长度
+bool prop_area::foreach_subtree(prop_bt* const trie, const char* segment, uint32_t segment_len,
+                                void (*propfn)(const prop_info* pi, void* cookie), void* cookie) {
+  // 栈里的每一项是一个待处理的节点，filtered表示它属于需要按segment筛选的那一层
+  struct pending {
+    prop_bt* bt;
+    bool filtered;
+  };
+  constexpr size_t kStackSize = 64;
+  pending stack[kStackSize];
+  size_t depth = 0;
+
+  // 栈满时对这个节点另起一次遍历，递归深度只有树高的1/kStackSize
+  auto push = [&](atomic_uint_least32_t* off_p, bool filtered) {
+    if (atomic_load_explicit(off_p, memory_order_relaxed) == 0) return true;
+    prop_bt* bt = to_prop_bt(off_p);
+    if (!bt) return false;
+    if (depth == kStackSize) {
+      return foreach_subtree(bt, filtered ? segment : nullptr, segment_len, propfn, cookie);
+    }
+    stack[depth++] = {bt, filtered};
+    return true;
+  };
+
+  if (!trie) return false;
+  stack[depth++] = {trie, segment != nullptr};
+  while (depth > 0) {
+    const pending current = stack[--depth];
+    prop_bt* bt = current.bt;
+
+    // 左右子树是同一层的兄弟节点，children是下一层
+    if (!push(&bt->right, current.filtered) || !push(&bt->left, current.filtered)) {
+      return false;
+    }
+    if (current.filtered &&
+        (bt->namelen < segment_len || strncmp(bt->name, segment, segment_len) != 0)) {
+      continue;
+    }
+    if (!push(&bt->children, false)) {
+      return false;
+    }
+
+    if (atomic_load_explicit(&bt->prop, memory_order_relaxed) != 0) {
+      prop_info* info = to_prop_info(&bt->prop);
+      if (!info) return false;
+      propfn(info, cookie);
+    }
+  }
+  return true;
+}
+
+// 获取当前发布的哈希索引，没有索引时返回nullptr
+prop_index* prop_area::index() {
+  uint_least32_t off = atomic_load_explicit(&index_offset_, memory_order_acquire);
+  if (off == 0) return nullptr;
+
+  // 旧索引被替换后会被释放，其内存最终可能被重用，所以读取器要检查容量是否合理
+  prop_index* index = reinterpret_cast<prop_index*>(to_prop_obj(off));
+  if (index == nullptr) return nullptr;
+  const uint32_t capacity = index->capacity;
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      sizeof(prop_index) + capacity * sizeof(prop_index::slot) > data_size() - off) {
+    return nullptr;
+  }
+  return index;
+}
+
+// 在哈希索引中查找属性
+// 如果结果是确定的（找到了，或者索引完整且确实不存在），将*conclusive设置为true，
+// 否则调用者需要回退到trie查找
+const prop_info* prop_area::index_find(prop_index* const index, const char* name, uint32_t hash,
+                                       bool* conclusive) {
+  const uint32_t capacity = index->capacity;  // 只读取一次，index()已经检查过这个值
+  const uint32_t mask = capacity - 1;
+  uint32_t pos = hash & mask;
+  for (uint32_t probes = 0; probes < capacity; ++probes, pos = (pos + 1) & mask) {
+    prop_index::slot* slot = &index->slots[pos];
+    uint_least32_t offset = atomic_load_explicit(&slot->offset, memory_order_acquire);
+    if (offset == 0) break;  // 遇到空槽，探测结束
+    if (offset == prop_index::kTombstone) continue;  // 已删除的条目
+    if (atomic_load_explicit(&slot->hash, memory_order_relaxed) != hash) continue;
+
+    // 比较完整名称，排除哈希冲突和指向已删除属性的旧条目
+    prop_info* pi = reinterpret_cast<prop_info*>(to_prop_obj(offset));
+    if (pi != nullptr && strcmp(pi->name, name) == 0) {
+      *conclusive = true;
+      return pi;
+    }
+  }
+  *conclusive = atomic_load_explicit(&index->incomplete, memory_order_relaxed) == 0;
+  return nullptr;
+}
+
+// 向哈希索引中插入条目，索引需要扩容时返回false
+bool prop_area::index_insert(prop_index* const index, uint32_t hash, uint_least32_t offset) {
+  if ((index->used + 1) * 2 > index->capacity) {  // 保持装载因子不超过1/2，使未命中的探测保持很短
+    return false;
+  }
+
+  const uint32_t mask = index->capacity - 1;
+  prop_index::slot* target = nullptr;
+  for (uint32_t pos = hash & mask;; pos = (pos + 1) & mask) {
+    prop_index::slot* slot = &index->slots[pos];
+    uint_least32_t slot_offset = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+    if (slot_offset == offset) return true;  // 已经在索引中
+    if (slot_offset == prop_index::kTombstone) {
+      if (!target) target = slot;  // 记录第一个可重用的墓碑槽，但继续检查重复
+    } else if (slot_offset == 0) {
+      if (!target) {
+        target = slot;
+        ++index->used;
+      }
+      break;
+    }
+  }
+
+  // 先写哈希，再以release顺序发布偏移量
+  atomic_store_explicit(&target->hash, hash, memory_order_relaxed);
+  atomic_store_explicit(&target->offset, offset, memory_order_release);
+  return true;
+}
+
+// 根据trie重建哈希索引，重建时会丢弃所有墓碑
+bool prop_area::rebuild_index() {
+  struct rebuild_state {
+    prop_area* pa;
+    prop_index* index;
+    uint32_t count;
+    bool ok;
+  } state = {this, nullptr, 0, true};
+
+  // 先统计trie中的属性数量
+  foreach_property(root_node(), [](const prop_info*, void* cookie) {
+    reinterpret_cast<rebuild_state*>(cookie)->count++;
+  }, &state);
+
+  uint32_t capacity = kMinIndexCapacity;
+  while (capacity < 4 * state.count) capacity *= 2;  // 重建后装载因子不超过1/4
+
+  uint_least32_t new_offset;
+  void* p = allocate_obj(sizeof(prop_index) + capacity * sizeof(prop_index::slot), &new_offset);
+  if (p == nullptr) {
+    return false;
+  }
+  state.index = reinterpret_cast<prop_index*>(p);
+  state.index->capacity = capacity;
+  state.index->used = 0;
+  atomic_init(&state.index->incomplete, 0u);
+  for (uint32_t i = 0; i < capacity; ++i) {
+    atomic_init(&state.index->slots[i].hash, 0u);
+    atomic_init(&state.index->slots[i].offset, 0u);
+  }
+
+  foreach_property(root_node(), [](const prop_info* pi, void* cookie) {
+    rebuild_state* state = reinterpret_cast<rebuild_state*>(cookie);
+    const uint_least32_t offset = reinterpret_cast<const char*>(pi) - state->pa->data_;
+    if (!state->pa->index_insert(state->index, prop_name_hash(pi->name, strlen(pi->name)),
+                                 offset)) {
+      state->ok = false;
+    }
+  }, &state);
+  if (!state.ok) {  // 在统计之后不会有新属性加入，这里只是防御
+    atomic_store_explicit(&state.index->incomplete, 1u, memory_order_relaxed);
+  }
+
+  // 发布新索引后释放旧索引。仍在探测旧索引的读取器只读取一次容量，
+  // 并且会比较名称，所以即使旧索引的内存被重用也只会导致回退到trie查找
+  const uint_least32_t old_offset = atomic_load_explicit(&index_offset_, memory_order_relaxed);
+  prop_index* old_index = index();
+  atomic_store_explicit(&index_offset_, new_offset, memory_order_release);
+  if (old_index != nullptr) {
+    free_obj(old_offset, sizeof(prop_index) + old_index->capacity * sizeof(prop_index::slot));
+  }
+  return true;
+}
+
+// 将新添加的属性加入哈希索引
+void prop_area::index_add(const prop_info* pi, uint32_t namelen) {
+  const uint_least32_t offset = reinterpret_cast<const char*>(pi) - data_;
+  prop_index* index = this->index();
+  if (index != nullptr && atomic_load_explicit(&index->incomplete, memory_order_relaxed) == 0 &&
+      index_insert(index, prop_name_hash(pi->name, namelen), offset)) {
+    return;
+  }
+
+  // 上次重建因空间不足失败之后区域没有扩展也没有释放空间时，重建仍会失败，
+  // 不要每次添加都遍历trie（索引已经标记为不完整）
+  const uint32_t space = data_size() + bytes_free_;
+  if (index_rebuild_space_ == space) {
+    return;
+  }
+
+  // 没有索引、索引已满或者之前因空间不足而不完整（区域可能已经扩展），
+  // 从trie重建一个更大的索引（新属性已经在trie中）
+  if (rebuild_index()) {
+    index_rebuild_space_ = 0;
+    return;
+  }
+  index_rebuild_space_ = space;
+  if (index != nullptr) {
+    // 空间不足，读取器在未命中时必须回退到trie
+    atomic_store_explicit(&index->incomplete, 1u, memory_order_relaxed);
+  }
+}
+
+// 从哈希索引中删除属性，必须在清除属性名之前调用
+void prop_area::index_remove(const prop_info* pi) {
+  prop_index* index = this->index();
+  if (index == nullptr) return;
+
+  const uint_least32_t offset = reinterpret_cast<const char*>(pi) - data_;
+  const uint32_t mask = index->capacity - 1;
+  uint32_t pos = prop_name_hash(pi->name, strlen(pi->name)) & mask;
+  for (uint32_t probes = 0; probes < index->capacity; ++probes, pos = (pos + 1) & mask) {
+    prop_index::slot* slot = &index->slots[pos];
+    uint_least32_t slot_offset = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+    if (slot_offset == 0) return;
+    if (slot_offset == offset) {
+      atomic_store_explicit(&slot->offset, prop_index::kTombstone, memory_order_release);
+      return;
+    }
+  }
+}
+
 // 查找属性（公共接口）
 const prop_info* prop_area::find(const char* name) {
-  return find_property(root_node(), name, strlen(name), nullptr, 0, false);  // 不分配新节点
+  const uint32_t namelen = strlen(name);
+  prop_index* index = this->index();
+  if (index != nullptr) {  // 优先使用哈希索引
+    bool conclusive;
+    const prop_info* pi = index_find(index, name, prop_name_hash(name, namelen), &conclusive);
+    if (conclusive) return pi;
+  }
+  return find_property(root_node(), name, namelen, nullptr, 0, false);  // 不分配新节点
+}
+
+// 查找预先计算好长度、哈希和分段的属性名
+const prop_info* prop_area::find(const prop_name& name) {
+  if (name.num_segments == 0) {  // 没有记录分段的名称按普通名称查找
+    return find(name.name);
+  }
+  prop_index* index = this->index();
+  if (index != nullptr) {
+    bool conclusive;
+    const prop_info* pi = index_find(index, name.name, name.hash, &conclusive);
+    if (conclusive) return pi;
+  }
+
+  // 按记录的分段遍历trie，不需要再查找分隔符
+  prop_bt* current = root_node();
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < name.num_segments && current != nullptr; ++i) {
+    current = find_child(current, name.name + start, name.segment_ends[i] - start, false);
+    start = name.segment_ends[i] + 1;
+  }
+  if (current == nullptr || atomic_load_explicit(&current->prop, memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  // 与find_property()一样，节点可能已被修剪并清零，需要确认名称
+  const prop_info* pi = to_prop_info(&current->prop);
+  if (pi != nullptr && strncmp(pi->name, name.name, name.namelen) == 0 &&
+      pi->name[name.namelen] == '\0') {
+    return pi;
+  }
+  return nullptr;
+}
+
+// 批量查找已按strcmp()排序的属性名
+// 相邻名称共享的以'.'分隔的前缀只遍历一次，后续名称直接从缓存的trie节点继续查找
+void prop_area::find_many(const char* const names[], size_t count, const prop_info* results[]) {
+  prop_index* index = this->index();
+  if (index != nullptr && atomic_load_explicit(&index->incomplete, memory_order_relaxed) == 0) {
+    // 完整的哈希索引对每个名称只需O(1)次探测，不需要复用trie路径
+    for (size_t i = 0; i < count; ++i) {
+      bool conclusive;
+      results[i] = index_find(index, names[i], prop_name_hash(names[i], strlen(names[i])),
+                              &conclusive);
+    }
+    return;
+  }
+
+  // path[i]是上一个名称第i段对应的trie节点，更深的段不缓存
+  constexpr size_t kMaxCachedDepth = 16;
+  prop_bt* path[kMaxCachedDepth];
+  size_t path_len = 0;
+  const char* prev = nullptr;
+
+  for (size_t i = 0; i < count; ++i) {
+    const char* name = names[i];
+
+    // 计算与上一个名称共享的完整段数（不超过已缓存的段数）
+    size_t depth = 0;
+    const char* remaining_name = name;
+    if (prev != nullptr) {
+      for (const char *a = name, *b = prev; *a != '\0' && *a == *b; ++a, ++b) {
+        if (*a == '.') {
+          if (depth == path_len) break;
+          ++depth;
+          remaining_name = a + 1;
+        }
+      }
+    }
+    path_len = depth;
+    prev = name;
+
+    prop_bt* current = depth ? path[depth - 1] : root_node();
+    while (current) {
+      const char* sep = strchr(remaining_name, '.');
+      const uint32_t substr_size = sep ? sep - remaining_name : strlen(remaining_name);
+      if (!substr_size) {  // 空片段，名称无效
+        current = nullptr;
+        break;
+      }
+
+      current = find_child(current, remaining_name, substr_size, false);
+      if (!current) break;
+      if (depth < kMaxCachedDepth && path_len == depth) {  // 记录路径供下一个名称复用
+        path[path_len++] = current;
+      }
+      ++depth;
+
+      if (!sep) break;
+      remaining_name = sep + 1;
+    }
+
+    results[i] = nullptr;
+    if (current && atomic_load_explicit(&current->prop, memory_order_relaxed) != 0) {
+      results[i] = to_prop_info(&current->prop);
+    }
+  }
+}
+
+// 检查名称的每个以'.'分隔的片段都不为空，这样的名称添加失败只能是因为区域已满
+bool prop_area::is_valid_name(const char* name) {
+  if (*name == '.' || *name == '\0') {
+    return false;
+  }
+  for (; *name != '\0'; ++name) {
+    if (*name == '.' && (name[1] == '.' || name[1] == '\0')) {
+      return false;
+    }
+  }
+  return true;
 }
 
 // 添加属性（公共接口）
 bool prop_area::add(const char* name, unsigned int namelen, const char* value,
                     unsigned int valuelen) {
-  return find_property(root_node(), name, namelen, value, valuelen, true);  // 允许分配新节点
+  // 允许分配新节点
+  const prop_info* pi = find_property(root_node(), name, namelen, value, valuelen, true);
+  if (!pi) {
+    return false;
+  }
+  index_add(pi, namelen);  // 在trie中发布之后再加入哈希索引
+  return true;
+}
+
+// 开始批量添加属性
+void prop_area::bulk_begin(prop_area_bulk* bulk) {
+  bulk->prev = nullptr;
+  bulk->depth = 0;
+}
+
+// 批量添加下一个属性，名称应按strcmp()排序
+const prop_info* prop_area::bulk_add(prop_area_bulk* bulk, const char* name, unsigned int namelen,
+                                     const char* value, unsigned int valuelen) {
+  // 计算与上一个名称共享的完整段数（不超过已记录的段数）
+  uint32_t depth = 0;
+  const char* remaining_name = name;
+  if (bulk->prev != nullptr) {
+    const char* a = name;
+    const char* b = bulk->prev;
+    for (; *a != '\0' && *a == *b; ++a, ++b) {
+      if (*a == '.') {
+        if (depth == bulk->depth) break;
+        ++depth;
+        remaining_name = a + 1;
+      }
+    }
+    if (*a == '.' && *b == '\0' && depth < bulk->depth) {  // 上一个名称是这个名称的前缀
+      ++depth;
+      remaining_name = a + 1;
+    }
+  }
+  // 更深的节点离开路径，它们下面的名称已经添加完，此时才重建排序数组
+  while (bulk->depth > depth) {
+    if (!update_sorted_children(bulk->path[bulk->depth - 1])) {
+      return nullptr;  // 节点留在路径上，区域扩展后用同一个名称重试
+    }
+    --bulk->depth;
+  }
+  bulk->prev = name;
+
+  prop_bt* current = depth ? bulk->path[depth - 1] : root_node();
+  while (true) {
+    const char* sep = strchr(remaining_name, '.');
+    const uint32_t substr_size = sep ? sep - remaining_name : strlen(remaining_name);
+    if (!substr_size) {  // 空片段，名称无效
+      return nullptr;
+    }
+
+    // 父节点在路径上（根节点在bulk_end()中处理）时推迟重建它的排序数组，
+    // 路径记录不下的节点离开时没有人重建，按普通方式添加
+    const bool parent_on_path = depth <= prop_area_bulk::kMaxDepth;
+    current = find_child(current, remaining_name, substr_size, true, !parent_on_path);
+    if (!current) {
+      return nullptr;  // 区域已满，已经记录的路径仍然有效
+    }
+    if (depth < prop_area_bulk::kMaxDepth) {
+      bulk->path[bulk->depth++] = current;
+    }
+    ++depth;
+
+    if (!sep) break;
+    remaining_name = sep + 1;
+  }
+
+  const prop_info* pi = node_property(current, name, namelen, value, valuelen, true);
+  if (pi != nullptr) {
+    index_add(pi, namelen);  // 与add()相同，在trie中发布之后再加入哈希索引
+  }
+  return pi;
+}
+
+// 结束批量添加，重建路径上剩余节点和根节点的排序数组
+bool prop_area::bulk_end(prop_area_bulk* bulk) {
+  while (bulk->depth > 0) {
+    if (!update_sorted_children(bulk->path[bulk->depth - 1])) {
+      return false;
+    }
+    --bulk->depth;
+  }
+  if (!update_sorted_children(root_node())) {
+    return false;
+  }
+  bulk->prev = nullptr;
+  return true;
 }
 
 // 遍历所有属性（公共接口）
@@ -408,6 +1350,144 @@ bool prop_area::foreach (void (*propfn)(const prop_info* pi, void* cookie), void
   return foreach_property(root_node(), propfn, cookie);  // 从根节点开始遍历
 }
 
+// 遍历名称以prefix开头的属性（公共接口）
+// 完整的以'.'分隔的段直接沿trie向下查找，最后不完整的段只用于筛选那一层的兄弟节点
+bool prop_area::foreach_prefix(const char* prefix,
+                               void (*propfn)(const prop_info* pi, void* cookie), void* cookie) {
+  prop_bt* current = root_node();
+  const char* remaining_prefix = prefix;
+  const char* sep;
+  while ((sep = strchr(remaining_prefix, '.')) != nullptr) {
+    const uint32_t substr_size = sep - remaining_prefix;
+    if (!substr_size) {  // 空片段，不可能有属性名以此为前缀
+      return true;
+    }
+    current = find_child(current, remaining_prefix, substr_size, false);
+    if (!current) {
+      return true;  // 没有属性在这个子树中
+    }
+    remaining_prefix = sep + 1;
+  }
+
+  if (atomic_load_explicit(&current->children, memory_order_relaxed) == 0) {
+    return true;
+  }
+  const uint32_t segment_len = strlen(remaining_prefix);
+  return foreach_subtree(to_prop_bt(&current->children), segment_len ? remaining_prefix : nullptr,
+                         segment_len, propfn, cookie);
+}
+
+// 开始逐个遍历区域中的属性
+void prop_area::cursor_begin(prop_area_cursor* cursor) {
+  cursor->depth = 0;
+  cursor->last = 0;
+  cursor->overflowed = 0;
+  const uint_least32_t children_offset =
+      atomic_load_explicit(&root_node()->children, memory_order_relaxed);
+  if (children_offset != 0) {
+    cursor->stack[cursor->depth++] = children_offset;
+  }
+}
+
+// 返回下一个属性，顺序与foreach_property()相同：左子树、节点本身、子节点、右子树
+const prop_info* prop_area::cursor_next(prop_area_cursor* cursor) {
+  constexpr uint_least32_t kVisit = 1;  // 对象按4字节对齐，最低位标记左子树已经处理完的节点
+
+  while (!cursor->overflowed && cursor->depth > 0) {
+    const uint_least32_t entry = cursor->stack[--cursor->depth];
+    prop_bt* bt = reinterpret_cast<prop_bt*>(to_prop_obj(entry & ~kVisit));
+    if (!bt) return nullptr;
+
+    if (entry & kVisit) {
+      if (atomic_load_explicit(&bt->prop, memory_order_relaxed) != 0) {
+        prop_info* info = to_prop_info(&bt->prop);
+        if (!info) return nullptr;
+        cursor->last = offset_of(info);
+        return info;
+      }
+      continue;
+    }
+
+    // 按出栈顺序的逆序入栈，最多需要4个位置
+    if (cursor->depth + 4 > prop_area_cursor::kStackSize) {
+      cursor->overflowed = 1;
+      break;
+    }
+    const uint_least32_t right = atomic_load_explicit(&bt->right, memory_order_relaxed);
+    const uint_least32_t children = atomic_load_explicit(&bt->children, memory_order_relaxed);
+    const uint_least32_t left = atomic_load_explicit(&bt->left, memory_order_relaxed);
+    if (right != 0) cursor->stack[cursor->depth++] = right;
+    if (children != 0) cursor->stack[cursor->depth++] = children;
+    cursor->stack[cursor->depth++] = entry | kVisit;
+    if (left != 0) cursor->stack[cursor->depth++] = left;
+  }
+  if (!cursor->overflowed) {
+    return nullptr;
+  }
+
+  // trie太深，栈放不下时按上一个返回的属性的名称从根节点重新下降，找到排在它之后的属性。
+  // prop_info被删除后仍然保留名称，所以上一个属性被删除了也可以继续
+  prop_bt* root = sibling(&root_node()->children);
+  const prop_info* result;
+  if (cursor->last == 0) {
+    result = first_property(root);
+  } else {
+    const prop_info* last = reinterpret_cast<const prop_info*>(to_prop_obj(cursor->last));
+    result = last != nullptr ? next_property(root, last->name) : nullptr;
+  }
+  if (result != nullptr) cursor->last = offset_of(result);
+  return result;
+}
+
+// 偏移量指向的兄弟或子节点，偏移量为0时返回nullptr
+prop_bt* prop_area::sibling(atomic_uint_least32_t* off_p) {
+  return atomic_load_explicit(off_p, memory_order_relaxed) != 0 ? to_prop_bt(off_p) : nullptr;
+}
+
+// 按foreach_property()的顺序，返回兄弟二叉树bt（包括各节点的子节点）中的第一个属性
+const prop_info* prop_area::first_property(prop_bt* const bt) {
+  for (prop_bt* current = bt; current != nullptr; current = sibling(&current->right)) {
+    const prop_info* pi = first_property(sibling(&current->left));
+    if (pi != nullptr) return pi;
+    if (atomic_load_explicit(&current->prop, memory_order_relaxed) != 0) {
+      return to_prop_info(&current->prop);
+    }
+    pi = first_property(sibling(&current->children));
+    if (pi != nullptr) return pi;
+  }
+  return nullptr;
+}
+
+// 按foreach_property()的顺序，返回兄弟二叉树bt中排在名称name之后的第一个属性，
+// name是从bt这一层开始的剩余部分。这个顺序逐段比较名称，节点本身的属性在它的子节点之前
+const prop_info* prop_area::next_property(prop_bt* const bt, const char* name) {
+  const char* sep = strchr(name, '.');
+  const uint32_t namelen = sep ? sep - name : strlen(name);
+  for (prop_bt* current = bt; current != nullptr;) {
+    const int ret = cmp_prop_name(name, namelen, current->name, current->namelen);
+    if (ret > 0) {  // 节点和它的左子树都在name之前
+      current = sibling(&current->right);
+      continue;
+    }
+    const prop_info* pi;
+    if (ret < 0) {  // 节点在name之后，先在左子树中查找
+      pi = next_property(sibling(&current->left), name);
+      if (pi != nullptr) return pi;
+      if (atomic_load_explicit(&current->prop, memory_order_relaxed) != 0) {
+        return to_prop_info(&current->prop);
+      }
+      pi = first_property(sibling(&current->children));
+    } else if (sep != nullptr) {  // 同一段，在子节点中继续比较下一段
+      pi = next_property(sibling(&current->children), sep + 1);
+    } else {  // name就是这个节点的属性，之后是它的子节点
+      pi = first_property(sibling(&current->children));
+    }
+    if (pi != nullptr) return pi;
+    return first_property(sibling(&current->right));
+  }
+  return nullptr;
+}
+
 #define get_offset(ptr)        atomic_load_explicit(ptr, memory_order_relaxed)  // 获取偏移量宏
 #define set_offset(ptr, val)   atomic_store_explicit(ptr, val, memory_order_release)  // 设置偏移量宏
 
@@ -417,12 +1497,20 @@ bool prop_area::foreach (void (*propfn)(const prop_info* pi, void* cookie), void
 // 当此方法返回true时，从父节点分离该节点
 bool prop_area::prune_trie(prop_bt *const node) {
   bool is_leaf = true;  // 是否为叶节点
+  prop_bt_children* children = children_of(node);
   if (get_offset(&node->children) != 0) {
     if (prune_trie(to_prop_bt(&node->children))) {
       set_offset(&node->children, 0u);
     } else {
       is_leaf = false;
     }
+    // 排序数组不能再引用被释放的子节点，先释放旧数组，重建失败时读取器只使用二叉树
+    if (children != nullptr &&
+        collect_siblings(get_offset(&node->children) != 0 ? to_prop_bt(&node->children) : nullptr,
+                         nullptr, 0) != get_offset(&children->count)) {
+      free_sorted_children(children);
+      rebuild_sorted_children(node, children);
+    }
   }
   if (get_offset(&node->left) != 0) {
     if (prune_trie(to_prop_bt(&node->left))) {
@@ -440,15 +1528,34 @@ bool prop_area::prune_trie(prop_bt *const node) {
   }
 
   if (is_leaf && get_offset(&node->prop) == 0) {
-    // Wipe the node
-    memset(node->name, 0, node->namelen);
-    memset(node, 0, sizeof(*node));
+    if (children != nullptr) free_sorted_children(children);
+    // Wipe the node. Its memory isn't reused, as lock-free readers may still be walking it
+    memset(node, 0, prop_bt_size(version_, node->namelen));
     // Then return true to detach the node from parent
     return true;
   }
   return false;
 }
 
+// 扩展属性区域：文件大小翻倍，但不超过预留的地址范围
+bool prop_area::grow(const char* filename) {
+  const uint32_t size = atomic_load_explicit(&size_, memory_order_relaxed);
+  if (size == 0 || size >= max_size_) {  // 旧格式的区域不能扩展
+    return false;
+  }
+
+  const uint32_t new_size = size * 2 < max_size_ ? size * 2 : max_size_;
+  if (truncate(filename, new_size) != 0) {
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not grow \"%s\" to %u bytes: %s",
+                          filename, new_size, strerror(errno));
+    return false;
+  }
+
+  // 新空间中的对象都在此之后才以release顺序发布
+  atomic_store_explicit(&size_, new_size, memory_order_relaxed);
+  return true;
+}
+
 // 删除属性
 bool prop_area::remove(const char *name, bool prune) {
   prop_bt *node = traverse_trie(root_node(), name, false);  // 查找目标节点
@@ -459,16 +1566,35 @@ bool prop_area::remove(const char *name, bool prune) {
 
   prop_info *prop = to_prop_info(&node->prop);  // 获取属性信息
 
-  // 尽快从trie中分离属性
+  // 尽快从trie和哈希索引中分离属性
   set_offset(&node->prop, 0u);
-
-  // 然后从内存中清除属性
-  if (prop->is_long()) {  // 如果是长属性
-    char *value = const_cast<char*>(prop->long_value());
-    memset(value, 0, strlen(value));  // 清除长值
+  index_remove(prop);
+
+  // 然后把值清空。prop_info保留名称，持有它的读取器和缓存看到的是同一个属性变为空值，
+  // 它只会在同名属性再次添加时被重新使用
+  uint32_t serial = atomic_load_explicit(&prop->serial, memory_order_relaxed);
+  const char* long_value = prop->is_long() ? prop->long_value() : nullptr;
+  const bool read_only = strncmp(prop->name, "ro.", 3) == 0;
+  memcpy(dirty_backup_area(), prop->value, (serial >> 24) + 1);  // 备份旧值
+  atomic_thread_fence(memory_order_release);
+  serial |= 1;  // 设置脏位
+  atomic_store_explicit(&prop->serial, serial, memory_order_relaxed);
+  memset(prop->value, 0, sizeof(prop->value));
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&prop->serial, prop_info::next_serial(serial, 0, false),
+                        memory_order_relaxed);
+  __futex_wake(&prop->serial, INT32_MAX);
+  free_prop_info(prop_offset, sizeof(prop_info) + strlen(prop->name) + 1);
+  if (long_value != nullptr) {
+    if (read_only) {
+      // 只读长值被读取器原地使用，只清除而不释放
+      memset(const_cast<char*>(long_value), 0, strlen(long_value));
+    } else {
+      // 读取器复制可变长值后会检查序列号，栅栏保证读到重用内容的读取器也能看到新序列号
+      atomic_thread_fence(memory_order_release);
+      free_long_value(long_value);
+    }
   }
-  memset(prop->name, 0, strlen(prop->name));  // 清除属性名
-  memset(prop, 0, sizeof(*prop));  // 清除属性对象
 
   if (prune) {  // 如果需要修剪
     prune_trie(root_node());  // 修剪trie
@@ -476,3 +1602,132 @@ bool prop_area::remove(const char *name, bool prune) {
 
   return true;
 }
+
+// 为属性分配新的长值，返回相对于prop_info的偏移量
+uint32_t prop_area::new_long_value(const prop_info* pi, const char* value, uint32_t valuelen) {
+  // prop_info中的偏移量是无符号的，新值必须在prop_info之后
+  const uint_least32_t pi_offset = offset_of(pi);
+  const size_t size = __BIONIC_ALIGN(valuelen + 1, sizeof(uint_least32_t));
+  uint_least32_t new_offset;
+  char* p = reinterpret_cast<char*>(allocate_obj(size, &new_offset, pi_offset));
+  if (p == nullptr) {
+    return 0;
+  }
+  memcpy(p, value, valuelen);
+  p[valuelen] = '\0';
+  return new_offset - pi_offset;
+}
+
+// 释放不再被引用的长值
+void prop_area::free_long_value(const char* value) {
+  const size_t size = __BIONIC_ALIGN(strlen(value) + 1, sizeof(uint_least32_t));
+  memset(const_cast<char*>(value), 0, size);
+  free_obj(value - data_, size);
+}
+
+// 复制可变属性的长值，值块可能已被释放并重用，所以长度受缓冲区和区域大小的限制
+void prop_area::read_long_value(const prop_info* pi, char* value) {
+  const char* src = pi->long_value();
+  const size_t off = src - data_;
+  size_t len = 0;
+  if (src > reinterpret_cast<const char*>(pi) && off < data_size()) {
+    size_t max_len = data_size() - off;
+    if (max_len > prop_info::kMutableLongValueMax - 1) max_len = prop_info::kMutableLongValueMax - 1;
+    len = strnlen(src, max_len);
+    memcpy(value, src, len);
+  }
+  value[len] = '\0';
+}
+
+// 获取序列区域的变更日志
+prop_changelog* prop_area::changelog() {
+  uint_least32_t off = atomic_load_explicit(&changelog_offset_, memory_order_acquire);
+  if (off == 0) return nullptr;
+
+  if (off > data_size() || sizeof(prop_changelog) > data_size() - off) return nullptr;
+  return reinterpret_cast<prop_changelog*>(data_ + off);
+}
+
+// 在序列区域中分配空的变更日志，分配到的内存是清零的，也就是一个空日志
+bool prop_area::init_changelog() {
+  if (changelog() != nullptr) return true;
+
+  uint_least32_t off;
+  if (allocate_obj(sizeof(prop_changelog), &off) == nullptr) {
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not allocate property change log");
+    return false;
+  }
+  atomic_store_explicit(&changelog_offset_, off, memory_order_release);
+  return true;
+}
+
+// 把变更日志记录的偏移量转换为属性信息指针
+const prop_info* prop_area::prop_info_at(uint_least32_t off) {
+  if (off == 0 || off > data_size() || sizeof(prop_info) > data_size() - off) return nullptr;
+
+  return reinterpret_cast<const prop_info*>(data_ + off);
+}
+
+// 把密封表复制到区域中，表写完之后才发布它的偏移量
+bool prop_area::set_ro_table(const void* table, uint32_t size) {
+  if (atomic_load_explicit(&ro_table_offset_, memory_order_relaxed) != 0) return false;
+
+  uint_least32_t off;
+  void* data = allocate_obj(size, &off);
+  if (data == nullptr) return false;
+  memcpy(data, table, size);
+  atomic_store_explicit(&ro_table_offset_, off, memory_order_release);
+  return true;
+}
+
+// 在区域的密封表中查找只读属性，表无效或者名称不在表中时返回nullptr
+const prop_info* prop_area::find_sealed(const char* name, uint32_t hash) {
+  const uint_least32_t table_off = atomic_load_explicit(&ro_table_offset_, memory_order_acquire);
+  if (table_off == 0 || table_off >= data_size()) return nullptr;
+
+  const prop_ro_table* table =
+      prop_ro_table::validate(data_ + table_off, data_size() - table_off);
+  uint32_t off;
+  if (table == nullptr || !table->find(hash, &off)) return nullptr;
+
+  // 偏移量来自同一区域的表，只需要检查它和名称都在区域之内
+  const prop_info* pi = prop_info_at(off);
+  if (pi == nullptr) return nullptr;
+  const size_t namelen = strlen(name);
+  if (namelen >= data_size() - off - offsetof(prop_info, name) ||
+      memcmp(pi->name, name, namelen + 1) != 0) {
+    return nullptr;
+  }
+  return pi;
+}
+
+// 追加一条修改记录，只有写入者调用
+void prop_changelog::append(uint32_t serial, uint32_t area_index, uint_least32_t offset) {
+  const uint32_t position = atomic_load_explicit(&head_, memory_order_relaxed);
+  entry* e = &entries_[position % kSize];
+
+  // 先把序号改成这个槽中不会出现的位置，读取器看到旧序号之后读到的内容都会被检查出来
+  atomic_store_explicit(&e->sequence, position + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&e->serial, serial, memory_order_relaxed);
+  atomic_store_explicit(&e->area_index, area_index, memory_order_relaxed);
+  atomic_store_explicit(&e->offset, offset, memory_order_relaxed);
+  atomic_store_explicit(&e->sequence, position, memory_order_release);
+  if (position + 1 == 0) {  // 位置回绕之后，环中的记录都是有效的
+    atomic_store_explicit(&wrapped_, 1u, memory_order_relaxed);
+  }
+  atomic_store_explicit(&head_, position + 1, memory_order_release);
+}
+
+// 读取position处的修改记录，已经被覆盖时返回false
+bool prop_changelog::read(uint32_t position, change* out) {
+  entry* e = &entries_[position % kSize];
+
+  const uint32_t sequence = atomic_load_explicit(&e->sequence, memory_order_acquire);
+  if (sequence != position) return false;
+  out->serial = atomic_load_explicit(&e->serial, memory_order_relaxed);
+  out->area_index = atomic_load_explicit(&e->area_index, memory_order_relaxed);
+  out->offset = atomic_load_explicit(&e->offset, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&e->sequence, memory_order_relaxed) == sequence;
+}
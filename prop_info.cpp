@@ -56,3 +56,10 @@ prop_info::prop_info(const char* name, uint32_t namelen, uint32_t long_offset) {
 
   this->long_property.offset = long_offset;  // 设置长属性偏移量
 }
+
+// 把值在prop_info中的属性转换为长属性，返回错误消息的长度
+uint32_t prop_info::make_long(uint32_t long_offset) {
+  memcpy(this->long_property.error_message, kLongLegacyError, sizeof(kLongLegacyError));
+  set_long_value(long_offset);
+  return sizeof(kLongLegacyError) - 1;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "system_properties/prop_ro_table.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <async_safe/log.h>
+
+#include "system_properties/prop_area.h"
+#include "system_properties/prop_hash.h"
+#include "system_properties/prop_info.h"
+
+// 每个桶平均的名称数，桶越大表越小，但构建时越难为大桶找到种子
+static constexpr uint32_t kNamesPerBucket = 4;
+// 为一个桶尝试的种子数上限，超过时放弃构建
+static constexpr uint32_t kMaxSeedAttempts = 1 << 20;
+
+// 查找hash所在的槽，槽中的哈希值不同时说明名称不在表中
+bool prop_ro_table::find(uint32_t hash, uint32_t* offset) const {
+  if (num_slots == 0) {
+    return false;
+  }
+  const uint32_t seed = seeds()[hash % num_buckets];
+  const slot& s = slots()[prop_ro_table_mix(hash, seed) % num_slots];
+  if (s.offset == 0 || s.hash != hash) {
+    return false;
+  }
+  *offset = s.offset;
+  return true;
+}
+
+// 验证区域中的密封表，表头和各数组都必须在size之内
+const prop_ro_table* prop_ro_table::validate(const void* data, size_t size) {
+  if (size < sizeof(prop_ro_table)) {
+    return nullptr;
+  }
+  const prop_ro_table* table = static_cast<const prop_ro_table*>(data);
+  const uint64_t expected_size = sizeof(prop_ro_table) +
+                                 static_cast<uint64_t>(table->num_buckets) * sizeof(uint32_t) +
+                                 static_cast<uint64_t>(table->num_slots) * sizeof(slot);
+  if (table->magic != kMagic || table->version != kVersion || table->size != expected_size ||
+      expected_size > size || table->num_slots == 0 || table->num_buckets == 0) {
+    return nullptr;
+  }
+  return table;
+}
+
+// 用CHD方法为entries构建最小完美哈希，结果追加到data中
+static bool build_table(std::vector<prop_ro_table::slot> entries, std::string* data) {
+  // 哈希值相同的名称无法区分，全部去掉，读取者会按普通方式查找它们
+  std::sort(entries.begin(), entries.end(),
+            [](const prop_ro_table::slot& a, const prop_ro_table::slot& b) {
+              return a.hash < b.hash;
+            });
+  std::vector<prop_ro_table::slot> unique;
+  for (size_t i = 0; i < entries.size();) {
+    size_t j = i + 1;
+    while (j < entries.size() && entries[j].hash == entries[i].hash) ++j;
+    if (j == i + 1) unique.push_back(entries[i]);
+    i = j;
+  }
+
+  const uint32_t num_slots = unique.size();
+  const uint32_t num_buckets = (num_slots + kNamesPerBucket - 1) / kNamesPerBucket;
+  std::vector<std::vector<uint32_t>> buckets(num_buckets);
+  for (uint32_t i = 0; i < num_slots; ++i) {
+    buckets[unique[i].hash % num_buckets].push_back(i);
+  }
+
+  // 先处理大桶，这时空槽最多，容易找到种子
+  std::vector<uint32_t> order(num_buckets);
+  for (uint32_t i = 0; i < num_buckets; ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  std::vector<uint32_t> seeds(num_buckets, 0);
+  std::vector<prop_ro_table::slot> slots(num_slots, prop_ro_table::slot{});
+  std::vector<bool> taken(num_slots, false);
+  std::vector<uint32_t> positions;
+  for (uint32_t bucket : order) {
+    const std::vector<uint32_t>& names = buckets[bucket];
+    if (names.empty()) break;  // 剩下的桶都是空的
+
+    bool placed = false;
+    for (uint32_t seed = 0; seed < kMaxSeedAttempts && !placed; ++seed) {
+      positions.clear();
+      placed = true;
+      for (uint32_t name : names) {
+        uint32_t position = prop_ro_table_mix(unique[name].hash, seed) % num_slots;
+        if (taken[position] ||
+            std::find(positions.begin(), positions.end(), position) != positions.end()) {
+          placed = false;
+          break;
+        }
+        positions.push_back(position);
+      }
+      if (placed) {
+        seeds[bucket] = seed;
+        for (size_t i = 0; i < names.size(); ++i) {
+          taken[positions[i]] = true;
+          slots[positions[i]] = unique[names[i]];
+        }
+      }
+    }
+    if (!placed) {
+      return false;
+    }
+  }
+
+  prop_ro_table header = {};
+  header.magic = prop_ro_table::kMagic;
+  header.version = prop_ro_table::kVersion;
+  header.size = sizeof(header) + num_buckets * sizeof(uint32_t) + num_slots * sizeof(slots[0]);
+  header.num_buckets = num_buckets;
+  header.num_slots = num_slots;
+  data->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  data->append(reinterpret_cast<const char*>(seeds.data()), num_buckets * sizeof(uint32_t));
+  data->append(reinterpret_cast<const char*>(slots.data()), num_slots * sizeof(slots[0]));
+  return true;
+}
+
+// 为区域中的只读属性构建密封表并存入区域，区域空间不足时通过full返回其中一个属性
+bool prop_ro_table::seal(prop_area* pa, const prop_info** full) {
+  *full = nullptr;
+  struct Collector {
+    std::vector<slot> slots;
+    prop_area* pa;
+    const prop_info* first;
+  } collector = {{}, pa, nullptr};
+  pa->foreach_prefix(
+      "ro.",
+      [](const prop_info* pi, void* cookie) {
+        Collector* collector = static_cast<Collector*>(cookie);
+        if (collector->first == nullptr) collector->first = pi;
+        collector->slots.push_back(
+            {prop_name_hash(pi->name, strlen(pi->name)), collector->pa->offset_of(pi)});
+      },
+      &collector);
+  if (collector.slots.empty()) {  // 没有只读属性的区域不需要表
+    return true;
+  }
+
+  std::string data;
+  if (!build_table(std::move(collector.slots), &data)) {
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc",
+                          "Could not build a perfect hash for the ro.* properties");
+    return false;
+  }
+  if (data.size() == sizeof(prop_ro_table)) {  // 所有名称的哈希值都有冲突
+    return true;
+  }
+  if (!pa->set_ro_table(data.data(), data.size())) {
+    *full = collector.first;
+    return false;
+  }
+  return true;
+}
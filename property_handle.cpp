@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <api/_system_properties.h>
+
+#include "system_properties/property_handle.h"
+
+// property_contexts中的数值类型，这些属性不能按bool读取
+static bool is_numeric_type(const char* type) {
+  return strcmp(type, "int") == 0 || strcmp(type, "uint") == 0 || strcmp(type, "double") == 0 ||
+         strcmp(type, "size") == 0;
+}
+
+// 获取属性在property_contexts中的类型，只查询一次
+const char* PropertyHandle::type() {
+  if (!atomic_load_explicit(&type_resolved_, memory_order_acquire)) {
+    // 多个线程可能同时查询，但结果相同
+    atomic_store_explicit(&type_, __system_property_get_type(name_), memory_order_relaxed);
+    atomic_store_explicit(&type_resolved_, true, memory_order_release);
+  }
+  return atomic_load_explicit(&type_, memory_order_relaxed);
+}
+
+// 检查属性的类型能否存放kind类型的值，没有类型或string、enum等类型的属性不做限制
+bool PropertyHandle::TypeAllows(Kind kind) {
+  const char* declared = type();
+  if (declared == nullptr) {
+    return true;
+  }
+  if (kind == kBool) {
+    return !is_numeric_type(declared);
+  }
+  return strcmp(declared, "bool") != 0;
+}
+
+// 按kind解析属性值，成功时返回kind | kParsed并把值的位模式存入bits，否则只返回kind
+uint32_t PropertyHandle::Parse(Kind kind, const char* value, uint64_t* bits) {
+  if (!TypeAllows(kind) || *value == '\0') {
+    return kind;
+  }
+
+  char* end;
+  errno = 0;
+  switch (kind) {
+    case kBool:
+      if (!strcmp(value, "1") || !strcmp(value, "y") || !strcmp(value, "yes") ||
+          !strcmp(value, "on") || !strcmp(value, "true")) {
+        *bits = 1;
+      } else if (!strcmp(value, "0") || !strcmp(value, "n") || !strcmp(value, "no") ||
+                 !strcmp(value, "off") || !strcmp(value, "false")) {
+        *bits = 0;
+      } else {
+        return kind;
+      }
+      return kind | kParsed;
+    case kInt:
+      *bits = static_cast<uint64_t>(strtoll(value, &end, 0));
+      break;
+    case kUint:
+      if (strchr(value, '-') != nullptr) {  // strtoull会接受负数并取反
+        return kind;
+      }
+      *bits = strtoull(value, &end, 0);
+      break;
+    case kDouble: {
+      double d = strtod(value, &end);
+      memcpy(bits, &d, sizeof(d));
+      break;
+    }
+    default:
+      return kind;
+  }
+  // 整个值都必须是数字且没有溢出
+  if (errno != 0 || *end != '\0') {
+    return kind;
+  }
+  return kind | kParsed;
+}
+
+// 获取按kind解析的属性值，属性序列号（属性不存在时是区域序列号）没有变化时直接使用缓存
+// 返回值表示属性是否存在并且解析成功
+bool PropertyHandle::Lookup(Kind kind, uint64_t* bits) {
+  // 快速路径：以读取者的方式读取seqlock保护的缓存
+  uint32_t seq = atomic_load_explicit(&seq_, memory_order_acquire);
+  const prop_info* pi = atomic_load_explicit(&pi_, memory_order_relaxed);
+  if ((seq & 1) == 0) {
+    uint32_t serial = atomic_load_explicit(&serial_, memory_order_relaxed);
+    uint32_t cached_kind = atomic_load_explicit(&kind_, memory_order_relaxed);
+    uint64_t cached_bits = atomic_load_explicit(&bits_, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&seq_, memory_order_relaxed) == seq &&
+        (cached_kind & ~kParsed) == kind) {
+      uint32_t current =
+          pi != nullptr ? __system_property_serial(pi) : __system_property_area_serial();
+      if (current == serial) {
+        *bits = cached_bits;
+        return (cached_kind & kParsed) != 0;
+      }
+    }
+  }
+
+  // 慢速路径：属性的prop_info一旦找到就不会再变化，只有还没找到时才需要查找
+  struct Read {
+    PropertyHandle* handle;
+    Kind kind;
+    uint32_t result;
+    uint32_t serial;
+    uint64_t bits;
+  } read = {this, kind, kind, 0, 0};
+  if (pi == nullptr) {
+    read.serial = __system_property_area_serial();  // 必须在查找之前读取，以免错过并发的添加
+    if (prop_name_ != nullptr) {
+      // 上下文索引解析一次后就固定下来，多个线程同时解析时写入的值相同
+      uint32_t context_index = atomic_load_explicit(&context_index_, memory_order_relaxed);
+      pi = __system_property_find_name(prop_name_, &context_index);
+      atomic_store_explicit(&context_index_, context_index, memory_order_relaxed);
+    } else {
+      pi = __system_property_find(name_);
+    }
+  }
+  if (pi != nullptr) {
+    __system_property_read_callback(
+        pi,
+        [](void* cookie, const char*, const char* value, uint32_t serial) {
+          Read* read = static_cast<Read*>(cookie);
+          read->serial = serial;
+          read->result = read->handle->Parse(read->kind, value, &read->bits);
+        },
+        &read);
+  }
+
+  // 有其他线程正在更新缓存时不等待，这次的结果不缓存
+  uint32_t expected = atomic_load_explicit(&seq_, memory_order_relaxed);
+  if ((expected & 1) == 0 &&
+      atomic_compare_exchange_strong_explicit(&seq_, &expected, expected + 1,
+                                              memory_order_relaxed, memory_order_relaxed)) {
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&pi_, pi, memory_order_relaxed);
+    atomic_store_explicit(&serial_, read.serial, memory_order_relaxed);
+    atomic_store_explicit(&kind_, read.result, memory_order_relaxed);
+    atomic_store_explicit(&bits_, read.bits, memory_order_relaxed);
+    atomic_store_explicit(&seq_, expected + 2, memory_order_release);
+  }
+
+  *bits = read.bits;
+  return (read.result & kParsed) != 0;
+}
+
+// 按bool读取属性
+bool PropertyHandle::GetBool(bool default_value) {
+  uint64_t bits;
+  return Lookup(kBool, &bits) ? bits != 0 : default_value;
+}
+
+// 按有符号整数读取属性，不在[min, max]范围内时返回默认值
+int64_t PropertyHandle::GetInt(int64_t default_value, int64_t min, int64_t max) {
+  uint64_t bits;
+  if (!Lookup(kInt, &bits)) {
+    return default_value;
+  }
+  int64_t value = static_cast<int64_t>(bits);
+  return (value < min || value > max) ? default_value : value;
+}
+
+// 按无符号整数读取属性，大于max时返回默认值
+uint64_t PropertyHandle::GetUint(uint64_t default_value, uint64_t max) {
+  uint64_t bits;
+  if (!Lookup(kUint, &bits)) {
+    return default_value;
+  }
+  return bits > max ? default_value : bits;
+}
+
+// 按浮点数读取属性
+double PropertyHandle::GetDouble(double default_value) {
+  uint64_t bits;
+  if (!Lookup(kDouble, &bits)) {
+    return default_value;
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
@@ -23,6 +23,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "system_properties/prop_prefetch.h"
+
 namespace android {
 namespace properties {
 
@@ -70,6 +72,26 @@ int PropertyInfoArea::FindTypeIndex(const char* type) const {
 // 二分查找子节点列表以找到给定属性片段的TrieNode
 // 用于在GetPropertyInfoIndexes()中遍历Trie树
 bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode* child) const {
+  if (has_lengths()) {
+    // 子节点按名称排序（std::string的顺序，即按较短长度memcmp、再比较长度），
+    // 有了连续存放的长度，二分查找时用memcmp比较，不需要strncmp和检查名称是否结束
+    const uint32_t* lengths = child_lengths();
+    auto node_index = Find(num_child_nodes(), [this, name, namelen, lengths](auto array_offset) {
+      const uint32_t child_len = lengths[array_offset];
+      int cmp = memcmp(child_node(array_offset).name(), name,
+                       child_len < namelen ? child_len : namelen);
+      if (cmp == 0 && child_len != namelen) {
+        cmp = child_len < namelen ? -1 : 1;
+      }
+      return cmp;
+    });
+    if (node_index == -1) {
+      return false;
+    }
+    *child = child_node(node_index);
+    return true;
+  }
+
   auto node_index = Find(trie_node_base_->num_child_nodes, [this, name, namelen](auto array_offset) {
     const char* child_name = child_node(array_offset).name();
     int cmp = strncmp(child_name, name, namelen);
@@ -91,15 +113,19 @@ bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode*
 
 // 检查前缀匹配，更新上下文和类型索引
 // remaining_name: 剩余的属性名部分
+// remaining_name_size: 剩余属性名的长度
 // trie_node: 当前Trie节点
 // context_index: 上下文索引指针（输出参数）
 // type_index: 类型索引指针（输出参数）
-void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                                        uint32_t* context_index, uint32_t* type_index) const {
-  const uint32_t remaining_name_size = strlen(remaining_name);
+void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                                        const TrieNode& trie_node, uint32_t* context_index,
+                                        uint32_t* type_index) const {
+  // 版本2中前缀长度连续存放，不需要为了长度去读每个前缀条目
+  const uint32_t* prefix_lengths =
+      trie_node.has_lengths() ? trie_node.prefix_lengths() : nullptr;
   // 遍历当前节点的所有前缀
   for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
-    auto prefix_len = trie_node.prefix(i)->namelen;
+    auto prefix_len = prefix_lengths ? prefix_lengths[i] : trie_node.prefix(i)->namelen;
     if (prefix_len > remaining_name_size) continue;  // 前缀长度超过剩余名称长度
 
     // 检查前缀是否匹配
@@ -126,6 +152,7 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
   uint32_t return_context_index = ~0u;  // 初始化为无效值
   uint32_t return_type_index = ~0u;     // 初始化为无效值
   const char* remaining_name = name;    // 剩余待处理的属性名
+  const char* name_end = name + strlen(name);  // 只计算一次长度，剩余部分的长度由它得出
   auto trie_node = root_node();         // 从根节点开始遍历
   
   while (true) {
@@ -141,7 +168,8 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
 
     // 检查此节点的前缀。这在节点检查之后进行，因为这些前缀
     // 根据定义比节点本身更长
-    CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+    CheckPrefixMatch(remaining_name, name_end - remaining_name, trie_node, &return_context_index,
+                     &return_type_index);
 
     if (sep == nullptr) {
       break;  // 没有更多分隔符，到达叶节点
@@ -181,7 +209,8 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
     }
   }
   // 检查不以'.'分隔的前缀匹配
-  CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+  CheckPrefixMatch(remaining_name, name_end - remaining_name, trie_node, &return_context_index,
+                     &return_type_index);
   // 返回之前找到的前缀匹配结果
   if (context_index != nullptr) *context_index = return_context_index;
   if (type_index != nullptr) *type_index = return_type_index;
@@ -216,6 +245,73 @@ void PropertyInfoArea::GetPropertyInfo(const char* property, const char** contex
   }
 }
 
+// 报告trie_node及其所有后代中出现的上下文索引
+void PropertyInfoArea::ForEachContextIndexInSubtree(const TrieNode& trie_node,
+                                                    void (*fn)(uint32_t context_index, void* cookie),
+                                                    void* cookie) const {
+  if (trie_node.context_index() != ~0u) fn(trie_node.context_index(), cookie);
+  for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
+    if (trie_node.prefix(i)->context_index != ~0u) fn(trie_node.prefix(i)->context_index, cookie);
+  }
+  for (uint32_t i = 0; i < trie_node.num_exact_matches(); ++i) {
+    if (trie_node.exact_match(i)->context_index != ~0u) {
+      fn(trie_node.exact_match(i)->context_index, cookie);
+    }
+  }
+  for (uint32_t i = 0; i < trie_node.num_child_nodes(); ++i) {
+    ForEachContextIndexInSubtree(trie_node.child_node(i), fn, cookie);
+  }
+}
+
+// 报告名称以prefix开头的属性可能使用的所有上下文索引
+// 沿着prefix的完整段向下走，途中的节点上下文和兼容的前缀都可能生效，
+// 到达最后一段后，名称以这一段开头的子节点的整个子树都可能生效
+void PropertyInfoArea::ForEachContextIndexForPrefix(const char* prefix,
+                                                    void (*fn)(uint32_t context_index, void* cookie),
+                                                    void* cookie) const {
+  const char* remaining = prefix;
+  auto trie_node = root_node();
+  while (true) {
+    if (trie_node.context_index() != ~0u) fn(trie_node.context_index(), cookie);
+
+    // 前缀条目与剩余部分较短的那个长度内相同时才可能匹配
+    const uint32_t remaining_size = strlen(remaining);
+    for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
+      auto entry = trie_node.prefix(i);
+      uint32_t len = entry->namelen < remaining_size ? entry->namelen : remaining_size;
+      if (entry->context_index != ~0u && !strncmp(c_string(entry->name_offset), remaining, len)) {
+        fn(entry->context_index, cookie);
+      }
+    }
+
+    const char* sep = strchr(remaining, '.');
+    if (sep == nullptr) break;
+
+    // 精确匹配的名称不含'.'，在这里不可能匹配
+    TrieNode child_node;
+    if (!trie_node.FindChildForString(remaining, sep - remaining, &child_node)) {
+      return;
+    }
+    trie_node = child_node;
+    remaining = sep + 1;
+  }
+
+  const uint32_t remaining_size = strlen(remaining);
+  for (uint32_t i = 0; i < trie_node.num_exact_matches(); ++i) {
+    auto entry = trie_node.exact_match(i);
+    if (entry->context_index != ~0u && entry->namelen >= remaining_size &&
+        !strncmp(c_string(entry->name_offset), remaining, remaining_size)) {
+      fn(entry->context_index, cookie);
+    }
+  }
+  for (uint32_t i = 0; i < trie_node.num_child_nodes(); ++i) {
+    auto child_node = trie_node.child_node(i);
+    if (!strncmp(child_node.name(), remaining, remaining_size)) {
+      ForEachContextIndexInSubtree(child_node, fn, cookie);
+    }
+  }
+}
+
 // 加载默认路径的属性信息文件
 bool PropertyInfoAreaFile::LoadDefaultPath() {
   return LoadPath("/dev/__properties__/property_info");
@@ -243,8 +339,8 @@ bool PropertyInfoAreaFile::LoadPath(const char* filename) {
 
   auto mmap_size = fd_stat.st_size;
 
-  // 将文件映射到内存
-  void* map_result = mmap(nullptr, mmap_size, PROT_READ, MAP_SHARED, fd, 0);
+  // 将文件映射到内存，启用预取时同时填充页表
+  void* map_result = mmap(nullptr, mmap_size, PROT_READ, MAP_SHARED | kPropPrefetchMapFlags, fd, 0);
   if (map_result == MAP_FAILED) {
     close(fd);
     return false;
@@ -265,6 +361,34 @@ bool PropertyInfoAreaFile::LoadPath(const char* filename) {
   return true;
 }
 
+// 从内存中的序列化数据加载属性信息
+// data: 序列化数据
+// size: 数据大小
+bool PropertyInfoAreaFile::LoadData(const void* data, size_t size) {
+  if (size < sizeof(PropertyInfoAreaHeader)) {
+    return false;
+  }
+
+  // 复制到匿名映射中，Reset()可以像文件映射一样用munmap释放
+  void* map_result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map_result == MAP_FAILED) {
+    return false;
+  }
+  memcpy(map_result, data, size);
+  mprotect(map_result, size, PROT_READ);
+
+  // 验证属性信息区域的有效性
+  auto property_info_area = reinterpret_cast<PropertyInfoArea*>(map_result);
+  if (property_info_area->minimum_supported_version() > 1 || property_info_area->size() != size) {
+    munmap(map_result, size);
+    return false;
+  }
+
+  mmap_base_ = map_result;  // 保存映射基地址
+  mmap_size_ = size;        // 保存映射大小
+  return true;
+}
+
 // 重置PropertyInfoAreaFile，释放映射的内存
 void PropertyInfoAreaFile::Reset() {
   if (mmap_size_ > 0) {
@@ -0,0 +1,350 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "property_info_serializer/property_info_serializer.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <set>
+
+#include "property_info_parser/property_info_parser.h"
+
+namespace android {
+namespace properties {
+
+namespace {
+
+// Trie中的一个属性条目，上下文和类型指向TrieBuilder中去重后的字符串，nullptr表示没有
+struct BuilderEntry {
+  std::string name;
+  const std::string* context;
+  const std::string* type;
+};
+
+// 构建中的Trie节点，每个节点对应属性名中以'.'分隔的一段
+struct BuilderNode {
+  explicit BuilderNode(const std::string& name) : entry{name, nullptr, nullptr} {}
+
+  BuilderNode* FindOrAddChild(const std::string& name) {
+    for (auto& child : children) {
+      if (child.entry.name == name) return &child;
+    }
+    children.emplace_back(name);
+    return &children.back();
+  }
+
+  BuilderEntry entry;                       // 以'.'结尾的前缀匹配到此节点时使用的上下文
+  std::vector<BuilderNode> children;        // 子节点
+  std::vector<BuilderEntry> prefixes;       // 不以'.'结尾的前缀，名称中不含'.'
+  std::vector<BuilderEntry> exact_matches;  // 精确匹配，名称中不含'.'
+};
+
+class TrieBuilder {
+ public:
+  TrieBuilder(const std::string& default_context, const std::string& default_type)
+      : root_("root") {
+    root_.entry.context = StringPointer(&contexts_, default_context);
+    root_.entry.type = StringPointer(&types_, default_type);
+  }
+
+  // 添加一个条目，同名条目已经存在时保留先添加的那个
+  void Add(const PropertyInfoEntry& property_info) {
+    const std::string* context = StringPointer(&contexts_, property_info.context);
+    const std::string* type = StringPointer(&types_, property_info.type);
+
+    // 除最后一段外的每一段都对应一个节点
+    auto node = &root_;
+    const std::string& name = property_info.name;
+    size_t start = 0;
+    size_t sep;
+    while ((sep = name.find('.', start)) != std::string::npos) {
+      node = node->FindOrAddChild(name.substr(start, sep - start));
+      start = sep + 1;
+    }
+    std::string last = name.substr(start);
+
+    if (!property_info.exact_match && last.empty()) {
+      // 以'.'结尾的前缀保存在节点本身
+      if (!node->entry.context && !node->entry.type) {
+        node->entry.context = context;
+        node->entry.type = type;
+      }
+      return;
+    }
+
+    auto& entries = property_info.exact_match ? node->exact_matches : node->prefixes;
+    for (const auto& entry : entries) {
+      if (entry.name == last) return;
+    }
+    entries.push_back({last, context, type});
+  }
+
+  const BuilderNode& root() const { return root_; }
+  const std::set<std::string>& contexts() const { return contexts_; }
+  const std::set<std::string>& types() const { return types_; }
+
+ private:
+  // 空字符串表示没有，返回nullptr
+  static const std::string* StringPointer(std::set<std::string>* strings, const std::string& s) {
+    if (s.empty()) return nullptr;
+    return &*strings->insert(s).first;
+  }
+
+  BuilderNode root_;
+  std::set<std::string> contexts_;
+  std::set<std::string> types_;
+};
+
+// 按照PropertyInfoArea的布局把TrieBuilder序列化，所有结构都按4字节对齐
+class TrieSerializer {
+ public:
+  std::string Serialize(const TrieBuilder& builder) {
+    data_.clear();
+    uint32_t header_offset = Allocate(sizeof(PropertyInfoAreaHeader));
+
+    PropertyInfoAreaHeader header = {};
+    // 版本2只是在TrieNodeInternal后面增加了字段，版本1的读者仍然可以解析
+    header.current_version = 2;
+    header.minimum_supported_version = 1;
+    header.contexts_offset = WriteStrings(builder.contexts(), &contexts_);
+    header.types_offset = WriteStrings(builder.types(), &types_);
+    header.root_offset = WriteNode(builder.root());
+    header.size = data_.size();
+    Write(header_offset, header);
+    return data_;
+  }
+
+ private:
+  uint32_t Allocate(size_t size) {
+    data_.resize((data_.size() + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1));
+    uint32_t offset = data_.size();
+    data_.resize(offset + size);
+    return offset;
+  }
+
+  template <typename T>
+  void Write(uint32_t offset, const T& value) {
+    memcpy(&data_[offset], &value, sizeof(value));
+  }
+
+  uint32_t WriteString(const std::string& s) {
+    uint32_t offset = data_.size();
+    data_.append(s);
+    data_.push_back('\0');
+    return offset;
+  }
+
+  uint32_t WriteArray(const std::vector<uint32_t>& values) {
+    uint32_t offset = Allocate(values.size() * sizeof(uint32_t));
+    if (!values.empty()) memcpy(&data_[offset], values.data(), values.size() * sizeof(uint32_t));
+    return offset;
+  }
+
+  // 写入字符串数量以及每个字符串的偏移；std::set已经排好序，FindContextIndex()可以二分查找
+  uint32_t WriteStrings(const std::set<std::string>& strings,
+                        std::vector<const std::string*>* written) {
+    uint32_t offset = Allocate(sizeof(uint32_t) * (strings.size() + 1));
+    Write(offset, static_cast<uint32_t>(strings.size()));
+    uint32_t i = 0;
+    for (const auto& s : strings) {
+      Write(offset + sizeof(uint32_t) * ++i, WriteString(s));
+      written->push_back(&s);
+    }
+    return offset;
+  }
+
+  static uint32_t IndexOf(const std::vector<const std::string*>& written, const std::string* s) {
+    if (!s) return ~0u;
+    return std::find(written.begin(), written.end(), s) - written.begin();
+  }
+
+  uint32_t WriteEntry(const BuilderEntry& entry) {
+    PropertyEntry property_entry = {};
+    property_entry.name_offset = WriteString(entry.name);
+    property_entry.namelen = entry.name.size();
+    property_entry.context_index = IndexOf(contexts_, entry.context);
+    property_entry.type_index = IndexOf(types_, entry.type);
+    uint32_t offset = Allocate(sizeof(property_entry));
+    Write(offset, property_entry);
+    return offset;
+  }
+
+  uint32_t WriteEntries(const std::vector<BuilderEntry>& entries) {
+    std::vector<uint32_t> offsets;
+    for (const auto& entry : entries) offsets.push_back(WriteEntry(entry));
+    return WriteArray(offsets);
+  }
+
+  uint32_t WriteNode(const BuilderNode& node) {
+    TrieNodeInternal internal = {};
+    internal.property_entry = WriteEntry(node.entry);
+
+    // 子节点需要按名称排序，FindChildForString()二分查找它们
+    std::vector<const BuilderNode*> children;
+    for (const auto& child : node.children) children.push_back(&child);
+    std::sort(children.begin(), children.end(),
+              [](const auto* l, const auto* r) { return l->entry.name < r->entry.name; });
+    std::vector<uint32_t> child_offsets;
+    std::vector<uint32_t> child_lengths;
+    for (const auto* child : children) {
+      child_offsets.push_back(WriteNode(*child));
+      child_lengths.push_back(child->entry.name.size());
+    }
+    internal.num_child_nodes = child_offsets.size();
+    internal.child_nodes = WriteArray(child_offsets);
+    internal.child_lengths = WriteArray(child_lengths);
+
+    // CheckPrefixMatch()使用第一个匹配的前缀，所以较长的排在前面
+    std::vector<BuilderEntry> prefixes = node.prefixes;
+    std::stable_sort(prefixes.begin(), prefixes.end(), [](const auto& l, const auto& r) {
+      return l.name.size() > r.name.size();
+    });
+    std::vector<uint32_t> prefix_lengths;
+    for (const auto& prefix : prefixes) prefix_lengths.push_back(prefix.name.size());
+    internal.num_prefixes = prefixes.size();
+    internal.prefix_entries = WriteEntries(prefixes);
+    internal.prefix_lengths = WriteArray(prefix_lengths);
+
+    // 精确匹配按名称排序
+    std::vector<BuilderEntry> exact_matches = node.exact_matches;
+    std::sort(exact_matches.begin(), exact_matches.end(),
+              [](const auto& l, const auto& r) { return l.name < r.name; });
+    internal.num_exact_matches = exact_matches.size();
+    internal.exact_match_entries = WriteEntries(exact_matches);
+
+    uint32_t offset = Allocate(sizeof(internal));
+    Write(offset, internal);
+    return offset;
+  }
+
+  std::string data_;
+  std::vector<const std::string*> contexts_;  // 按写入顺序排列，下标即context_index
+  std::vector<const std::string*> types_;     // 按写入顺序排列，下标即type_index
+};
+
+// 读取一行中以空白分隔的前两个条目，与contexts_split.cpp中的read_spec_entries()行为一致
+int ReadSpecEntries(const char* line, std::string* first, std::string* second) {
+  std::string* entries[] = {first, second};
+  int items = 0;
+  while (isspace(*line)) line++;
+  if (*line == '#') return 0;  // 跳过注释行
+  while (items < 2 && *line != '\0') {
+    const char* start = line;
+    while (*line != '\0' && !isspace(*line)) line++;
+    entries[items++]->assign(start, line - start);
+    while (isspace(*line)) line++;
+  }
+  return items;
+}
+
+}  // namespace
+
+bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
+               const std::string& default_context, const std::string& default_type,
+               std::string* serialized_trie, std::string* error) {
+  TrieBuilder builder(default_context, default_type);
+  for (const auto& entry : property_info) {
+    if (entry.name.empty()) {
+      *error = "Empty property name";
+      return false;
+    }
+    builder.Add(entry);
+  }
+
+  *serialized_trie = TrieSerializer().Serialize(builder);
+  return true;
+}
+
+bool ParsePropertyContextsFile(const char* filename, std::vector<PropertyInfoEntry>* property_infos,
+                               std::string* default_context) {
+  FILE* file = fopen(filename, "re");
+  if (!file) {
+    return false;
+  }
+
+  char* buffer = nullptr;
+  size_t line_len;
+  std::string prop_prefix;
+  std::string context;
+
+  // 逐行读取配置文件
+  while (getline(&buffer, &line_len, file) > 0) {
+    if (ReadSpecEntries(buffer, &prop_prefix, &context) != 2) {
+      continue;  // 跳过空行、注释行以及没有上下文的行
+    }
+
+    // init使用ctl.*属性作为IPC机制，不会将它们写入属性文件
+    if (!strncmp(prop_prefix.c_str(), "ctl.", 4)) {
+      continue;
+    }
+
+    // ContextsSplit总是把新的通配符插到已有的通配符前面，所以最后一个生效
+    if (prop_prefix[0] == '*') {
+      *default_context = context;
+      continue;
+    }
+    property_infos->emplace_back(prop_prefix, context, "", false);
+  }
+
+  free(buffer);
+  fclose(file);
+  return true;
+}
+
+bool BuildTrieFromPropertyContexts(std::string* serialized_trie, std::string* error) {
+  std::vector<PropertyInfoEntry> property_infos;
+  std::string default_context;
+
+  // 文件的查找顺序与ContextsSplit::InitializeProperties()相同
+  if (!ParsePropertyContextsFile("/property_contexts", &property_infos, &default_context)) {
+    if (access("/system/etc/selinux/plat_property_contexts", R_OK) != -1) {
+      if (!ParsePropertyContextsFile("/system/etc/selinux/plat_property_contexts", &property_infos,
+                                     &default_context)) {
+        *error = "Could not read /system/etc/selinux/plat_property_contexts";
+        return false;
+      }
+      if (access("/vendor/etc/selinux/vendor_property_contexts", R_OK) != -1) {
+        ParsePropertyContextsFile("/vendor/etc/selinux/vendor_property_contexts", &property_infos,
+                                  &default_context);
+      } else {
+        ParsePropertyContextsFile("/vendor/etc/selinux/nonplat_property_contexts",
+                                  &property_infos, &default_context);
+      }
+    } else {
+      if (!ParsePropertyContextsFile("/plat_property_contexts", &property_infos,
+                                     &default_context)) {
+        *error = "Could not read /plat_property_contexts";
+        return false;
+      }
+      if (access("/vendor_property_contexts", R_OK) != -1) {
+        ParsePropertyContextsFile("/vendor_property_contexts", &property_infos, &default_context);
+      } else {
+        ParsePropertyContextsFile("/nonplat_property_contexts", &property_infos,
+                                  &default_context);
+      }
+    }
+  }
+
+  return BuildTrie(property_infos, default_context, "", serialized_trie, error);
+}
+
+}  // namespace properties
+}  // namespace android
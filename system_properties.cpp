@@ -34,18 +34,25 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <new>
 
 #include <async_safe/log.h>
 
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <api/_system_properties.h>
+
 #include "private/ErrnoRestorer.h"
 #include "private/bionic_futex.h"
 
 #include "system_properties/context_node.h"
 #include "system_properties/prop_area.h"
+#include "system_properties/prop_hash.h"
 #include "system_properties/prop_info.h"
+#include "system_properties/prop_ro_table.h"
+#include "system_properties/prop_stats.h"
 
 // 检查序列号是否脏（用于同步）
 // 检查序列号是否脏（用于同步）
@@ -53,6 +60,30 @@
 // 从序列号中获取值长度
 #define SERIAL_VALUE_LEN(serial) ((serial) >> 24)
 
+#if defined(SYSTEM_PROPERTIES_STATS)
+prop_stats_shard g_prop_stats[kPropStatsShards];
+#endif
+
+#if !defined(SYSTEM_PROPERTIES_NO_FIND_CACHE)
+namespace {
+
+// 每个线程私有的名称到prop_info的查找缓存，同时缓存未找到的结果
+// 条目以全局序列号为键：任何Add/Update/Delete都会增加全局序列号，使所有条目失效，
+// 所以命中时只需要一次原子加载、一次哈希探测和一次名称比较
+struct FindCacheEntry {
+  uint32_t area_serial;
+  uint32_t generation;
+  const prop_info* pi;
+  uint32_t hash;
+  char name[44];  // 更长的名称不缓存
+};
+
+constexpr size_t kFindCacheSize = 32;  // 必须是2的幂
+thread_local FindCacheEntry g_find_cache[kFindCacheSize];
+
+}  // namespace
+#endif
+
 // 检查路径是否为目录
 static bool is_dir(const char* pathname) {
   struct stat info;
@@ -62,6 +93,16 @@ static bool is_dir(const char* pathname) {
   return S_ISDIR(info.st_mode);  // 检查是否为目录类型
 }
 
+// 按索引顺序计算所有上下文名称的哈希值，变更日志中的上下文索引只对哈希值相同的Contexts有意义
+static uint32_t hash_contexts(Contexts* contexts) {
+  uint32_t hash = 0;
+  const char* context;
+  for (size_t i = 0; (context = contexts->GetContextForIndex(i)) != nullptr; ++i) {
+    hash = hash * 31 + prop_name_hash(context, strlen(context));
+  }
+  return hash != 0 ? hash : 1;  // 0表示写入者没有记录
+}
+
 // 初始化系统属性
 bool SystemProperties::Init(const char* filename) {
   // 这个函数从__libc_init_common调用，应该保持errno为0 (http://b/37248982)
@@ -69,6 +110,7 @@ bool SystemProperties::Init(const char* filename) {
 
   if (initialized_) {  // 如果已经初始化，重置访问权限
     contexts_->ResetAccess();
+    ++find_cache_generation_;  // 之前缓存的prop_info可能位于已取消映射的区域中
     return true;
   }
 
@@ -78,13 +120,10 @@ bool SystemProperties::Init(const char* filename) {
   strcpy(property_filename_, filename);  // 保存属性文件名
 
   if (is_dir(property_filename_)) {  // 如果是目录
-    // 根据property_info文件的存在选择不同的上下文实现
-    if (access("/dev/__properties__/property_info", R_OK) == 0) {
-      contexts_ = new (contexts_data_) ContextsSerialized();  // 使用序列化上下文
-      if (!contexts_->Initialize(false, property_filename_, nullptr)) {
-        return false;
-      }
-    } else {
+    // 优先使用序列化上下文：init在没有property_info文件时把文本格式的property_contexts
+    // 编译成这个文件。读取者不编译，没有这个文件时使用分割上下文
+    contexts_ = new (contexts_data_) ContextsSerialized();
+    if (!contexts_->Initialize(false, property_filename_, nullptr)) {
       contexts_ = new (contexts_data_) ContextsSplit();  // 使用分割上下文
       if (!contexts_->Initialize(false, property_filename_, nullptr)) {
         return false;
@@ -97,6 +136,7 @@ bool SystemProperties::Init(const char* filename) {
       return false;
     }
   }
+  contexts_hash_ = hash_contexts(contexts_);
   initialized_ = true;  // 标记为已初始化
   return true;
 }
@@ -112,6 +152,10 @@ bool SystemProperties::AreaInit(const char* filename, bool* fsetxattr_failed) {
   if (!contexts_->Initialize(true, property_filename_, fsetxattr_failed)) {  // 初始化为读写模式
     return false;
   }
+  // 分配失败时没有变更日志，读取器会回退到遍历所有属性
+  contexts_hash_ = hash_contexts(contexts_);
+  contexts_->GetSerialPropArea()->set_contexts_hash(contexts_hash_);
+  contexts_->GetSerialPropArea()->init_changelog();
   initialized_ = true;  // 标记为已初始化
   return true;
 }
@@ -131,24 +175,115 @@ uint32_t SystemProperties::AreaSerial() {
   return atomic_load_explicit(pa->serial(), memory_order_acquire);
 }
 
+// 检查属性是否为只读
+static bool is_read_only(const char* name) {
+  return strncmp(name, "ro.", 3) == 0;  // 以"ro."开头的属性为只读
+}
+
+// 检查值的长度：可变属性的长值由读取器复制到栈上的缓冲区，所以有上限
+static bool is_valid_value_length(const char* name, unsigned int valuelen) {
+  return valuelen < prop_info::kMutableLongValueMax || is_read_only(name);
+}
+
+// 只读属性是否已经密封
+bool SystemProperties::Sealed() {
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  return serial_pa != nullptr &&
+         (atomic_load_explicit(serial_pa->serial_flags(), memory_order_acquire) &
+          prop_area::kSerialFlagReadOnlySealed) != 0;
+}
+
 // 查找属性信息
 const prop_info* SystemProperties::Find(const char* name) {
   if (!initialized_) {  // 检查是否已初始化
     return nullptr;
   }
+  PROP_STATS_ADD(kPropStatFind, 1);
+
+#if !defined(SYSTEM_PROPERTIES_NO_FIND_CACHE)
+  FindCacheEntry* entry = nullptr;
+  uint32_t area_serial = 0;
+  uint32_t hash = 0;
+  const size_t namelen = strlen(name);
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa != nullptr && namelen < sizeof(entry->name)) {
+    // 必须在查找之前读取序列号，这样查找期间发生的修改会使新条目立即失效
+    area_serial = atomic_load_explicit(serial_pa->serial(), memory_order_acquire);
+    hash = prop_name_hash(name, namelen);
+    entry = &g_find_cache[hash & (kFindCacheSize - 1)];
+    if (entry->area_serial == area_serial && entry->generation == find_cache_generation_ &&
+        entry->hash == hash && memcmp(entry->name, name, namelen + 1) == 0) {
+      PROP_STATS_ADD(kPropStatFindCacheHit, 1);
+      if (entry->pi == nullptr) PROP_STATS_ADD(kPropStatFindMiss, 1);
+      return entry->pi;  // 缓存命中
+    }
+  }
+#endif
 
   prop_area* pa = contexts_->GetPropAreaForName(name);  // 根据属性名获取属性区域
   if (!pa) {
-    async_safe_format_log(ANDROID_LOG_WARN, "libc", "Access denied finding property \"%s\"", name);
+    // 不缓存访问被拒绝的结果，每次访问都应该产生selinux审计
+    async_safe_format_log(ANDROID_LOG_WARN, "libc", "Access denied finding property \"%s\"",
+                          name);
+    PROP_STATS_ADD(kPropStatFindMiss, 1);
     return nullptr;
   }
-
-  return pa->find(name);  // 在属性区域中查找属性
+  const prop_info* pi = nullptr;
+  if (is_read_only(name)) {  // 已密封的只读属性不需要遍历区域的trie
+    pi = pa->find_sealed(name, prop_name_hash(name, strlen(name)));
+  }
+  if (pi == nullptr) {
+    pi = pa->find(name);  // 在属性区域中查找属性
+  }
+#if !defined(SYSTEM_PROPERTIES_NO_FIND_CACHE)
+  if (entry != nullptr) {  // 记录查找结果，包括未找到的情况
+    entry->area_serial = area_serial;
+    entry->generation = find_cache_generation_;
+    entry->pi = pi;
+    entry->hash = hash;
+    memcpy(entry->name, name, namelen + 1);
+  }
+#endif
+  if (pi == nullptr) PROP_STATS_ADD(kPropStatFindMiss, 1);
+  return pi;
 }
 
-// 检查属性是否为只读
-static bool is_read_only(const char* name) {
-  return strncmp(name, "ro.", 3) == 0;  // 以"ro."开头的属性为只读
+// 查找预先计算好的属性名，固定上下文索引后不再需要在property_info中查找上下文
+// context_index: 上下文索引，为~0u时先解析并写回
+const prop_info* SystemProperties::Find(const prop_name& name, uint32_t* context_index) {
+  if (!initialized_) {  // 检查是否已初始化
+    return nullptr;
+  }
+  PROP_STATS_ADD(kPropStatFind, 1);
+
+  if (*context_index == ~0u) {
+    size_t index;
+    if (!contexts_->GetPropAreaIndexForName(name.name, &index)) {
+      async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not find context for property \"%s\"",
+                            name.name);
+      PROP_STATS_ADD(kPropStatFindMiss, 1);
+      return nullptr;
+    }
+    *context_index = index;
+  }
+
+  prop_area* pa = nullptr;
+  if (!contexts_->GetPropAreaForIndex(*context_index, &pa) || pa == nullptr) {
+    async_safe_format_log(ANDROID_LOG_WARN, "libc", "Access denied finding property \"%s\"",
+                          name.name);
+    PROP_STATS_ADD(kPropStatFindMiss, 1);
+    return nullptr;
+  }
+
+  const prop_info* pi = nullptr;
+  if (is_read_only(name.name)) {  // 已密封的只读属性不需要遍历区域的trie
+    pi = pa->find_sealed(name.name, name.hash);
+  }
+  if (pi == nullptr) {
+    pi = pa->find(name);
+  }
+  if (pi == nullptr) PROP_STATS_ADD(kPropStatFindMiss, 1);
+  return pi;
 }
 
 // 读取可变属性值
@@ -157,21 +292,28 @@ uint32_t SystemProperties::ReadMutablePropertyValue(const prop_info* pi, char* v
   uint32_t new_serial = load_const_atomic(&pi->serial, memory_order_acquire);
   uint32_t serial;
   unsigned int len;
+  PROP_STATS_ADD(kPropStatRead, 1);
   for (;;) {  // 循环直到读取到一致的值
     serial = new_serial;
     len = SERIAL_VALUE_LEN(serial);  // 从序列号中提取值长度
+    // 序列号来自共享内存，长度不能超出缓冲区
+    if (__predict_false(len >= PROP_VALUE_MAX)) len = PROP_VALUE_MAX - 1;
     if (__predict_false(SERIAL_DIRTY(serial))) {  // 如果序列号标记为脏
       // 参见prop_area构造函数中的注释
-      prop_area* pa = contexts_->GetPropAreaForName(pi->name);
-      memcpy(value, pa->dirty_backup_area(), len + 1);  // 从备份区域复制
+      // 按地址找到所在区域，写入者正在更新时不需要再查找属性名
+      prop_area* pa = contexts_->GetPropAreaForPropInfo(pi);
+      memcpy(value, pa->dirty_backup_area(), len);  // 从备份区域复制
+      PROP_STATS_ADD(kPropStatReadBackup, 1);
     } else {
-      memcpy(value, pi->value, len + 1);  // 从主区域复制
+      memcpy(value, pi->value, len);  // 从主区域复制
     }
+    value[len] = '\0';
     atomic_thread_fence(memory_order_acquire);  // 内存栅栏
     new_serial = load_const_atomic(&pi->serial, memory_order_relaxed);
     if (__predict_true(serial == new_serial)) {  // 如果序列号没有变化
       break;
     }
+    PROP_STATS_ADD(kPropStatReadRetry, 1);
     // 我们在这里需要另一个栅栏，因为我们想确保循环下一次迭代中的memcpy
     // 发生在上面new_serial的加载之后。我们可以通过让new_serial的load_const_atomic
     // 使用memory_order_acquire而不是memory_order_relaxed来获得这个保证，
@@ -201,10 +343,39 @@ int SystemProperties::Read(const prop_info* pi, char* name, char* value) {
         " __system_property_get()/__system_property_read(); use"
         " __system_property_read_callback() instead.",
         pi->name, strlen(pi->long_value()));
+  } else if (serial & prop_info::kLongFlag) {  // 可变长值的块可能已被释放，不能计算其长度
+    async_safe_format_log(
+        ANDROID_LOG_ERROR, "libc",
+        "The property \"%s\" has a value that is too large for"
+        " __system_property_get()/__system_property_read(); use"
+        " __system_property_read_callback() instead.",
+        pi->name);
   }
   return SERIAL_VALUE_LEN(serial);  // 返回值长度
 }
 
+// 复制可变的长属性值并交给回调。单独成为不内联的函数，4KB的缓冲区只占用读取长值时的栈，
+// 而不是每次调用ReadCallback()的栈
+static __attribute__((noinline)) void read_long_value_callback(
+    prop_area* pa, const prop_info* pi, uint32_t serial,
+    void (*callback)(void* cookie, const char* name, const char* value, uint32_t serial),
+    void* cookie) {
+  char long_value_buf[prop_info::kMutableLongValueMax];
+  PROP_STATS_ADD(kPropStatRead, 1);
+  for (;;) {
+    pa->read_long_value(pi, long_value_buf);
+    atomic_thread_fence(memory_order_acquire);
+    const uint32_t new_serial = load_const_atomic(&pi->serial, memory_order_relaxed);
+    if (__predict_true(serial == new_serial)) {
+      callback(cookie, pi->name, long_value_buf, serial);
+      return;
+    }
+    PROP_STATS_ADD(kPropStatReadRetry, 1);
+    serial = new_serial;
+    atomic_thread_fence(memory_order_acquire);
+  }
+}
+
 // 通过回调读取属性
 void SystemProperties::ReadCallback(const prop_info* pi,
                                     void (*callback)(void* cookie, const char* name,
@@ -222,9 +393,24 @@ void SystemProperties::ReadCallback(const prop_info* pi,
     return;
   }
 
-  char value_buf[PROP_VALUE_MAX];  // 为可变属性创建缓冲区
-  uint32_t serial = ReadMutablePropertyValue(pi, value_buf);
-  callback(cookie, pi->name, value_buf, serial);
+  // 可变的长属性每次更新都换用新的值块，旧块在新序列号发布后立即被释放，
+  // 所以先把值复制出来，确认序列号没有变化后才交给回调
+  uint32_t serial = load_const_atomic(&pi->serial, memory_order_acquire);
+  if (!(serial & prop_info::kLongFlag)) {
+    char value_buf[PROP_VALUE_MAX];  // 为可变属性创建缓冲区
+    serial = ReadMutablePropertyValue(pi, value_buf);
+    if (__predict_true(!(serial & prop_info::kLongFlag))) {
+      callback(cookie, pi->name, value_buf, serial);
+      return;
+    }
+    // 读取期间被更新为长值，value_buf中只有错误信息
+  }
+  prop_area* pa = contexts_->GetPropAreaForPropInfo(pi);
+  if (__predict_false(pa == nullptr)) {
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not find area for \"%s\"", pi->name);
+    return;
+  }
+  read_long_value_callback(pa, pi, serial, callback, cookie);
 }
 
 // 获取属性值
@@ -239,12 +425,99 @@ int SystemProperties::Get(const char* name, char* value) {
   }
 }
 
-// 更新属性值
-int SystemProperties::Update(prop_info* pi, const char* value, unsigned int len) {
-  if (len >= PROP_VALUE_MAX) {  // 检查值长度
+// 批量获取属性值
+// 每批名称先解析所属属性区域，再按(区域, 名称)排序，同一区域内的名称一次性查找，
+// 这样共享前缀的trie节点只遍历一次，并且在切换到下一个区域之前完成该区域的所有查找
+int SystemProperties::GetMany(const char* const names[], char* const values[], size_t count) {
+  if (!initialized_) {  // 检查是否已初始化
     return -1;
   }
 
+  // 不使用malloc (b/31659220)，所以每次在栈上处理固定数量的名称
+  constexpr size_t kBatchSize = 32;
+  int found = 0;
+  for (size_t base = 0; base < count; base += kBatchSize) {
+    const size_t n = MIN(count - base, kBatchSize);
+    prop_area* areas[kBatchSize];
+    size_t order[kBatchSize];
+
+    for (size_t i = 0; i < n; ++i) {
+      areas[i] = contexts_->GetPropAreaForName(names[base + i]);  // 根据属性名获取属性区域
+      if (!areas[i]) {
+        async_safe_format_log(ANDROID_LOG_WARN, "libc", "Access denied finding property \"%s\"",
+                              names[base + i]);
+      }
+      // 插入排序：先按属性区域分组，再按名称排序，使共享前缀的名称相邻
+      size_t j = i;
+      while (j > 0 && (areas[order[j - 1]] > areas[i] ||
+                       (areas[order[j - 1]] == areas[i] &&
+                        strcmp(names[base + order[j - 1]], names[base + i]) > 0))) {
+        order[j] = order[j - 1];
+        --j;
+      }
+      order[j] = i;
+    }
+
+    for (size_t run = 0; run < n;) {
+      prop_area* pa = areas[order[run]];
+      size_t run_end = run;
+      const char* run_names[kBatchSize];
+      while (run_end < n && areas[order[run_end]] == pa) {
+        run_names[run_end - run] = names[base + order[run_end]];
+        ++run_end;
+      }
+
+      const prop_info* results[kBatchSize];
+      if (pa) {
+        pa->find_many(run_names, run_end - run, results);  // 在同一属性区域中批量查找
+      }
+
+      for (size_t i = run; i < run_end; ++i) {
+        const prop_info* pi = pa ? results[i - run] : nullptr;
+        char* value = values[base + order[i]];
+        if (pi != nullptr) {  // 如果找到属性
+          Read(pi, nullptr, value);  // 读取属性值
+          ++found;
+        } else {
+          value[0] = 0;  // 属性不存在，设置为空字符串
+        }
+      }
+      run = run_end;
+    }
+  }
+  return found;  // 返回找到的属性数量
+}
+
+// 写入者修改区域期间在序列区域设置kSerialFlagWriting，Snapshot()看到它时重试
+// 嵌套时只有最外层清除标志位，清除发生在序列号增加之后
+class SerialWriteScope {
+ public:
+  explicit SerialWriteScope(prop_area* serial_pa) : flags_(serial_pa->serial_flags()) {
+    const uint32_t flags = atomic_load_explicit(flags_, memory_order_relaxed);
+    nested_ = (flags & prop_area::kSerialFlagWriting) != 0;
+    if (!nested_) {
+      atomic_store_explicit(flags_, flags | prop_area::kSerialFlagWriting, memory_order_relaxed);
+      atomic_thread_fence(memory_order_release);  // 标志位必须先于任何修改可见
+    }
+  }
+  ~SerialWriteScope() {
+    if (!nested_) {
+      atomic_store_explicit(flags_,
+                            atomic_load_explicit(flags_, memory_order_relaxed) &
+                                ~prop_area::kSerialFlagWriting,
+                            memory_order_release);
+    }
+  }
+
+ private:
+  atomic_uint_least32_t* flags_;
+  bool nested_;
+
+  BIONIC_DISALLOW_COPY_AND_ASSIGN(SerialWriteScope);
+};
+
+// 更新属性值
+int SystemProperties::Update(prop_info* pi, const char* value, unsigned int len) {
   if (!initialized_) {  // 检查是否已初始化
     return -1;
   }
@@ -257,7 +530,7 @@ int SystemProperties::Update(prop_info* pi, const char* value, unsigned int len)
   if (!serial_pa) {
     return -1;
   }
-  prop_area* pa = contexts_->GetPropAreaForName(pi->name);  // 获取属性所在区域
+  prop_area* pa = contexts_->GetPropAreaForPropInfo(pi);  // 获取属性所在区域
   if (__predict_false(!pa)) {
     async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not find area for \"%s\"", pi->name);
     return -1;
@@ -266,23 +539,64 @@ int SystemProperties::Update(prop_info* pi, const char* value, unsigned int len)
   uint32_t serial = atomic_load_explicit(&pi->serial, memory_order_relaxed);
   unsigned int old_len = SERIAL_VALUE_LEN(serial);  // 获取旧值长度
 
-  // 与读取器的约定是，每当设置脏位时，预脏值的未损坏副本
-  // 在脏备份区域中可用。栅栏确保我们在允许读取器看到
-  // 脏序列之前发布我们的脏区域更新
-  memcpy(pa->dirty_backup_area(), pi->value, old_len + 1);  // 备份旧值
-  atomic_thread_fence(memory_order_release);
-  serial |= 1;  // 设置脏位
-  atomic_store_explicit(&pi->serial, serial, memory_order_relaxed);
-  strlcpy(pi->value, value, len + 1);  // 复制新值
-  // 现在主值属性区域是最新的。让读取器知道他们应该
-  // 查看属性值而不是备份区域
-  atomic_thread_fence(memory_order_release);
-  atomic_store_explicit(&pi->serial, (len << 24) | ((serial + 1) & 0xffffff), memory_order_relaxed);
+  // 只读属性的长值被读取器原地使用，不能替换
+  const bool is_long = len >= PROP_VALUE_MAX || (serial & prop_info::kLongFlag);
+  if (len >= prop_info::kMutableLongValueMax || (is_long && is_read_only(pi->name))) {
+    return -1;
+  }
+
+  SerialWriteScope write_scope(serial_pa);
+
+  if (is_long) {
+    // 长属性之后的值即使变短也放在单独的值块中，读取器不必区分两种布局
+    uint32_t long_offset = pa->new_long_value(pi, value, len);
+    while (long_offset == 0 && contexts_->GrowPropAreaForName(pi->name)) {  // 空间不足时扩展区域
+      long_offset = pa->new_long_value(pi, value, len);
+    }
+    if (long_offset == 0) {
+      return -1;
+    }
+
+    if (serial & prop_info::kLongFlag) {
+      // 新值块在发布前已经写好，不需要脏位。读取器复制值之后检查序列号，
+      // 栅栏保证读到旧块被重用后内容的读取器也能看到新序列号
+      const char* old_value = pi->long_value();
+      pi->set_long_value(long_offset);
+      atomic_store_explicit(&pi->serial, prop_info::next_serial(serial | 1, old_len, true),
+                            memory_order_release);
+      atomic_thread_fence(memory_order_release);
+      pa->free_long_value(old_value);
+    } else {
+      // 短值变为长值时pi->value被替换为错误信息，按照脏备份区域的约定进行
+      memcpy(pa->dirty_backup_area(), pi->value, old_len + 1);  // 备份旧值
+      atomic_thread_fence(memory_order_release);
+      serial |= 1;  // 设置脏位
+      atomic_store_explicit(&pi->serial, serial, memory_order_relaxed);
+      const uint32_t error_len = pi->make_long(long_offset);
+      atomic_thread_fence(memory_order_release);
+      atomic_store_explicit(&pi->serial, prop_info::next_serial(serial, error_len, true),
+                            memory_order_relaxed);
+    }
+  } else {
+    // 与读取器的约定是，每当设置脏位时，预脏值的未损坏副本
+    // 在脏备份区域中可用。栅栏确保我们在允许读取器看到
+    // 脏序列之前发布我们的脏区域更新
+    memcpy(pa->dirty_backup_area(), pi->value, old_len + 1);  // 备份旧值
+    atomic_thread_fence(memory_order_release);
+    serial |= 1;  // 设置脏位
+    atomic_store_explicit(&pi->serial, serial, memory_order_relaxed);
+    strlcpy(pi->value, value, len + 1);  // 复制新值
+    // 现在主值属性区域是最新的。让读取器知道他们应该
+    // 查看属性值而不是备份区域
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&pi->serial, prop_info::next_serial(serial, len, false),
+                          memory_order_relaxed);
+  }
   __futex_wake(&pi->serial, INT32_MAX);  // 通过副作用进行栅栏
-  atomic_store_explicit(serial_pa->serial(),
-                        atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) + 1,
-                        memory_order_release);
-  __futex_wake(serial_pa->serial(), INT32_MAX);  // 唤醒等待者
+  PROP_STATS_ADD(kPropStatUpdate, 1);
+  PROP_STATS_ADD(kPropStatFutexWake, 1);
+  LogChange(pa, serial_pa, pi->name, pi);
+  NotifySerials(pa, serial_pa);
 
   return 0;
 }
@@ -290,10 +604,6 @@ int SystemProperties::Update(prop_info* pi, const char* value, unsigned int len)
 // 添加新属性
 int SystemProperties::Add(const char* name, unsigned int namelen, const char* value,
                           unsigned int valuelen) {
-  if (valuelen >= PROP_VALUE_MAX && !is_read_only(name)) {  // 检查非只读属性的值长度
-    return -1;
-  }
-
   if (namelen < 1) {  // 检查属性名长度
     return -1;
   }
@@ -311,23 +621,152 @@ int SystemProperties::Add(const char* name, unsigned int namelen, const char* va
     return -1;
   }
 
+  if (!is_valid_value_length(name, valuelen)) {  // 检查可变属性的值长度
+    return -1;
+  }
+
+  // 先拒绝无效的名称，这样下面添加失败只能是因为区域已满，只有这时才扩展区域
+  if (!prop_area::is_valid_name(name)) {
+    return -1;
+  }
+
   prop_area* pa = contexts_->GetPropAreaForName(name);  // 获取属性所在区域
   if (!pa) {
     async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Access denied adding property \"%s\"", name);
     return -1;
   }
 
+  SerialWriteScope write_scope(serial_pa);
   bool ret = pa->add(name, namelen, value, valuelen);  // 添加属性到区域
+  while (!ret && contexts_->GrowPropAreaForName(name)) {  // 空间不足时扩展区域后重试
+    ret = pa->add(name, namelen, value, valuelen);
+  }
   if (!ret) {
     return -1;
   }
 
+  LogChange(pa, serial_pa, name, pa->find(name));
+  NotifySerials(pa, serial_pa);
+  return 0;
+}
+
+// 批量添加的排序顺序：上下文索引、名称、原来的位置（同名时第一项生效）
+static int compare_bulk_entries(const void* lhs, const void* rhs) {
+  const prop_bulk_entry* a = static_cast<const prop_bulk_entry*>(lhs);
+  const prop_bulk_entry* b = static_cast<const prop_bulk_entry*>(rhs);
+  if (a->__context_index != b->__context_index) {
+    return a->__context_index < b->__context_index ? -1 : 1;
+  }
+  const int ret = strcmp(a->name, b->name);
+  if (ret != 0) {
+    return ret;
+  }
+  return a->__position < b->__position ? -1 : (a->__position > b->__position ? 1 : 0);
+}
+
+// 批量添加属性
+// 按上下文和名称排序后，每个区域的属性一次性按名称顺序添加，共享前缀的trie节点只遍历一次，
+// 全部在一个批量更新中完成，每个区域和全局序列号只增加一次
+int SystemProperties::AddMany(prop_bulk_entry* entries, size_t count) {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  if (!contexts_->rw_) {  // 检查是否有写权限
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();  // 获取序列属性区域
+  if (serial_pa == nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    size_t index;
+    entries[i].result = -1;
+    entries[i].__context_index =
+        contexts_->GetPropAreaIndexForName(entries[i].name, &index) ? index : ~0u;
+    entries[i].__position = i;
+  }
+  // 不使用malloc (b/31659220)，直接在调用者的数组中排序
+  qsort(entries, count, sizeof(*entries), compare_bulk_entries);
+
+  SerialWriteScope write_scope(serial_pa);
+  if (BatchBegin() != 0) {
+    return -1;
+  }
+  prop_changelog* changelog = serial_pa->changelog();
+  // 批量更新期间全局序列号不变，提交时才增加一次，与LogChange()相同
+  const uint32_t serial = atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) + 1;
+  int ret = 0;
+  for (size_t run = 0; run < count;) {
+    const uint32_t context_index = entries[run].__context_index;
+    size_t run_end = run + 1;
+    while (run_end < count && entries[run_end].__context_index == context_index) {
+      ++run_end;
+    }
+
+    prop_area* pa = nullptr;
+    if (context_index == ~0u || !contexts_->GetPropAreaForIndex(context_index, &pa) || !pa) {
+      async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Access denied adding property \"%s\"",
+                            entries[run].name);
+      ret = -1;
+      run = run_end;
+      continue;
+    }
+
+    bool changed = false;
+    prop_area_bulk bulk;
+    pa->bulk_begin(&bulk);
+    for (size_t i = run; i < run_end; ++i) {
+      prop_bulk_entry& entry = entries[i];
+      const unsigned int namelen = strlen(entry.name);
+      const unsigned int valuelen = strlen(entry.value);
+      // 与Add()相同的检查，名称有效时bulk_add()失败只能是因为区域已满
+      if (namelen < 1 || !is_valid_value_length(entry.name, valuelen) ||
+          !prop_area::is_valid_name(entry.name)) {
+        ret = -1;
+        continue;
+      }
+
+      const prop_info* pi = pa->bulk_add(&bulk, entry.name, namelen, entry.value, valuelen);
+      while (pi == nullptr && contexts_->GrowPropAreaForName(entry.name)) {  // 空间不足时扩展区域
+        pi = pa->bulk_add(&bulk, entry.name, namelen, entry.value, valuelen);
+      }
+      if (pi == nullptr) {
+        ret = -1;
+        continue;
+      }
+
+      entry.result = 0;
+      changed = true;
+      if (changelog != nullptr) {  // 上下文索引已知，不需要像LogChange()那样再查找
+        changelog->append(serial, context_index, pa->offset_of(pi));
+      }
+    }
+    bool ended = pa->bulk_end(&bulk);  // 排序数组同样可能需要扩展区域
+    while (!ended && contexts_->GrowPropAreaForName(entries[run].name)) {
+      ended = pa->bulk_end(&bulk);
+    }
+    if (changed) {
+      NotifySerials(pa, serial_pa);  // 在批量中只是记录区域
+    }
+    run = run_end;
+  }
+
+  if (BatchCommit() != 0) {
+    return -1;
+  }
+  return ret;
+}
+
+// 增加区域的序列号并唤醒等待者
+static void bump_serial(prop_area* pa) {
   // 只有一个修改器，但我们想确保更新对等待更新的读取器可见
-  atomic_store_explicit(serial_pa->serial(),
-                        atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) + 1,
+  atomic_store_explicit(pa->serial(), atomic_load_explicit(pa->serial(), memory_order_relaxed) + 1,
                         memory_order_release);
-  __futex_wake(serial_pa->serial(), INT32_MAX);  // 唤醒等待者
-  return 0;
+  __futex_wake(pa->serial(), INT32_MAX);  // 唤醒等待者
+  PROP_STATS_ADD(kPropStatFutexWake, 1);
 }
 
 // 删除属性
@@ -345,6 +784,12 @@ int SystemProperties::Delete(const char *name, bool prune) {
     return -1;
   }
 
+  if (is_read_only(name) && Sealed()) {  // 密封表中的prop_info不能被释放
+    async_safe_format_log(ANDROID_LOG_ERROR, "libc",
+                          "Can't delete property \"%s\" after ro.* properties were sealed", name);
+    return -1;
+  }
+
   prop_area* pa = contexts_->GetPropAreaForName(name);  // 获取属性所在区域
   if (!pa) {
     async_safe_format_log(ANDROID_LOG_ERROR, "libc",
@@ -352,19 +797,179 @@ int SystemProperties::Delete(const char *name, bool prune) {
     return -1;
   }
 
+  SerialWriteScope write_scope(serial_pa);
   bool ret = pa->remove(name, prune);  // 从区域中删除属性
   if (!ret) {
     return -1;
   }
 
-  // 只有一个修改器，但我们想确保更新对等待更新的读取器可见
-  atomic_store_explicit(serial_pa->serial(),
-                        atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) + 1,
+  LogChange(pa, serial_pa, name, nullptr);
+  NotifySerials(pa, serial_pa);
+  if (batch_depth_ != 0) {
+    // 其它线程的Find()缓存只在全局序列号变化时失效，不能等到提交时才让它们忘记被删除的属性
+    bump_serial(serial_pa);
+  }
+  return 0;
+}
+
+// 把每个区域中现有的只读属性密封到该区域的密封表中，之后的只读属性查找先查这个表
+int SystemProperties::SealReadOnly() {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  if (!contexts_->rw_) {  // 检查是否有写权限
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr || Sealed()) {  // 只能密封一次
+    return -1;
+  }
+
+  // 无法密封的区域仍然按普通方式查找，但其它区域的表已经引用了它们的prop_info，标记总要设置
+  int result = 0;
+  prop_area* pa;
+  for (size_t i = 0; contexts_->GetPropAreaForIndex(i, &pa); ++i) {
+    if (pa == nullptr) continue;
+    const prop_info* full;
+    bool sealed = prop_ro_table::seal(pa, &full);
+    while (!sealed && full != nullptr && contexts_->GrowPropAreaForName(full->name)) {
+      sealed = prop_ro_table::seal(pa, &full);  // 空间不足时扩展区域后重试
+    }
+    if (!sealed) {
+      async_safe_format_log(ANDROID_LOG_ERROR, "libc",
+                            "Could not seal the ro.* properties of context %zu", i);
+      result = -1;
+    }
+  }
+
+  // 从此不能再删除只读属性，密封表中的偏移量一直有效
+  atomic_store_explicit(serial_pa->serial_flags(),
+                        atomic_load_explicit(serial_pa->serial_flags(), memory_order_relaxed) |
+                            prop_area::kSerialFlagReadOnlySealed,
                         memory_order_release);
-  __futex_wake(serial_pa->serial(), INT32_MAX);  // 唤醒等待者
+  return result;
+}
+
+// 在变更日志中记录一次修改，pi为nullptr表示属性被删除
+// 记录的是这次修改发布时的全局序列号，必须在NotifySerials()之前调用，被唤醒的读取器才能看到它
+void SystemProperties::LogChange(prop_area* pa, prop_area* serial_pa, const char* name,
+                                 const prop_info* pi) {
+  prop_changelog* changelog = serial_pa->changelog();
+  if (changelog == nullptr) {
+    return;
+  }
+
+  // 批量更新期间全局序列号不变，提交时才增加一次，所以这里同样是当前值加一
+  const uint32_t serial = atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) + 1;
+  size_t index;
+  if (pi == nullptr || !contexts_->GetPropAreaIndexForName(name, &index)) {
+    changelog->append(serial, 0, 0);  // 无法描述的修改，读取器需要遍历所有属性
+    return;
+  }
+  changelog->append(serial, index, pa->offset_of(pi));
+}
+
+// 增加属性所在区域（即上下文）的序列号和全局序列号，批量更新期间推迟到提交时进行
+void SystemProperties::NotifySerials(prop_area* pa, prop_area* serial_pa) {
+  if (batch_depth_ != 0) {
+    batch_dirty_ = true;
+    ++find_cache_generation_;  // 全局序列号不变，写入者自己的Find()缓存需要另外失效
+    if (pa != serial_pa && !BatchRecordArea(pa)) {
+      bump_serial(pa);  // 记录不下的区域立即增加
+    }
+    return;
+  }
+
+  if (pa != serial_pa) {  // pre-split时只有一个区域
+    bump_serial(pa);
+  }
+  bump_serial(serial_pa);  // 全局序列号最后增加，看到它变化的读取器也能看到区域序列号的变化
+}
+
+// 记录批量更新中修改过的区域，记录已满时返回false
+bool SystemProperties::BatchRecordArea(prop_area* pa) {
+  for (size_t i = 0; i < num_batch_areas_; ++i) {
+    if (batch_areas_[i] == pa) return true;
+  }
+  if (num_batch_areas_ == kMaxBatchAreas) {
+    return false;
+  }
+  batch_areas_[num_batch_areas_++] = pa;
+  return true;
+}
+
+// 开始批量更新，可以嵌套
+int SystemProperties::BatchBegin() {
+  if (!initialized_ || !contexts_->rw_) {  // 只有写入者可以批量更新
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr) {
+    return -1;
+  }
+
+  if (batch_depth_++ == 0) {
+    // 在批量中的第一个修改之前设置标志位，看到任何修改的读取器也能看到这个标志位
+    atomic_store_explicit(serial_pa->serial_flags(),
+                          atomic_load_explicit(serial_pa->serial_flags(), memory_order_relaxed) |
+                              prop_area::kSerialFlagBatch,
+                          memory_order_release);
+  }
   return 0;
 }
 
+// 提交批量更新：最外层的提交只增加一次全局序列号并唤醒一次等待者
+int SystemProperties::BatchCommit() {
+  if (!initialized_ || !contexts_->rw_ || batch_depth_ == 0) {
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr) {
+    return -1;
+  }
+
+  if (--batch_depth_ != 0) {
+    return 0;
+  }
+
+  // kSerialFlagWriting覆盖从清除kSerialFlagBatch到序列号增加的这段时间，
+  // 否则Snapshot()可能在两者之间看到干净的标志位和旧的全局序列号
+  SerialWriteScope write_scope(serial_pa);
+  // 先清除标志位，被全局序列号唤醒的读取器不会再看到批量正在进行
+  atomic_store_explicit(serial_pa->serial_flags(),
+                        atomic_load_explicit(serial_pa->serial_flags(), memory_order_relaxed) &
+                            ~prop_area::kSerialFlagBatch,
+                        memory_order_relaxed);
+  for (size_t i = 0; i < num_batch_areas_; ++i) {
+    bump_serial(batch_areas_[i]);
+  }
+  num_batch_areas_ = 0;
+  if (batch_dirty_) {
+    batch_dirty_ = false;
+    bump_serial(serial_pa);
+  }
+  return 0;
+}
+
+// 检查是否有批量更新正在进行
+bool SystemProperties::BatchInProgress() {
+  if (!initialized_) {
+    return false;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr) {
+    return false;
+  }
+
+  return (atomic_load_explicit(serial_pa->serial_flags(), memory_order_acquire) &
+          prop_area::kSerialFlagBatch) != 0;
+}
+
 // 获取属性的SELinux上下文
 const char* SystemProperties::GetContext(const char* name) {
   if (!initialized_) {  // 检查是否已初始化
@@ -374,6 +979,15 @@ const char* SystemProperties::GetContext(const char* name) {
   return contexts_->GetContextForName(name);  // 根据属性名获取上下文
 }
 
+// 获取属性在property_contexts中声明的类型
+const char* SystemProperties::GetType(const char* name) {
+  if (!initialized_) {  // 检查是否已初始化
+    return nullptr;
+  }
+
+  return contexts_->GetTypeForName(name);
+}
+
 // 等待任意属性变化
 uint32_t SystemProperties::WaitAny(uint32_t old_serial) {
   uint32_t new_serial;
@@ -381,6 +995,50 @@ uint32_t SystemProperties::WaitAny(uint32_t old_serial) {
   return new_serial;
 }
 
+// 获取属性所在上下文的序列号
+uint32_t SystemProperties::ContextSerial(const char* name) {
+  if (!initialized_) {
+    return -1;
+  }
+
+  prop_area* pa = contexts_->GetPropAreaForName(name);  // 获取属性所在区域
+  if (!pa) {
+    return -1;
+  }
+  return atomic_load_explicit(pa->serial(), memory_order_acquire);
+}
+
+// 等待属性所在上下文的序列号变化
+bool SystemProperties::ContextWait(const char* name, uint32_t old_serial,
+                                   uint32_t* new_serial_ptr, const timespec* relative_timeout) {
+  if (!initialized_) {
+    return false;
+  }
+
+  prop_area* pa = contexts_->GetPropAreaForName(name);  // 获取属性所在区域
+  if (!pa) {
+    return false;
+  }
+  return WaitForSerialChange(pa->serial(), old_serial, new_serial_ptr, relative_timeout);
+}
+
+// 等待序列号离开old_serial
+bool SystemProperties::WaitForSerialChange(atomic_uint_least32_t* serial_ptr, uint32_t old_serial,
+                                           uint32_t* new_serial_ptr,
+                                           const timespec* relative_timeout) {
+  uint32_t new_serial;
+  do {
+    int rc;
+    if ((rc = __futex_wait(serial_ptr, old_serial, relative_timeout)) != 0 && rc == -ETIMEDOUT) {
+      return false;  // 超时
+    }
+    new_serial = load_const_atomic(serial_ptr, memory_order_acquire);
+  } while (new_serial == old_serial);  // 继续等待直到序列号变化
+
+  *new_serial_ptr = new_serial;
+  return true;
+}
+
 // 等待属性变化
 bool SystemProperties::Wait(const prop_info* pi, uint32_t old_serial, uint32_t* new_serial_ptr,
                             const timespec* relative_timeout) {
@@ -401,35 +1059,169 @@ bool SystemProperties::Wait(const prop_info* pi, uint32_t old_serial, uint32_t*
     serial_ptr = const_cast<atomic_uint_least32_t*>(&pi->serial);
   }
 
-  uint32_t new_serial;
-  do {
+  return WaitForSerialChange(serial_ptr, old_serial, new_serial_ptr, relative_timeout);
+}
+
+// 计算距离截止时间（CLOCK_MONOTONIC）的剩余时间，已经超时则返回false
+static bool remaining_time(const timespec& deadline, timespec* remaining) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  remaining->tv_sec = deadline.tv_sec - now.tv_sec;
+  remaining->tv_nsec = deadline.tv_nsec - now.tv_nsec;
+  if (remaining->tv_nsec < 0) {
+    remaining->tv_sec--;
+    remaining->tv_nsec += 1000000000;
+  }
+  return remaining->tv_sec >= 0 && (remaining->tv_sec > 0 || remaining->tv_nsec > 0);
+}
+
+// 同时等待多个属性中的任意一个变化
+// pis中的nullptr表示全局序列号
+bool SystemProperties::WaitMany(const prop_info* const pis[], const uint32_t old_serials[],
+                                size_t count, const timespec* relative_timeout,
+                                size_t* index_ptr) {
+  if (!initialized_) {
+    return false;
+  }
+
+  if (count == 0 || count > __FUTEX_WAITV_MAX) {  // 受futex_waitv的上限限制
+    return false;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();  // 获取序列属性区域
+  if (serial_pa == nullptr) {
+    return false;
+  }
+
+  // futex_waitv只接受绝对时间，而回退路径每次等待前重新计算相对时间
+  timespec deadline;
+  if (relative_timeout != nullptr) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += relative_timeout->tv_sec;
+    deadline.tv_nsec += relative_timeout->tv_nsec;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  __futex_waitv_entry waiters[__FUTEX_WAITV_MAX];
+  for (size_t i = 0; i < count; ++i) {
+    const atomic_uint_least32_t* serial_ptr = pis[i] ? &pis[i]->serial : serial_pa->serial();
+    waiters[i].val = old_serials[i];
+    waiters[i].uaddr = reinterpret_cast<uintptr_t>(serial_ptr);
+    waiters[i].flags = __FUTEX2_SIZE_U32;  // 属性区域是共享内存，不能使用FUTEX2_PRIVATE
+    waiters[i].__reserved = 0;
+  }
+
+  bool use_waitv = true;
+  for (;;) {
+    // 在检查各个序列号之前读取全局序列号，回退路径据此等待全局序列号的下一次变化
+    uint32_t global_serial = atomic_load_explicit(serial_pa->serial(), memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+      const atomic_uint_least32_t* serial_ptr =
+          reinterpret_cast<const atomic_uint_least32_t*>(waiters[i].uaddr);
+      if (load_const_atomic(serial_ptr, memory_order_acquire) != old_serials[i]) {
+        *index_ptr = i;
+        return true;
+      }
+    }
+
     int rc;
-    if ((rc = __futex_wait(serial_ptr, old_serial, relative_timeout)) != 0 && rc == -ETIMEDOUT) {
+    if (use_waitv) {
+      rc = __futex_waitv(waiters, count, relative_timeout ? &deadline : nullptr);
+      if (rc < 0 && rc != -EAGAIN && rc != -EINTR && rc != -ETIMEDOUT) {
+        // 5.16之前的内核返回ENOSYS，其它意外的错误重试也不会消失，否则会一直空转。
+        // 都回退到等待全局序列号
+        use_waitv = false;
+        continue;
+      }
+    } else {
+      timespec remaining;
+      if (relative_timeout != nullptr && !remaining_time(deadline, &remaining)) {
+        return false;  // 超时
+      }
+      rc = __futex_wait(serial_pa->serial(), global_serial,
+                        relative_timeout ? &remaining : nullptr);
+    }
+    if (rc == -ETIMEDOUT) {
       return false;  // 超时
     }
-    new_serial = load_const_atomic(serial_ptr, memory_order_acquire);
-  } while (new_serial == old_serial);  // 继续等待直到序列号变化
+  }
+}
 
-  *new_serial_ptr = new_serial;
-  return true;
+// 开始逐个遍历所有属性
+void SystemProperties::CursorBegin(Cursor* cursor) {
+  cursor->context_index = 0;
+  cursor->area_started = 0;
+  cursor->generation = find_cache_generation_;
+  cursor->pa = nullptr;
 }
 
+// 返回下一个属性，顺序与Foreach()相同，没有更多属性时返回nullptr
+const prop_info* SystemProperties::CursorNext(Cursor* cursor) {
+  if (!initialized_) {  // 检查是否已初始化
+    return nullptr;
+  }
+
+  while (true) {
+    // 区域指针在重新映射后失效，需要重新获取；区域内的位置是偏移量，仍然有效
+    if (!cursor->pa || cursor->generation != find_cache_generation_) {
+      if (!contexts_->GetPropAreaForIndex(cursor->context_index, &cursor->pa)) {
+        cursor->pa = nullptr;
+        return nullptr;  // 所有上下文都已遍历完
+      }
+      cursor->generation = find_cache_generation_;
+      if (!cursor->pa) {  // 没有访问权限，跳过这个上下文
+        cursor->context_index++;
+        cursor->area_started = 0;
+        continue;
+      }
+    }
+
+    if (!cursor->area_started) {
+      cursor->pa->cursor_begin(&cursor->area_cursor);
+      cursor->area_started = 1;
+    }
+    const prop_info* pi = cursor->pa->cursor_next(&cursor->area_cursor);
+    if (pi) {
+      return pi;
+    }
+
+    // 这个区域已经遍历完，转到下一个上下文
+    cursor->context_index++;
+    cursor->area_started = 0;
+    cursor->pa = nullptr;
+  }
+}
+
+// 保护FindNth()缓存的游标
+static Lock g_find_nth_lock;
+
 // 查找第n个属性
+// n依次递增时从上一次的位置继续，每次调用平均只需O(1)
 const prop_info* SystemProperties::FindNth(unsigned n) {
-  struct find_nth {  // 用于查找第n个属性的辅助结构
-    const uint32_t sought;  // 要查找的索引
-    uint32_t current;       // 当前索引
-    const prop_info* result; // 结果属性信息
+  LockGuard guard(g_find_nth_lock);
 
-    explicit find_nth(uint32_t n) : sought(n), current(0), result(nullptr) {
-    }
-    static void fn(const prop_info* pi, void* ptr) {  // 遍历回调函数
-      find_nth* self = reinterpret_cast<find_nth*>(ptr);
-      if (self->current++ == self->sought) self->result = pi;  // 找到目标属性
+  if (find_nth_next_ > 0 && n == find_nth_next_ - 1) {
+    return find_nth_last_;  // 与上一次调用相同
+  }
+  if (find_nth_next_ == 0 || n < find_nth_next_) {
+    CursorBegin(&find_nth_cursor_);  // 只能向前移动，需要从头开始
+    find_nth_next_ = 0;
+  }
+
+  const prop_info* pi = nullptr;
+  while (find_nth_next_ <= n) {
+    pi = CursorNext(&find_nth_cursor_);
+    if (!pi) {
+      find_nth_next_ = 0;  // 所有属性都少于n+1个，下次从头开始
+      return nullptr;
     }
-  } state(n);
-  Foreach(find_nth::fn, &state);  // 遍历所有属性
-  return state.result;
+    find_nth_next_++;
+  }
+  find_nth_last_ = pi;
+  return pi;
 }
 
 // 遍历所有属性
@@ -442,3 +1234,344 @@ int SystemProperties::Foreach(void (*propfn)(const prop_info* pi, void* cookie),
 
   return 0;
 }
+
+namespace {
+
+// 快照的格式：SnapshotHeader之后是每个可访问区域的SnapshotArea及其数据区前size字节的副本，
+// 每个副本的起始位置按8字节对齐，副本中的偏移量与原区域中的相同
+struct SnapshotHeader {
+  static constexpr uint32_t kMagic = 0x50414e53;  // "SNAP"
+
+  uint32_t magic;
+  uint32_t serial;     // 复制期间的全局序列号
+  uint32_t num_areas;
+  uint32_t size;       // 整个快照的大小
+};
+
+struct SnapshotArea {
+  uint32_t size;
+  uint32_t version;  // 区域的版本，决定脏备份区域的位置
+};
+
+constexpr size_t kSnapshotAlign = 8;
+constexpr int kMaxSnapshotAttempts = 8;  // 写入者一直在修改时放弃，避免一直重试
+
+// 解码快照中一个区域的数据，所有偏移量都检查是否在副本范围内
+class SnapshotDecoder {
+ public:
+  SnapshotDecoder(const char* data, uint32_t size, uint32_t version,
+                  void (*callback)(void* cookie, const char* name, const char* value,
+                                   uint32_t serial),
+                  void* cookie)
+      : data_(data), size_(size), dirty_backup_offset_(prop_area::dirty_backup_offset(version)),
+        callback_(callback), cookie_(cookie), remaining_nodes_(size / sizeof(prop_bt)) {
+  }
+
+  // 与prop_area::foreach_property()的顺序相同
+  bool Walk(uint32_t offset) {
+    // 副本只有在复制期间没有写入者时才会被使用，这里的限制只是防止损坏的数据造成无限递归
+    if (remaining_nodes_-- == 0) return false;
+    const prop_bt* bt = At<prop_bt>(offset);
+    if (!bt) return false;
+
+    uint_least32_t left = load_const_atomic(&bt->left, memory_order_relaxed);
+    if (left != 0 && !Walk(left)) return false;
+    uint_least32_t prop = load_const_atomic(&bt->prop, memory_order_relaxed);
+    if (prop != 0) Visit(prop);
+    uint_least32_t children = load_const_atomic(&bt->children, memory_order_relaxed);
+    if (children != 0 && !Walk(children)) return false;
+    uint_least32_t right = load_const_atomic(&bt->right, memory_order_relaxed);
+    if (right != 0 && !Walk(right)) return false;
+    return true;
+  }
+
+ private:
+  template <typename T>
+  const T* At(uint32_t offset) const {
+    if (offset > size_ || size_ - offset < sizeof(T)) return nullptr;
+    return reinterpret_cast<const T*>(data_ + offset);
+  }
+
+  // 字符串必须在副本范围内结束
+  bool Terminated(const char* s) const {
+    if (s < data_ || s >= data_ + size_) return false;
+    return memchr(s, '\0', data_ + size_ - s) != nullptr;
+  }
+
+  void Visit(uint32_t offset) {
+    const prop_info* pi = At<prop_info>(offset);
+    if (!pi || !Terminated(pi->name)) return;
+
+    uint32_t serial = load_const_atomic(&pi->serial, memory_order_relaxed);
+    if (pi->is_long()) {
+      const char* value = pi->long_value();
+      if (Terminated(value)) callback_(cookie_, pi->name, value, serial);
+      return;
+    }
+
+    // 与ReadMutablePropertyValue()一样，正在更新的值从脏备份区域读取
+    const char* value = pi->value;
+    if (SERIAL_DIRTY(serial)) {
+      if (dirty_backup_offset_ + PROP_VALUE_MAX > size_) return;
+      const char* dirty_backup_area = data_ + dirty_backup_offset_;
+      value = dirty_backup_area;
+    }
+    char value_buf[PROP_VALUE_MAX];
+    uint32_t len = SERIAL_VALUE_LEN(serial);
+    if (len >= PROP_VALUE_MAX) len = PROP_VALUE_MAX - 1;
+    memcpy(value_buf, value, len);
+    value_buf[len] = '\0';
+    callback_(cookie_, pi->name, value_buf, serial);
+  }
+
+  const char* data_;
+  const uint32_t size_;
+  const size_t dirty_backup_offset_;
+  void (*callback_)(void* cookie, const char* name, const char* value, uint32_t serial);
+  void* cookie_;
+  uint32_t remaining_nodes_;
+};
+
+}  // namespace
+
+// 把所有可访问区域的数据区复制到buffer中，得到一份一致的快照
+// 复制前后全局序列号相同，并且都没有修改或批量修改正在进行时，复制期间没有写入者修改过区域
+// buffer: 快照缓冲区
+// len: 缓冲区大小
+// serial_ptr: 返回快照对应的全局序列号，可以为nullptr
+// 返回快照的大小；len不够时不写入完整的快照，只返回需要的大小
+ssize_t SystemProperties::Snapshot(void* buffer, size_t len, uint32_t* serial_ptr) {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr) {
+    return -1;
+  }
+
+  char* out = static_cast<char*>(buffer);
+  for (int attempt = 0; attempt < kMaxSnapshotAttempts; ++attempt) {
+    const uint32_t serial = atomic_load_explicit(serial_pa->serial(), memory_order_acquire);
+    const uint32_t flags = atomic_load_explicit(serial_pa->serial_flags(), memory_order_acquire);
+
+    size_t needed = __BIONIC_ALIGN(sizeof(SnapshotHeader), kSnapshotAlign);
+    uint32_t num_areas = 0;
+    prop_area* pa;
+    for (size_t i = 0; contexts_->GetPropAreaForIndex(i, &pa); ++i) {
+      if (!pa) continue;  // 没有访问权限
+      const uint32_t used = pa->bytes_used();
+      const size_t area_size = __BIONIC_ALIGN(sizeof(SnapshotArea) + used, kSnapshotAlign);
+      if (needed + area_size <= len) {
+        SnapshotArea area = {used, pa->version()};
+        memcpy(out + needed, &area, sizeof(area));
+        memcpy(out + needed + sizeof(area), pa->data(), used);
+      }
+      needed += area_size;
+      num_areas++;
+    }
+    if (needed > len) {
+      return needed;  // 缓冲区太小，不需要一致
+    }
+
+    atomic_thread_fence(memory_order_acquire);  // 复制必须在再次读取标志位和序列号之前完成
+    // 复制到了某个修改的任何部分时，要么看到kSerialFlagWriting，要么看到清除它之前增加的序列号
+    const uint32_t new_flags =
+        atomic_load_explicit(serial_pa->serial_flags(), memory_order_acquire);
+    constexpr uint32_t kBusy = prop_area::kSerialFlagBatch | prop_area::kSerialFlagWriting;
+    if (((flags | new_flags) & kBusy) == 0 &&
+        atomic_load_explicit(serial_pa->serial(), memory_order_relaxed) == serial) {
+      SnapshotHeader header = {SnapshotHeader::kMagic, serial, num_areas,
+                               static_cast<uint32_t>(needed)};
+      memcpy(out, &header, sizeof(header));
+      if (serial_ptr) *serial_ptr = serial;
+      return needed;
+    }
+    // 复制期间有写入者，重试
+  }
+
+  errno = EAGAIN;
+  return -1;
+}
+
+// 对快照中的每个属性调用callback，不需要访问属性区域
+// snapshot: Snapshot()写入的快照
+// len: 快照缓冲区大小
+int SystemProperties::SnapshotForeach(const void* snapshot, size_t len,
+                                      void (*callback)(void* cookie, const char* name,
+                                                       const char* value, uint32_t serial),
+                                      void* cookie) {
+  const char* data = static_cast<const char*>(snapshot);
+  SnapshotHeader header;
+  if (len < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != SnapshotHeader::kMagic || header.size > len) {
+    return -1;
+  }
+
+  size_t offset = __BIONIC_ALIGN(sizeof(SnapshotHeader), kSnapshotAlign);
+  for (uint32_t i = 0; i < header.num_areas; ++i) {
+    SnapshotArea area;
+    if (offset > header.size || header.size - offset < sizeof(area)) {
+      return -1;
+    }
+    memcpy(&area, data + offset, sizeof(area));
+    if (header.size - offset - sizeof(area) < area.size) {
+      return -1;
+    }
+    // 根节点位于数据区偏移量0处
+    SnapshotDecoder(data + offset + sizeof(area), area.size, area.version, callback, cookie)
+        .Walk(0);
+    offset += __BIONIC_ALIGN(sizeof(area) + area.size, kSnapshotAlign);
+  }
+  return 0;
+}
+
+// 遍历名称以prefix开头的属性
+int SystemProperties::ForeachPrefix(const char* prefix,
+                                    void (*propfn)(const prop_info* pi, void* cookie),
+                                    void* cookie) {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  contexts_->ForEachPrefix(prefix, propfn, cookie);  // 只遍历可能匹配的上下文和子树
+
+  return 0;
+}
+
+// 汇总本进程的统计计数，没有编译进统计时返回-1
+int SystemProperties::GetStats(prop_stats* stats) {
+#if defined(SYSTEM_PROPERTIES_STATS)
+  uint64_t counters[kPropStatCount] = {};
+  memset(stats, 0, sizeof(*stats));
+  for (size_t i = 0; i < kPropStatsShards; ++i) {
+    for (size_t j = 0; j < kPropStatCount; ++j) {
+      counters[j] += atomic_load_explicit(&g_prop_stats[i].counters[j], memory_order_relaxed);
+    }
+    for (size_t j = 0; j < kPropStatsLatencyBuckets; ++j) {
+      stats->set_latency_us[j] +=
+          atomic_load_explicit(&g_prop_stats[i].set_latency[j], memory_order_relaxed);
+    }
+  }
+  stats->finds = counters[kPropStatFind];
+  stats->find_cache_hits = counters[kPropStatFindCacheHit];
+  stats->find_misses = counters[kPropStatFindMiss];
+  stats->reads = counters[kPropStatRead];
+  stats->read_retries = counters[kPropStatReadRetry];
+  stats->read_backup_copies = counters[kPropStatReadBackup];
+  stats->updates = counters[kPropStatUpdate];
+  stats->futex_wakes = counters[kPropStatFutexWake];
+  stats->context_cache_hits = counters[kPropStatContextCacheHit];
+  stats->context_cache_misses = counters[kPropStatContextCacheMiss];
+  stats->sets = counters[kPropStatSet];
+  stats->set_failures = counters[kPropStatSetFailure];
+  if (initialized_) {  // 上下文的计数不依赖编译选项
+    stats->access_checks_deferred = contexts_->access_checks_deferred_;
+  }
+  return 0;
+#else
+  (void)stats;
+  return -1;
+#endif
+}
+
+// 报告每个可访问区域的使用情况，用于在区域快要用完时报警
+int SystemProperties::AreaUsage(void (*callback)(void* cookie, const char* context,
+                                                 uint32_t bytes_used, uint32_t bytes_free,
+                                                 uint32_t bytes_max),
+                                void* cookie) {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  prop_area* pa;
+  for (size_t i = 0; contexts_->GetPropAreaForIndex(i, &pa); ++i) {
+    if (pa == nullptr) {  // 没有访问权限
+      continue;
+    }
+    callback(cookie, contexts_->GetContextForIndex(i), pa->bytes_used(), pa->bytes_free(),
+             pa->max_data_size());
+  }
+  return 0;
+}
+
+// 从变更日志中找出全局序列号为serial之后修改过的属性，按最后一次修改的顺序放入out
+// 日志已经回绕、记录了删除或者out放不下时返回-1，调用者需要遍历所有属性
+int SystemProperties::ChangesSince(uint32_t serial, const prop_info* out[], size_t max) {
+  if (!initialized_) {  // 检查是否已初始化
+    return -1;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();
+  if (serial_pa == nullptr) {
+    return -1;
+  }
+  prop_changelog* changelog = serial_pa->changelog();
+  if (changelog == nullptr) {  // 旧的写入者没有变更日志
+    return -1;
+  }
+  // 上下文的编号与写入者不同时（例如回退到了分割上下文），无法解析日志中的上下文索引
+  if (serial_pa->contexts_hash() != contexts_hash_) {
+    return -1;
+  }
+
+  // 从最新的记录往回读，序列号不大于serial的记录调用者都已经看到过
+  const uint32_t head = changelog->head();
+  const uint32_t available = changelog->available(head);
+  size_t count = 0;
+  for (uint32_t n = 0;; ++n) {
+    if (n == available) {
+      if (n == prop_changelog::kSize) {  // 更早的记录已经被覆盖
+        return -1;
+      }
+      break;  // 日志从这里开始，之前没有修改
+    }
+
+    prop_changelog::change change;
+    if (!changelog->read(head - 1 - n, &change)) {  // 读取期间被覆盖
+      return -1;
+    }
+    if (static_cast<int32_t>(change.serial - serial) <= 0) {
+      break;
+    }
+    if (change.offset == 0) {  // 删除等无法描述的修改
+      return -1;
+    }
+
+    prop_area* pa;
+    if (!contexts_->GetPropAreaForIndex(change.area_index, &pa)) {
+      return -1;
+    }
+    if (pa == nullptr) {  // 调用者无权访问的上下文，它本来就看不到这些属性
+      continue;
+    }
+    const prop_info* pi = pa->prop_info_at(change.offset);
+    if (pi == nullptr) {
+      return -1;
+    }
+
+    // 同一个属性可能修改了多次，只保留最后一次
+    bool seen = false;
+    for (size_t i = 0; i < count && !seen; ++i) {
+      seen = out[i] == pi;
+    }
+    if (seen) {
+      continue;
+    }
+    if (count == max) {
+      return -1;
+    }
+    out[count++] = pi;
+  }
+
+  // 往回读得到的是从新到旧的顺序
+  for (size_t i = 0; i < count / 2; ++i) {
+    const prop_info* tmp = out[i];
+    out[i] = out[count - 1 - i];
+    out[count - 1 - i] = tmp;
+  }
+  return count;
+}
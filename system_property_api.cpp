@@ -74,6 +74,18 @@ const prop_info* __system_property_find(const char* name) {
   return system_properties.Find(name);
 }
 
+// 密封只读属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_seal_read_only() {
+  return system_properties.SealReadOnly();
+}
+
+// 查找预先计算好的系统属性名
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+const prop_info* __system_property_find_name(const prop_name* name, uint32_t* context_index) {
+  return system_properties.Find(*name, context_index);
+}
+
 // 读取系统属性
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 int __system_property_read(const prop_info* pi, char* name, char* value) {
@@ -95,6 +107,12 @@ int __system_property_get(const char* name, char* value) {
   return system_properties.Get(name, value);
 }
 
+// 批量获取系统属性值
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_get_many(const char* const names[], char* const values[], size_t count) {
+  return system_properties.GetMany(names, values, count);
+}
+
 // 更新系统属性
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 int __system_property_update(prop_info* pi, const char* value, unsigned int len) {
@@ -107,12 +125,36 @@ int __system_property_delete(const char *name, bool prune) {
   return system_properties.Delete(name, prune);
 }
 
+// 开始批量更新系统属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_batch_begin() {
+  return system_properties.BatchBegin();
+}
+
+// 提交批量更新
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_batch_commit() {
+  return system_properties.BatchCommit();
+}
+
+// 检查是否有批量更新正在进行
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+bool __system_property_batch_in_progress() {
+  return system_properties.BatchInProgress();
+}
+
 // 获取系统属性的SELinux上下文
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 const char* __system_property_get_context(const char *name) {
   return system_properties.GetContext(name);
 }
 
+// 获取系统属性在property_contexts中声明的类型
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+const char* __system_property_get_type(const char* name) {
+  return system_properties.GetType(name);
+}
+
 // 添加系统属性
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 int __system_property_add(const char* name, unsigned int namelen, const char* value,
@@ -120,6 +162,12 @@ int __system_property_add(const char* name, unsigned int namelen, const char* va
   return system_properties.Add(name, namelen, value, valuelen);
 }
 
+// 批量添加系统属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_add_many(prop_bulk_entry* entries, size_t count) {
+  return system_properties.AddMany(entries, count);
+}
+
 // 获取属性序列号
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 uint32_t __system_property_serial(const prop_info* pi) {
@@ -143,6 +191,27 @@ bool __system_property_wait(const prop_info* pi, uint32_t old_serial, uint32_t*
   return system_properties.Wait(pi, old_serial, new_serial_ptr, relative_timeout);
 }
 
+// 获取系统属性所在上下文的序列号
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+uint32_t __system_property_context_serial(const char* name) {
+  return system_properties.ContextSerial(name);
+}
+
+// 等待系统属性所在上下文的序列号变化
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+bool __system_property_context_wait(const char* name, uint32_t old_serial,
+                                    uint32_t* new_serial_ptr, const timespec* relative_timeout) {
+  return system_properties.ContextWait(name, old_serial, new_serial_ptr, relative_timeout);
+}
+
+// 同时等待多个系统属性变化
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+bool __system_property_wait_many(const prop_info* const pis[], const uint32_t old_serials[],
+                                 size_t count, const timespec* relative_timeout,
+                                 size_t* index_ptr) {
+  return system_properties.WaitMany(pis, old_serials, count, relative_timeout, index_ptr);
+}
+
 // 查找第n个属性
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 const prop_info* __system_property_find_nth(unsigned n) {
@@ -154,3 +223,83 @@ __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 int __system_property_foreach(void (*propfn)(const prop_info* pi, void* cookie), void* cookie) {
   return system_properties.Foreach(propfn, cookie);
 }
+
+static_assert(sizeof(SystemProperties::Cursor) <= sizeof(prop_cursor) &&
+                  alignof(SystemProperties::Cursor) <= alignof(prop_cursor),
+              "prop_cursor is too small for SystemProperties::Cursor");
+
+// 复制所有可访问属性的一致快照
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+ssize_t __system_property_snapshot(void* buffer, size_t len, uint32_t* serial_ptr) {
+  return system_properties.Snapshot(buffer, len, serial_ptr);
+}
+
+// 遍历快照中的属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_snapshot_foreach(const void* snapshot, size_t len,
+                                       void (*callback)(void* cookie, const char* name,
+                                                        const char* value, uint32_t serial),
+                                       void* cookie) {
+  return SystemProperties::SnapshotForeach(snapshot, len, callback, cookie);
+}
+
+// 开始逐个遍历所有属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+void __system_property_cursor_begin(prop_cursor* cursor) {
+  system_properties.CursorBegin(reinterpret_cast<SystemProperties::Cursor*>(cursor));
+}
+
+// 返回下一个属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+const prop_info* __system_property_cursor_next(prop_cursor* cursor) {
+  return system_properties.CursorNext(reinterpret_cast<SystemProperties::Cursor*>(cursor));
+}
+
+// 遍历名称以prefix开头的属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_foreach_prefix(const char* prefix,
+                                     void (*propfn)(const prop_info* pi, void* cookie),
+                                     void* cookie) {
+  return system_properties.ForeachPrefix(prefix, propfn, cookie);
+}
+
+// 获取某个全局序列号之后修改过的属性
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_changes_since(uint32_t serial, const prop_info* out[], size_t max) {
+  return system_properties.ChangesSince(serial, out, max);
+}
+
+// 获取本进程的统计计数
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_get_stats(prop_stats* stats) {
+  return system_properties.GetStats(stats);
+}
+
+// 报告每个属性区域的使用情况
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_area_usage(void (*callback)(void* cookie, const char* context,
+                                                  uint32_t bytes_used, uint32_t bytes_free,
+                                                  uint32_t bytes_max),
+                                 void* cookie) {
+  return system_properties.AreaUsage(callback, cookie);
+}
+
+// 创建可以加入poll/epoll的属性监视
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+prop_watch* __system_property_watch_create(const prop_info* const pis[], size_t count,
+                                           const char* const context_names[],
+                                           size_t context_count) {
+  return system_properties.WatchCreate(pis, count, context_names, context_count);
+}
+
+// 获取监视的eventfd
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_watch_fd(const prop_watch* watch) {
+  return SystemProperties::WatchFd(watch);
+}
+
+// 停止并释放监视
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+void __system_property_watch_destroy(prop_watch* watch) {
+  SystemProperties::WatchDestroy(watch);
+}
@@ -27,6 +27,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdatomic.h>
 #include <stddef.h>
@@ -37,6 +38,7 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/un.h>
+#include <time.h>
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <api/_system_properties.h>
 #include <unistd.h>
@@ -45,21 +47,46 @@
 #include <async_safe/CHECK.h>
 
 #include "private/bionic_defs.h"
+#include "private/bionic_lock.h"
 #include "platform/bionic/macros.h"
 #include "private/ScopedFd.h"
+#include "system_properties/prop_stats.h"
 
 // 属性服务套接字路径
 static const char property_service_socket[] = "/dev/socket/" PROP_SERVICE_NAME;
 // 服务版本属性名称
 static const char* kServiceVersionPropertyName = "ro.property_service.version";
 
+// 非阻塞socket上连接或发送需要等待时最多等待的时间，与send_prop_msg等待应答的时间相同
+static constexpr int kNonBlockingTimeoutMs = 250;
+
+// 等待socket上的事件，超时时设置errno为ETIMEDOUT并返回false
+static bool wait_for_socket(int fd, short events, int timeout_ms) {
+  pollfd pollfds[1];
+  pollfds[0].fd = fd;
+  pollfds[0].events = events;
+  const int poll_result = TEMP_FAILURE_RETRY(poll(pollfds, 1, timeout_ms));
+  if (poll_result == 0) {
+    errno = ETIMEDOUT;
+  }
+  return poll_result == 1;
+}
+
 // 属性服务连接类，管理与属性服务的socket连接
 class PropertyServiceConnection {
  public:
+  // kNonBlocking的连接在连接和发送时最多等待kNonBlockingTimeoutMs，而不是无限期阻塞
+  enum Mode { kBlocking, kNonBlocking };
+
   // 构造函数：创建并连接到属性服务
-  PropertyServiceConnection() : last_error_(0) {
+  PropertyServiceConnection() : PropertyServiceConnection(kBlocking) {
+  }
+
+  explicit PropertyServiceConnection(Mode mode) : last_error_(0) {
     // 创建本地socket，设置CLOEXEC标志
-    socket_.reset(::socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    socket_.reset(::socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC |
+                                         (mode == kNonBlocking ? SOCK_NONBLOCK : 0),
+                           0));
     if (socket_.get() == -1) {
       last_error_ = errno;
       return;
@@ -75,12 +102,22 @@ class PropertyServiceConnection {
 
     // 连接到属性服务
     if (TEMP_FAILURE_RETRY(connect(socket_.get(),
-                                   reinterpret_cast<sockaddr*>(&addr), alen)) == -1) {
+                                   reinterpret_cast<sockaddr*>(&addr), alen)) == -1 &&
+        (errno != EINPROGRESS || !FinishConnect())) {
       last_error_ = errno;
       socket_.reset();  // 连接失败，重置socket
     }
   }
 
+  // 接管一个已经建立的连接
+  explicit PropertyServiceConnection(int fd) : socket_(fd), last_error_(0) {
+  }
+
+  // 放弃对连接的所有权，以便之后复用
+  int Release() {
+    return socket_.release();
+  }
+
   // 检查连接是否有效
   bool IsValid() {
     return socket_.get() != -1;
@@ -116,6 +153,23 @@ class PropertyServiceConnection {
     return last_error_ == 0;
   }
 
+  // 等待非阻塞socket上正在进行的连接完成，失败时设置errno
+  bool FinishConnect() {
+    if (!wait_for_socket(socket_.get(), POLLOUT, kNonBlockingTimeoutMs)) {
+      return false;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(socket_.get(), SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+      return false;
+    }
+    if (error != 0) {
+      errno = error;
+      return false;
+    }
+    return true;
+  }
+
   ScopedFd socket_;    // socket文件描述符的智能指针
   int last_error_;     // 最后的错误码
 
@@ -127,7 +181,7 @@ class SocketWriter {
  public:
   // 构造函数，关联到属性服务连接
   explicit SocketWriter(PropertyServiceConnection* connection)
-      : connection_(connection), iov_index_(0), uint_buf_index_(0) {
+      : connection_(connection), iov_index_(0), uint_buf_index_(0), sent_nothing_(true) {
   }
 
   // 写入32位无符号整数
@@ -164,25 +218,59 @@ class SocketWriter {
       return false;
     }
 
-    // 使用writev一次性发送所有IO向量
-    if (writev(connection_->socket(), iov_, iov_index_) == -1) {
-      connection_->last_error_ = errno;
-      return false;
+    // 一次性发送所有IO向量。使用MSG_NOSIGNAL，这样服务端关闭了复用的连接时
+    // 我们得到EPIPE而不是SIGPIPE；流式socket可能只发送一部分，需要继续发送剩余部分
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov_;
+    msg.msg_iovlen = iov_index_;
+    sent_nothing_ = true;
+    while (msg.msg_iovlen > 0) {
+      ssize_t sent = TEMP_FAILURE_RETRY(sendmsg(connection_->socket(), &msg, MSG_NOSIGNAL));
+      if (sent == -1 && errno == EAGAIN &&
+          wait_for_socket(connection_->socket(), POLLOUT, kNonBlockingTimeoutMs)) {
+        continue;  // 非阻塞socket的发送缓冲区已满，等它有空间后继续
+      }
+      if (sent == -1) {
+        connection_->last_error_ = errno;
+        return false;
+      }
+      if (sent > 0) sent_nothing_ = false;
+      // 跳过已经完整发送的IO向量
+      while (msg.msg_iovlen > 0 && static_cast<size_t>(sent) >= msg.msg_iov->iov_len) {
+        sent -= msg.msg_iov->iov_len;
+        ++msg.msg_iov;
+        --msg.msg_iovlen;
+      }
+      if (msg.msg_iovlen > 0) {
+        msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + sent;
+        msg.msg_iov->iov_len -= sent;
+      }
     }
 
     iov_index_ = uint_buf_index_ = 0;  // 重置索引，准备下次使用
     return true;
   }
 
+  // 上一次Send()失败时是否一个字节都没有发送，这时服务端不可能处理过其中的任何请求
+  bool SentNothing() const {
+    return sent_nothing_;
+  }
+
+  // 一次Send()最多可以包含的PROP_MSG_SETPROP2消息数
+  static constexpr size_t kMaxMessages = 16;
+
  private:
-  static constexpr size_t kUintBufSize = 8;  // 整数缓冲区大小
-  static constexpr size_t kIovSize = 8;      // IO向量数组大小
+  // 每条PROP_MSG_SETPROP2消息需要3个整数（命令和两个长度）和5个IO向量
+  static constexpr size_t kUintBufSize = 3 * kMaxMessages;  // 整数缓冲区大小
+  static constexpr size_t kIovSize = 5 * kMaxMessages;      // IO向量数组大小
 
   PropertyServiceConnection* connection_;  // 属性服务连接
   iovec iov_[kIovSize];                   // IO向量数组
   size_t iov_index_;                      // 当前IO向量索引
   uint32_t uint_buf_[kUintBufSize];       // 整数缓冲区
   size_t uint_buf_index_;                 // 当前整数缓冲区索引
+  bool sent_nothing_;                     // 上一次Send()是否一个字节都没有发送
 
   BIONIC_DISALLOW_IMPLICIT_CONSTRUCTORS(SocketWriter);  // 禁止隐式构造函数
 };
@@ -238,6 +326,7 @@ static int send_prop_msg(const prop_msg* msg) {
 // 协议版本常量
 static constexpr uint32_t kProtocolVersion1 = 1;      // 旧版本协议
 static constexpr uint32_t kProtocolVersion2 = 2;      // 当前版本协议
+static constexpr uint32_t kProtocolVersion3 = 3;      // 连接可以复用，服务端按顺序应答多个请求
 
 // 全局属性服务协议版本（原子变量）
 static atomic_uint_least32_t g_propservice_protocol_version = 0;
@@ -255,7 +344,9 @@ static void detect_protocol_version() {
   } else {
     // 解析版本号
     uint32_t version = static_cast<uint32_t>(atoll(value));
-    if (version >= kProtocolVersion2) {
+    if (version >= kProtocolVersion3) {
+      g_propservice_protocol_version = kProtocolVersion3;
+    } else if (version >= kProtocolVersion2) {
       g_propservice_protocol_version = kProtocolVersion2;
     } else {
       // 版本号太低，使用旧协议
@@ -267,9 +358,8 @@ static void detect_protocol_version() {
   }
 }
 
-// 系统属性设置函数（bionic弱符号，用于native bridge）
-__BIONIC_WEAK_FOR_NATIVE_BRIDGE
-int __system_property_set(const char* key, const char* value) {
+// 设置系统属性，__system_property_set在统计打开时围绕它计时
+static int set_property(const char* key, const char* value) {
   if (key == nullptr) return -1;   // 键不能为空
   if (value == nullptr) value = "";  // 值为空时设为空字符串
 
@@ -292,10 +382,7 @@ int __system_property_set(const char* key, const char* value) {
 
     return send_prop_msg(&msg);
   } else {
-    // 新协议只允许ro.属性使用长值
-    if (strlen(value) >= PROP_VALUE_MAX && strncmp(key, "ro.", 3) != 0) return -1;
-    
-    // 使用新协议
+    // 使用新协议，长值是否允许由属性服务决定
     PropertyServiceConnection connection;
     if (!connection.IsValid()) {
       errno = connection.GetLastError();
@@ -337,3 +424,252 @@ int __system_property_set(const char* key, const char* value) {
     return 0;  // 设置成功
   }
 }
+
+// 系统属性设置函数（bionic弱符号，用于native bridge）
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_set(const char* key, const char* value) {
+#if defined(SYSTEM_PROPERTIES_STATS)
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int result = set_property(key, value);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const int64_t latency_ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+                             (end.tv_nsec - start.tv_nsec);
+  prop_stats_record_set(latency_ns / 1000, result != 0);
+  return result;
+#else
+  return set_property(key, value);
+#endif
+}
+
+// 异步设置系统属性：发送请求后立即返回连接的socket，调用者等它可读之后调用
+// __system_property_set_finish获取结果
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_set_async(const char* key, const char* value) {
+  if (key == nullptr) return -1;   // 键不能为空
+  if (value == nullptr) value = "";  // 值为空时设为空字符串
+
+  // 如果协议版本未检测，先检测版本
+  if (g_propservice_protocol_version == 0) {
+    detect_protocol_version();
+  }
+
+  if (g_propservice_protocol_version == kProtocolVersion1) {
+    // 旧协议不支持长名称或长值
+    if (strlen(key) >= PROP_NAME_MAX) return -1;
+    if (strlen(value) >= PROP_VALUE_MAX) return -1;
+  }
+
+  // 服务端忙时也不能让调用者阻塞，连接和发送最多等待kNonBlockingTimeoutMs
+  PropertyServiceConnection connection(PropertyServiceConnection::kNonBlocking);
+  if (!connection.IsValid()) {
+    errno = connection.GetLastError();
+    async_safe_format_log(
+        ANDROID_LOG_WARN, "libc",
+        "Unable to set property \"%s\" to \"%s\": connection failed; errno=%d (%s)", key, value,
+        errno, strerror(errno));
+    return -1;
+  }
+
+  if (g_propservice_protocol_version == kProtocolVersion1) {
+    // 旧协议：服务端处理完请求后关闭连接
+    prop_msg msg;
+    memset(&msg, 0, sizeof msg);
+    msg.cmd = PROP_MSG_SETPROP;
+    strlcpy(msg.name, key, sizeof msg.name);
+    strlcpy(msg.value, value, sizeof msg.value);
+    // 新socket的发送缓冲区足以容纳一条消息，所以不会只发送一部分
+    ssize_t sent = TEMP_FAILURE_RETRY(send(connection.socket(), &msg, sizeof(msg), MSG_NOSIGNAL));
+    if (sent == -1 && errno == EAGAIN &&
+        wait_for_socket(connection.socket(), POLLOUT, kNonBlockingTimeoutMs)) {
+      sent = TEMP_FAILURE_RETRY(send(connection.socket(), &msg, sizeof(msg), MSG_NOSIGNAL));
+    }
+    if (sent != sizeof(msg)) {
+      return -1;
+    }
+  } else {
+    SocketWriter writer(&connection);
+    if (!writer.WriteUint32(PROP_MSG_SETPROP2).WriteString(key).WriteString(value).Send()) {
+      errno = connection.GetLastError();
+      async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                            "Unable to set property \"%s\" to \"%s\": write failed; errno=%d (%s)",
+                            key, value, errno, strerror(errno));
+      return -1;
+    }
+  }
+
+  return connection.Release();
+}
+
+// 获取异步设置的结果并关闭socket，如果服务端还没有应答则阻塞等待
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_set_finish(int fd) {
+  if (fd < 0) return -1;
+  PropertyServiceConnection connection(fd);  // 返回时关闭socket
+
+  if (g_propservice_protocol_version == kProtocolVersion1) {
+    // 旧协议没有应答，服务端关闭连接即表示完成。与send_prop_msg一样最多等待250毫秒，
+    // 超时也视为成功
+    pollfd pollfds[1];
+    pollfds[0].fd = fd;
+    pollfds[0].events = 0;
+    const int poll_result = TEMP_FAILURE_RETRY(poll(pollfds, 1, 250 /* ms */));
+    if (poll_result != 1 || (pollfds[0].revents & POLLHUP) == 0) {
+      async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                            "Property service has timed out while trying to set a property");
+    }
+    return 0;
+  }
+
+  // __system_property_set_async返回的socket是非阻塞的，这里要等到应答为止
+  const int flags = fcntl(fd, F_GETFL);
+  if (flags != -1 && (flags & O_NONBLOCK) != 0) {
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  }
+
+  // 接收服务器响应
+  int result = -1;
+  if (!connection.RecvInt32(&result)) {
+    errno = connection.GetLastError();
+    async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                          "Unable to set property: recv failed; errno=%d (%s)", errno,
+                          strerror(errno));
+    return -1;
+  }
+
+  // 检查服务器返回的结果
+  if (result != PROP_SUCCESS) {
+    async_safe_format_log(ANDROID_LOG_WARN, "libc", "Unable to set property: error code: 0x%x",
+                          result);
+    return -1;
+  }
+
+  return 0;  // 设置成功
+}
+
+// __system_property_set_many复用的连接。
+// 整个进程共享一个连接，由锁保证请求和应答按顺序配对；fork之后子进程不会使用从父进程继承的连接
+static Lock g_connection_lock;
+static int g_connection_fd = -1;
+static pid_t g_connection_pid;
+
+// set_pipelined()中还没有结果的请求
+static constexpr int kResultPending = 1;
+
+// 通过复用的连接流水线发送最多SocketWriter::kMaxMessages个请求，并按顺序读取应答
+// results中为kResultPending的是待发送的请求，返回时它们都已被替换为0或-1
+// 必须持有g_connection_lock
+static void set_pipelined(const char* const keys[], const char* const values[], size_t count,
+                          int results[]) {
+  size_t pending = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (results[i] == kResultPending) ++pending;
+  }
+  if (pending == 0) return;
+
+  // 最多重试一次，而且只在复用的连接上发送失败、一个字节都没有发出时重试：
+  // 这种情况通常是服务端关闭了空闲的连接。请求发出之后读取应答失败时不能重试，
+  // 服务端可能已经处理了这些请求，ctl.start之类的请求不能重复执行
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (g_connection_fd != -1 && g_connection_pid != getpid()) {
+      close(g_connection_fd);  // 只关闭子进程自己的副本
+      g_connection_fd = -1;
+    }
+    const bool reused = g_connection_fd != -1;
+    PropertyServiceConnection connection = reused ? PropertyServiceConnection(g_connection_fd)
+                                                  : PropertyServiceConnection();
+    g_connection_fd = -1;  // 出错时连接随connection一起关闭
+    if (!connection.IsValid()) {
+      errno = connection.GetLastError();
+      async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                            "Unable to set properties: connection failed; errno=%d (%s)", errno,
+                            strerror(errno));
+      break;
+    }
+
+    SocketWriter writer(&connection);
+    for (size_t i = 0; i < count; ++i) {
+      if (results[i] == kResultPending) {
+        writer.WriteUint32(PROP_MSG_SETPROP2).WriteString(keys[i]).WriteString(values[i]);
+      }
+    }
+    if (!writer.Send()) {
+      if (reused && writer.SentNothing()) continue;
+      errno = connection.GetLastError();
+      async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                            "Unable to set properties: write failed; errno=%d (%s)", errno,
+                            strerror(errno));
+      break;
+    }
+
+    bool recv_failed = false;
+    for (size_t i = 0; i < count; ++i) {
+      if (results[i] != kResultPending) continue;
+
+      int result = -1;
+      if (!connection.RecvInt32(&result)) {
+        recv_failed = true;
+        errno = connection.GetLastError();
+        async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                              "Unable to set property \"%s\" to \"%s\": recv failed; errno=%d (%s)",
+                              keys[i], values[i], errno, strerror(errno));
+        break;
+      }
+      if (result != PROP_SUCCESS) {
+        async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                              "Unable to set property \"%s\" to \"%s\": error code: 0x%x",
+                              keys[i], values[i], result);
+      }
+      results[i] = result == PROP_SUCCESS ? 0 : -1;
+    }
+    if (!recv_failed) {  // 全部应答都已读取，保留连接供下次使用
+      g_connection_fd = connection.Release();
+      g_connection_pid = getpid();
+    }
+    break;
+  }
+
+  for (size_t i = 0; i < count; ++i) {  // 没有得到应答的请求都算失败
+    if (results[i] == kResultPending) results[i] = -1;
+  }
+}
+
+// 批量设置系统属性：协议版本3时通过一个复用的连接流水线发送
+__BIONIC_WEAK_FOR_NATIVE_BRIDGE
+int __system_property_set_many(const char* const keys[], const char* const values[],
+                               size_t count, int results[]) {
+  // 如果协议版本未检测，先检测版本
+  if (g_propservice_protocol_version == 0) {
+    detect_protocol_version();
+  }
+
+  int failed = 0;
+  if (g_propservice_protocol_version < kProtocolVersion3) {  // 旧的服务端每个连接只处理一个请求
+    for (size_t i = 0; i < count; ++i) {
+      int result = __system_property_set(keys[i], values[i]);
+      if (results) results[i] = result;
+      if (result != 0) failed = -1;
+    }
+    return failed;
+  }
+
+  LockGuard guard(g_connection_lock);
+  for (size_t start = 0; start < count; start += SocketWriter::kMaxMessages) {
+    const size_t n = count - start < SocketWriter::kMaxMessages ? count - start
+                                                                : SocketWriter::kMaxMessages;
+    const char* chunk_values[SocketWriter::kMaxMessages];
+    int chunk_results[SocketWriter::kMaxMessages];
+    for (size_t i = 0; i < n; ++i) {
+      const char* key = keys[start + i];
+      const char* value = values[start + i] ? values[start + i] : "";  // 值为空时设为空字符串
+      chunk_values[i] = value;
+      chunk_results[i] = key == nullptr ? -1 : kResultPending;
+    }
+    set_pipelined(keys + start, chunk_values, n, chunk_results);
+    for (size_t i = 0; i < n; ++i) {
+      if (results) results[start + i] = chunk_results[i];
+      if (chunk_results[i] != 0) failed = -1;
+    }
+  }
+  return failed;
+}
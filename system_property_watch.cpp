@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <async_safe/log.h>
+
+#include "private/bionic_futex.h"
+#include "private/bionic_lock.h"
+#include "system_properties/prop_area.h"
+#include "system_properties/prop_info.h"
+#include "system_properties/system_properties.h"
+
+// 一个监视：它的序列号任意一个变化时让eventfd变为可读
+// 进程中所有的监视由同一个后台线程服务，这里只记录被监视的序列号
+struct prop_watch {
+  int fd;
+  pid_t pid;  // 创建监视的进程，fork之后子进程中没有监视线程
+  prop_watch* next;  // 下一个由监视线程服务的监视
+  size_t count;
+  // val是监视线程最后一次看到的序列号
+  __futex_waitv_entry waiters[__FUTEX_WAITV_MAX - 1];
+};
+
+// 监视线程的状态，由g_watch_lock保护。使用静态存储而不是malloc (b/31659220)
+static Lock g_watch_lock;
+static prop_watch* g_watches;  // 所有的监视，线程在链表为空时退出
+static bool g_watch_thread_running;
+static atomic_uint_least32_t* g_watch_global_serial;
+// 创建和销毁监视时递增并唤醒，让线程按新的链表重新等待。线程也在这个字上等待
+static atomic_uint_least32_t g_watch_control;
+// 内核不支持futex_waitv或者它报告了意外的错误后，线程改为等待全局序列号
+static bool g_watch_use_waitv = true;
+static pthread_once_t g_watch_atfork_once = PTHREAD_ONCE_INIT;
+
+// fork时持有锁，子进程中没有监视线程，继承的监视只能被销毁，不再被服务
+static void watch_atfork_prepare() {
+  g_watch_lock.lock();
+}
+
+static void watch_atfork_parent() {
+  g_watch_lock.unlock();
+}
+
+static void watch_atfork_child() {
+  g_watches = nullptr;
+  g_watch_thread_running = false;
+  g_watch_lock.init(false);
+}
+
+static void watch_register_atfork() {
+  pthread_atfork(watch_atfork_prepare, watch_atfork_parent, watch_atfork_child);
+}
+
+// 监视线程：检查所有监视的序列号，有变化就写对应的eventfd，然后在所有序列号和控制字上等待
+static void* watch_thread(void*) {
+  // 所有监视的等待项，加上最后的控制字
+  __futex_waitv_entry waiters[__FUTEX_WAITV_MAX];
+
+  g_watch_lock.lock();
+  while (g_watches != nullptr) {
+    const uint32_t control = atomic_load_explicit(&g_watch_control, memory_order_acquire);
+    // 在检查各个序列号之前读取全局序列号，回退路径据此等待全局序列号的下一次变化
+    atomic_uint_least32_t* global_serial_ptr = g_watch_global_serial;
+    const uint32_t global_serial = atomic_load_explicit(global_serial_ptr, memory_order_acquire);
+    bool changed = false;
+    size_t count = 0;
+    for (prop_watch* watch = g_watches; watch != nullptr; watch = watch->next) {
+      bool watch_changed = false;
+      for (size_t i = 0; i < watch->count; ++i) {
+        __futex_waitv_entry* waiter = &watch->waiters[i];
+        const uint32_t serial = load_const_atomic(
+            reinterpret_cast<const atomic_uint_least32_t*>(waiter->uaddr), memory_order_acquire);
+        if (serial != waiter->val) {
+          waiter->val = serial;
+          watch_changed = true;
+        }
+        if (count + 1 < __FUTEX_WAITV_MAX) {
+          waiters[count] = *waiter;
+        }
+        ++count;  // 超过futex_waitv的上限时只计数
+      }
+      if (watch_changed) {
+        uint64_t one = 1;
+        (void)TEMP_FAILURE_RETRY(write(watch->fd, &one, sizeof(one)));
+        changed = true;
+      }
+    }
+    const bool use_waitv = g_watch_use_waitv && count + 1 <= __FUTEX_WAITV_MAX;
+    g_watch_lock.unlock();
+
+    if (changed) {
+      // 写入期间可能又有变化，重新检查后再等待
+    } else if (use_waitv) {
+      __futex_waitv_entry* control_waiter = &waiters[count];
+      control_waiter->val = control;
+      control_waiter->uaddr = reinterpret_cast<uintptr_t>(&g_watch_control);
+      control_waiter->flags = __FUTEX2_SIZE_U32 | __FUTEX2_PRIVATE;
+      control_waiter->__reserved = 0;
+      const int rc = __futex_waitv(waiters, count + 1, nullptr);
+      if (rc < 0 && rc != -EAGAIN && rc != -EINTR) {
+        // 5.16之前的内核返回ENOSYS，其它错误重试也不会消失，否则线程会一直空转。
+        // 从此回退到等待全局序列号
+        if (rc != -ENOSYS) {
+          async_safe_format_log(ANDROID_LOG_WARN, "libc",
+                                "futex_waitv failed for property watches: %d", rc);
+        }
+        g_watch_lock.lock();
+        g_watch_use_waitv = false;
+        g_watch_lock.unlock();
+      }
+    } else {
+      // 监视的序列号太多或者不能使用futex_waitv：任何属性变化都会改变全局序列号。
+      // 新的监视要到下一次变化时才被检查，在那之前它的序列号也不会变化
+      __futex_wait(global_serial_ptr, global_serial, nullptr);
+    }
+    g_watch_lock.lock();
+  }
+  g_watch_thread_running = false;
+  g_watch_lock.unlock();
+  return nullptr;
+}
+
+// 通知监视线程监视的链表已经改变，调用时持有g_watch_lock
+static void watch_list_changed() {
+  atomic_fetch_add_explicit(&g_watch_control, 1u, memory_order_release);
+  __futex_wake_ex(&g_watch_control, false, INT32_MAX);
+}
+
+// 创建监视，pis中的nullptr表示全局序列号，context_names中的每个名字表示该属性所在上下文的序列号
+prop_watch* SystemProperties::WatchCreate(const prop_info* const pis[], size_t count,
+                                          const char* const context_names[],
+                                          size_t context_count) {
+  if (!initialized_) {
+    return nullptr;
+  }
+
+  // 监视线程的控制字占用一个等待项
+  if (count + context_count == 0 || count + context_count >= __FUTEX_WAITV_MAX) {
+    return nullptr;
+  }
+
+  prop_area* serial_pa = contexts_->GetSerialPropArea();  // 获取序列属性区域
+  if (serial_pa == nullptr) {
+    return nullptr;
+  }
+
+  // 与上下文节点一样使用匿名映射，避免调用malloc
+  void* map = mmap(nullptr, sizeof(prop_watch), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+  prop_watch* watch = reinterpret_cast<prop_watch*>(map);
+  watch->pid = getpid();
+  watch->count = 0;
+
+  for (size_t i = 0; i < count + context_count; ++i) {
+    atomic_uint_least32_t* serial_ptr;
+    if (i < count) {
+      serial_ptr = pis[i] ? const_cast<atomic_uint_least32_t*>(&pis[i]->serial)
+                          : serial_pa->serial();
+    } else {
+      prop_area* pa = contexts_->GetPropAreaForName(context_names[i - count]);
+      if (pa == nullptr) {
+        munmap(map, sizeof(prop_watch));
+        return nullptr;
+      }
+      serial_ptr = pa->serial();
+    }
+    // 创建时的序列号作为起点，线程第一次检查之前的变化也会被报告
+    __futex_waitv_entry* waiter = &watch->waiters[watch->count++];
+    waiter->val = atomic_load_explicit(serial_ptr, memory_order_acquire);
+    waiter->uaddr = reinterpret_cast<uintptr_t>(serial_ptr);
+    waiter->flags = __FUTEX2_SIZE_U32;  // 属性区域是共享内存，不能使用FUTEX2_PRIVATE
+    waiter->__reserved = 0;
+  }
+
+  watch->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (watch->fd == -1) {
+    munmap(map, sizeof(prop_watch));
+    return nullptr;
+  }
+
+  pthread_once(&g_watch_atfork_once, watch_register_atfork);
+  LockGuard guard(g_watch_lock);
+  if (!g_watch_thread_running) {
+    // 线程只做等待，不需要默认大小的栈
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN + 16 * 1024);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int rc = pthread_create(&thread, &attr, watch_thread, nullptr);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+      async_safe_format_log(ANDROID_LOG_ERROR, "libc", "Could not start property watch thread: %d",
+                            rc);
+      close(watch->fd);
+      munmap(map, sizeof(prop_watch));
+      return nullptr;
+    }
+    g_watch_thread_running = true;
+  }
+  g_watch_global_serial = serial_pa->serial();
+  watch->next = g_watches;
+  g_watches = watch;
+  watch_list_changed();
+  return watch;
+}
+
+// 获取监视的eventfd
+int SystemProperties::WatchFd(const prop_watch* watch) {
+  return watch->fd;
+}
+
+// 从监视线程的链表中摘除监视并释放它
+void SystemProperties::WatchDestroy(prop_watch* watch) {
+  // fork时继承的监视不在子进程的链表中，只释放本进程的副本
+  if (watch->pid == getpid()) {
+    LockGuard guard(g_watch_lock);
+    for (prop_watch** link = &g_watches; *link != nullptr; link = &(*link)->next) {
+      if (*link == watch) {
+        *link = watch->next;
+        break;
+      }
+    }
+    // 线程只在持有锁时访问监视，之后可以立即释放。链表为空时线程醒来后退出
+    watch_list_changed();
+  }
+  close(watch->fd);
+  munmap(watch, sizeof(prop_watch));
+}
@@ -0,0 +1,10 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := system_properties_test
+LOCAL_STATIC_LIBRARIES := libsystemproperties libcxx
+LOCAL_CFLAGS := -std=c++17
+LOCAL_SRC_FILES := \
+    system_properties_test.cpp
+
+include $(BUILD_NATIVE_TEST)
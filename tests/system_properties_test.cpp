@@ -0,0 +1,697 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <api/_system_properties.h>
+#include <property_info_serializer/property_info_serializer.h>
+#include <system_properties/prop_area.h>
+#include <system_properties/prop_hash.h>
+#include <system_properties/system_properties.h>
+
+using android::properties::BuildTrie;
+using android::properties::PropertyInfoEntry;
+
+// 在临时目录中用AreaInit()创建属性区域。写入者和读取者是两个SystemProperties实例，
+// 读取者像普通进程一样只读映射这些区域
+class SystemPropertiesTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    snprintf(dir_, sizeof(dir_), "%s/properties.XXXXXX", getenv("TMPDIR") ?: "/data/local/tmp");
+    ASSERT_NE(nullptr, mkdtemp(dir_));
+
+    std::vector<PropertyInfoEntry> entries;
+    entries.emplace_back("test.", "u:object_r:test_prop:s0", "string", false);
+    entries.emplace_back("other.", "u:object_r:other_prop:s0", "string", false);
+    entries.emplace_back("ro.", "u:object_r:ro_prop:s0", "string", false);
+    std::string serialized, error;
+    ASSERT_TRUE(BuildTrie(entries, "u:object_r:default_prop:s0", "string", &serialized, &error))
+        << error;
+    std::string property_info = std::string(dir_) + "/property_info";
+    int fd = open(property_info.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0444);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(static_cast<ssize_t>(serialized.size()),
+              write(fd, serialized.data(), serialized.size()));
+    close(fd);
+
+    // Find()的缓存由同一线程中的所有实例共用，每个实例使用不同的代数，
+    // 这样不会命中之前的测试或者另一个实例缓存的prop_info
+    static uint32_t generation;
+    writer_.find_cache_generation_ = ++generation << 16;
+    reader_.find_cache_generation_ = ++generation << 16;
+
+    bool fsetxattr_failed;
+    ASSERT_TRUE(writer_.AreaInit(dir_, &fsetxattr_failed));
+    writer_.contexts_->rw_ = true;  // AreaInit()不会设置rw_
+    ASSERT_TRUE(reader_.Init(dir_));
+    initialized_ = true;
+  }
+
+  void TearDown() override {
+    if (initialized_) {
+      writer_.contexts_->FreeAndUnmap();
+      reader_.contexts_->FreeAndUnmap();
+    }
+    std::string command = std::string("rm -rf ") + dir_;
+    system(command.c_str());
+  }
+
+  void Add(const std::string& name, const std::string& value) {
+    ASSERT_EQ(0, writer_.Add(name.c_str(), name.size(), value.c_str(), value.size())) << name;
+  }
+
+  prop_info* WriterFind(const char* name) {
+    return const_cast<prop_info*>(writer_.Find(name));
+  }
+
+  static std::string Read(SystemProperties& system_properties, const prop_info* pi) {
+    std::string value;
+    system_properties.ReadCallback(
+        pi,
+        [](void* cookie, const char*, const char* value, uint32_t) {
+          *static_cast<std::string*>(cookie) = value;
+        },
+        &value);
+    return value;
+  }
+
+  static uint32_t Serial(SystemProperties& system_properties, const prop_info* pi) {
+    uint32_t serial = 0;
+    system_properties.ReadCallback(
+        pi,
+        [](void* cookie, const char*, const char*, uint32_t serial) {
+          *static_cast<uint32_t*>(cookie) = serial;
+        },
+        &serial);
+    return serial;
+  }
+
+  // 从读取者的映射中读取属性值，属性不存在时返回"<none>"
+  std::string ReaderGet(const char* name) {
+    const prop_info* pi = reader_.Find(name);
+    return pi != nullptr ? Read(reader_, pi) : "<none>";
+  }
+
+  prop_area* ReaderArea(const char* name) {
+    return reader_.contexts_->GetPropAreaForName(name);
+  }
+
+  // 把变更日志的位置移到head之前，并用序列号为serial的旧修改填满，这样不用真的修改2^32次
+  // 就能测试位置的回绕
+  void MoveChangelog(uint32_t head, uint32_t serial) {
+    prop_changelog* changelog = writer_.contexts_->GetSerialPropArea()->changelog();
+    ASSERT_NE(nullptr, changelog);
+    atomic_store_explicit(&changelog->head_, head - prop_changelog::kSize, memory_order_relaxed);
+    for (uint32_t i = 0; i < prop_changelog::kSize; ++i) {
+      changelog->append(serial, 0, 0);
+    }
+  }
+
+  // 读取者看到的serial之后修改过的属性的名称，日志无法回答时返回{"<walk>"}
+  std::vector<std::string> ChangesSince(uint32_t serial, size_t max = 64) {
+    std::vector<const prop_info*> pis(max);
+    int count = reader_.ChangesSince(serial, pis.data(), max);
+    if (count < 0) return {"<walk>"};
+    std::vector<std::string> names;
+    for (int i = 0; i < count; ++i) names.push_back(pis[i]->name);
+    return names;
+  }
+
+  char dir_[PATH_MAX];
+  bool initialized_ = false;
+  SystemProperties writer_{false};
+  SystemProperties reader_{false};
+};
+
+TEST_F(SystemPropertiesTest, BatchCommitPublishesChangesOnce) {
+  Add("test.a", "1");
+  Add("test.b", "1");
+  const uint32_t serial = reader_.AreaSerial();
+
+  ASSERT_EQ(0, writer_.BatchBegin());
+  EXPECT_TRUE(writer_.BatchInProgress());
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  Add("test.c", "2");
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.b"), "2", 1));
+  // 批量更新期间全局序列号不变，但写入者自己能看到新的属性
+  EXPECT_EQ(serial, reader_.AreaSerial());
+  EXPECT_NE(nullptr, writer_.Find("test.c"));
+
+  ASSERT_EQ(0, writer_.BatchCommit());
+  EXPECT_FALSE(writer_.BatchInProgress());
+  EXPECT_EQ(serial + 1, reader_.AreaSerial());
+  EXPECT_EQ(serial + 1, reader_.WaitAny(serial));
+  EXPECT_EQ("2", ReaderGet("test.a"));
+  EXPECT_EQ("2", ReaderGet("test.b"));
+  EXPECT_EQ("2", ReaderGet("test.c"));
+}
+
+TEST_F(SystemPropertiesTest, BatchNests) {
+  Add("test.a", "1");
+  const uint32_t serial = reader_.AreaSerial();
+
+  ASSERT_EQ(0, writer_.BatchBegin());
+  ASSERT_EQ(0, writer_.BatchBegin());
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  ASSERT_EQ(0, writer_.BatchCommit());
+  EXPECT_TRUE(writer_.BatchInProgress());
+  EXPECT_EQ(serial, reader_.AreaSerial());
+  ASSERT_EQ(0, writer_.BatchCommit());
+  EXPECT_EQ(serial + 1, reader_.AreaSerial());
+  EXPECT_EQ(-1, writer_.BatchCommit());
+}
+
+TEST_F(SystemPropertiesTest, BatchDeleteBumpsSerial) {
+  Add("test.a", "1");
+  Add("test.b", "1");
+  ASSERT_NE(nullptr, reader_.Find("test.a"));
+  const uint32_t serial = reader_.AreaSerial();
+
+  // 其它线程缓存的Find()结果只在全局序列号变化时失效，删除不能等到提交
+  ASSERT_EQ(0, writer_.BatchBegin());
+  ASSERT_EQ(0, writer_.Delete("test.a", false));
+  EXPECT_NE(serial, reader_.AreaSerial());
+  EXPECT_EQ(nullptr, reader_.Find("test.a"));
+  ASSERT_EQ(0, writer_.BatchCommit());
+  EXPECT_EQ("1", ReaderGet("test.b"));
+}
+
+TEST_F(SystemPropertiesTest, WaitManyTimesOut) {
+  Add("test.a", "1");
+  Add("other.b", "1");
+  const prop_info* pis[] = {reader_.Find("test.a"), reader_.Find("other.b"), nullptr};
+  const uint32_t old_serials[] = {Serial(reader_, pis[0]), Serial(reader_, pis[1]),
+                                  reader_.AreaSerial()};
+
+  const timespec timeout = {0, 10 * 1000 * 1000};
+  size_t index = ~0u;
+  EXPECT_FALSE(reader_.WaitMany(pis, old_serials, 3, &timeout, &index));
+  EXPECT_EQ(~0u, index);
+}
+
+TEST_F(SystemPropertiesTest, WaitManyReturnsChangedProperty) {
+  Add("test.a", "1");
+  Add("other.b", "1");
+  const prop_info* pis[] = {reader_.Find("test.a"), reader_.Find("other.b")};
+  const uint32_t old_serials[] = {Serial(reader_, pis[0]), Serial(reader_, pis[1])};
+
+  std::thread thread([this]() {
+    usleep(50 * 1000);
+    writer_.Update(WriterFind("other.b"), "2", 1);
+  });
+  const timespec timeout = {5, 0};
+  size_t index = ~0u;
+  EXPECT_TRUE(reader_.WaitMany(pis, old_serials, 2, &timeout, &index));
+  EXPECT_EQ(1u, index);
+  thread.join();
+
+  // 已经过时的序列号不需要等待
+  EXPECT_TRUE(reader_.WaitMany(pis, old_serials, 2, nullptr, &index));
+  EXPECT_EQ(1u, index);
+}
+
+TEST_F(SystemPropertiesTest, WaitManyWakesOnGlobalSerial) {
+  Add("test.a", "1");
+  const prop_info* pis[] = {reader_.Find("test.a"), nullptr};
+  const uint32_t old_serials[] = {Serial(reader_, pis[0]), reader_.AreaSerial()};
+
+  // 全局序列号随任何属性的修改而变化，包括没有被等待的属性
+  std::thread thread([this]() {
+    usleep(50 * 1000);
+    Add("other.c", "1");
+  });
+  const timespec timeout = {5, 0};
+  size_t index = ~0u;
+  EXPECT_TRUE(reader_.WaitMany(pis, old_serials, 2, &timeout, &index));
+  EXPECT_EQ(1u, index);
+  thread.join();
+}
+
+TEST_F(SystemPropertiesTest, WaitManyRejectsBadCounts) {
+  const uint32_t old_serial = reader_.AreaSerial();
+  const prop_info* pi = nullptr;
+  size_t index;
+  EXPECT_FALSE(reader_.WaitMany(&pi, &old_serial, 0, nullptr, &index));
+
+  std::vector<const prop_info*> pis(129, nullptr);
+  std::vector<uint32_t> old_serials(129, old_serial);
+  EXPECT_FALSE(reader_.WaitMany(pis.data(), old_serials.data(), 129, nullptr, &index));
+}
+
+TEST_F(SystemPropertiesTest, ChangesSinceListsEachPropertyOnceInOrder) {
+  Add("test.a", "1");
+  Add("other.b", "1");
+  const uint32_t serial = reader_.AreaSerial();
+  EXPECT_EQ(std::vector<std::string>(), ChangesSince(serial));
+
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  ASSERT_EQ(0, writer_.Update(WriterFind("other.b"), "2", 1));
+  Add("test.c", "1");
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "3", 1));
+  EXPECT_EQ((std::vector<std::string>{"other.b", "test.c", "test.a"}), ChangesSince(serial));
+  // 放不下所有修改过的属性时需要遍历
+  EXPECT_EQ(std::vector<std::string>{"<walk>"}, ChangesSince(serial, 2));
+
+  const uint32_t serial2 = reader_.AreaSerial();
+  ASSERT_EQ(0, writer_.Delete("test.c", false));
+  EXPECT_EQ(std::vector<std::string>{"<walk>"}, ChangesSince(serial2));
+}
+
+TEST_F(SystemPropertiesTest, ChangesSinceSurvivesWraparound) {
+  Add("test.a", "1");
+  Add("other.b", "1");
+  const uint32_t serial = reader_.AreaSerial();
+  MoveChangelog(0xfffffff0u, serial);
+
+  for (int i = 0; i < 40; ++i) {
+    ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), i % 2 ? "1" : "2", 1));
+  }
+  ASSERT_EQ(0, writer_.Update(WriterFind("other.b"), "2", 1));
+  EXPECT_EQ((std::vector<std::string>{"test.a", "other.b"}), ChangesSince(serial));
+
+  // 超过日志容量的修改之后，更早的序列号需要遍历
+  for (uint32_t i = 0; i < prop_changelog::kSize; ++i) {
+    ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), i % 2 ? "1" : "2", 1));
+  }
+  EXPECT_EQ(std::vector<std::string>{"<walk>"}, ChangesSince(serial));
+  const uint32_t serial2 = reader_.AreaSerial();
+  ASSERT_EQ(0, writer_.Update(WriterFind("other.b"), "3", 1));
+  EXPECT_EQ(std::vector<std::string>{"other.b"}, ChangesSince(serial2));
+}
+
+static void AppendPropInfo(const prop_info* pi, void* cookie) {
+  static_cast<std::vector<const prop_info*>*>(cookie)->push_back(pi);
+}
+
+TEST_F(SystemPropertiesTest, CursorMatchesForeach) {
+  // 不同长度的兄弟节点、有子节点的属性，以及比游标记录的路径更深的名称
+  for (int i = 999; i >= 100; i -= 3) {
+    std::string name = "test.n" + std::to_string(i);
+    Add(name, "v");
+    if (i % 7 == 0) Add(name + ".sub" + std::to_string(i % 3), "v");
+  }
+  std::string deep = "test";
+  for (int i = 0; i < 20; ++i) {
+    deep += ".d" + std::to_string(i);
+    if (i % 4 == 0) Add(deep + ".leaf", "v");
+  }
+  Add(deep, "v");
+  Add("other.x", "v");
+  Add("ro.y", "v");
+
+  std::vector<const prop_info*> foreach_pis;
+  ASSERT_EQ(0, reader_.Foreach(AppendPropInfo, &foreach_pis));
+
+  std::vector<const prop_info*> cursor_pis;
+  SystemProperties::Cursor cursor;
+  reader_.CursorBegin(&cursor);
+  bool overflowed = false;
+  for (const prop_info* pi; (pi = reader_.CursorNext(&cursor)) != nullptr;) {
+    cursor_pis.push_back(pi);
+    overflowed |= cursor.area_cursor.overflowed != 0;
+    ASSERT_LE(cursor_pis.size(), foreach_pis.size());
+  }
+  EXPECT_TRUE(overflowed);
+  EXPECT_EQ(foreach_pis, cursor_pis);
+}
+
+TEST_F(SystemPropertiesTest, CursorSurvivesDeletingReturnedProperty) {
+  for (int i = 0; i < 100; ++i) {
+    Add("test.n" + std::to_string(i), "v");
+  }
+  std::vector<const prop_info*> foreach_pis;
+  ASSERT_EQ(0, reader_.Foreach(AppendPropInfo, &foreach_pis));
+
+  std::vector<const prop_info*> cursor_pis;
+  SystemProperties::Cursor cursor;
+  reader_.CursorBegin(&cursor);
+  for (const prop_info* pi; (pi = reader_.CursorNext(&cursor)) != nullptr;) {
+    cursor_pis.push_back(pi);
+    if (cursor_pis.size() == 50) {
+      ASSERT_EQ(0, writer_.Delete(std::string(pi->name).c_str(), true));
+    }
+    ASSERT_LE(cursor_pis.size(), foreach_pis.size());
+  }
+  EXPECT_EQ(foreach_pis, cursor_pis);
+}
+
+static void CollectValue(void* cookie, const char* name, const char* value, uint32_t) {
+  (*static_cast<std::map<std::string, std::string>*>(cookie))[name] = value;
+}
+
+TEST_F(SystemPropertiesTest, SnapshotHoldsEveryProperty) {
+  Add("test.a", "1");
+  Add("other.b", "2");
+  Add("ro.c", std::string(PROP_VALUE_MAX + 100, 'c'));
+  Add("test.long", std::string(1000, 'l'));
+
+  std::map<std::string, std::string> expected;
+  std::vector<const prop_info*> pis;
+  ASSERT_EQ(0, reader_.Foreach(AppendPropInfo, &pis));
+  for (const prop_info* pi : pis) expected[pi->name] = Read(reader_, pi);
+
+  // 缓冲区太小时只返回需要的大小
+  const ssize_t size = reader_.Snapshot(nullptr, 0, nullptr);
+  ASSERT_GT(size, 0);
+  std::vector<char> buffer(size);
+  uint32_t serial;
+  ASSERT_EQ(size, reader_.Snapshot(buffer.data(), buffer.size(), &serial));
+  EXPECT_EQ(reader_.AreaSerial(), serial);
+
+  // 快照是一份拷贝，之后的修改不会改变它
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "3", 1));
+  std::map<std::string, std::string> values;
+  ASSERT_EQ(0, SystemProperties::SnapshotForeach(buffer.data(), buffer.size(), CollectValue,
+                                                 &values));
+  EXPECT_EQ(expected, values);
+
+  EXPECT_EQ(-1, SystemProperties::SnapshotForeach(buffer.data(), sizeof(uint32_t), CollectValue,
+                                                  &values));
+}
+
+static void CheckUniformValue(void* cookie, const char* name, const char* value, uint32_t) {
+  if (strncmp(name, "test.", 5) != 0) return;
+  for (const char* p = value; *p != '\0'; ++p) {
+    if (*p != value[0]) {
+      ++*static_cast<int*>(cookie);
+      return;
+    }
+  }
+}
+
+TEST_F(SystemPropertiesTest, SnapshotIsNeverTorn) {
+  for (int i = 0; i < 10; ++i) Add("test.p" + std::to_string(i), "a");
+  Add("test.long", std::string(1000, 'a'));
+
+  // 每个值都由同一个字符重复组成，快照中出现不同的字符说明复制了写了一半的值
+  std::atomic<bool> done(false);
+  std::thread thread([this, &done]() {
+    for (int j = 0; !done; ++j) {
+      const std::string name = "test.p" + std::to_string(j % 10);
+      const std::string value(1 + j % 90, 'a' + j % 26);
+      writer_.Update(WriterFind(name.c_str()), value.c_str(), value.size());
+      const std::string long_value(PROP_VALUE_MAX + j % 1000, 'a' + j % 26);
+      writer_.Update(WriterFind("test.long"), long_value.c_str(), long_value.size());
+      if (j % 50 == 0) {
+        Add("test.q", "q");
+        writer_.Delete("test.q", true);
+      }
+      usleep(10);  // 给快照留出完成复制的机会，否则它可能一直重试
+    }
+  });
+
+  std::vector<char> buffer(1 << 20);
+  int snapshots = 0;
+  int torn = 0;
+  for (int i = 0; i < 100000 && snapshots < 500; ++i) {
+    const ssize_t size = reader_.Snapshot(buffer.data(), buffer.size(), nullptr);
+    if (size < 0) {
+      EXPECT_EQ(EAGAIN, errno);
+      continue;
+    }
+    ASSERT_LE(static_cast<size_t>(size), buffer.size());
+    ++snapshots;
+    ASSERT_EQ(0, SystemProperties::SnapshotForeach(buffer.data(), size, CheckUniformValue, &torn));
+  }
+  done = true;
+  thread.join();
+  EXPECT_GT(snapshots, 0);
+  EXPECT_EQ(0, torn);
+}
+
+// 等待监视的fd变为可读，然后读出并返回计数，超时时返回0
+static uint64_t WaitForWatch(prop_watch* watch, int timeout_ms) {
+  pollfd pfd = {SystemProperties::WatchFd(watch), POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) != 1) return 0;
+  uint64_t count = 0;
+  if (read(pfd.fd, &count, sizeof(count)) != sizeof(count)) return 0;
+  return count;
+}
+
+static size_t ThreadCount() {
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) return 0;
+  size_t count = 0;
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') ++count;
+  }
+  closedir(dir);
+  return count;
+}
+
+TEST_F(SystemPropertiesTest, WatchReportsOnlyWatchedSerials) {
+  Add("test.a", "1");
+  Add("test.b", "1");
+  Add("other.c", "1");
+  const prop_info* pis[] = {reader_.Find("test.a")};
+  prop_watch* property_watch = reader_.WatchCreate(pis, 1, nullptr, 0);
+  ASSERT_NE(nullptr, property_watch);
+  const char* contexts[] = {"other.x"};
+  prop_watch* context_watch = reader_.WatchCreate(nullptr, 0, contexts, 1);
+  ASSERT_NE(nullptr, context_watch);
+
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.b"), "2", 1));
+  EXPECT_EQ(0u, WaitForWatch(property_watch, 50));
+  EXPECT_EQ(0u, WaitForWatch(context_watch, 0));
+
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  EXPECT_GE(WaitForWatch(property_watch, 5000), 1u);
+  EXPECT_EQ(0u, WaitForWatch(context_watch, 0));
+
+  ASSERT_EQ(0, writer_.Update(WriterFind("other.c"), "2", 1));
+  EXPECT_GE(WaitForWatch(context_watch, 5000), 1u);
+  EXPECT_EQ(0u, WaitForWatch(property_watch, 0));
+
+  SystemProperties::WatchDestroy(property_watch);
+  SystemProperties::WatchDestroy(context_watch);
+}
+
+TEST_F(SystemPropertiesTest, WatchesShareOneThread) {
+  Add("test.a", "1");
+  const prop_info* pis[] = {reader_.Find("test.a"), nullptr};
+
+  // 第一个监视启动线程，之后的监视不再增加线程
+  std::vector<prop_watch*> watches;
+  watches.push_back(reader_.WatchCreate(pis, 2, nullptr, 0));
+  ASSERT_NE(nullptr, watches.back());
+  const size_t threads = ThreadCount() - 1;
+  for (int i = 1; i < 8; ++i) {
+    watches.push_back(reader_.WatchCreate(pis, 2, nullptr, 0));
+    ASSERT_NE(nullptr, watches.back());
+  }
+  EXPECT_EQ(threads + 1, ThreadCount());
+
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  for (prop_watch* watch : watches) {
+    EXPECT_GE(WaitForWatch(watch, 5000), 1u);
+  }
+
+  // 最后一个监视销毁后线程退出
+  for (prop_watch* watch : watches) {
+    SystemProperties::WatchDestroy(watch);
+  }
+  for (int i = 0; i < 500 && ThreadCount() != threads; ++i) usleep(10 * 1000);
+  EXPECT_EQ(threads, ThreadCount());
+}
+
+TEST_F(SystemPropertiesTest, WatchCanBeDestroyedInChild) {
+  Add("test.a", "1");
+  const prop_info* pis[] = {reader_.Find("test.a")};
+  prop_watch* watch = reader_.WatchCreate(pis, 1, nullptr, 0);
+  ASSERT_NE(nullptr, watch);
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    SystemProperties::WatchDestroy(watch);
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(pid, TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)));
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  // 子进程销毁的只是它自己的副本
+  ASSERT_EQ(0, writer_.Update(WriterFind("test.a"), "2", 1));
+  EXPECT_GE(WaitForWatch(watch, 5000), 1u);
+  SystemProperties::WatchDestroy(watch);
+}
+
+TEST_F(SystemPropertiesTest, SealedReadOnlyPropertiesAreFound) {
+  for (int i = 0; i < 500; ++i) {
+    Add("ro.n" + std::to_string(i) + ".x", std::to_string(i));
+  }
+  Add("ro.long", std::string(PROP_VALUE_MAX + 100, 'l'));
+  Add("test.a", "1");
+  ASSERT_EQ(0, writer_.SealReadOnly());
+  EXPECT_EQ(-1, writer_.SealReadOnly());
+
+  // 密封表在只读属性所在的区域中，读取者通过它找到的prop_info与遍历trie找到的相同
+  prop_area* pa = ReaderArea("ro.n0.x");
+  ASSERT_NE(nullptr, pa);
+  size_t sealed = 0;
+  for (int i = 0; i < 500; ++i) {
+    const std::string name = "ro.n" + std::to_string(i) + ".x";
+    const prop_info* pi = pa->find_sealed(name.c_str(), prop_name_hash(name.c_str(), name.size()));
+    if (pi != nullptr) {
+      ++sealed;
+      EXPECT_EQ(pa->find(name.c_str()), pi);
+    }
+    EXPECT_EQ(std::to_string(i), ReaderGet(name.c_str()));
+  }
+  EXPECT_GT(sealed, 490u);  // 只有哈希值冲突的名称不在表中
+  EXPECT_EQ(std::string(PROP_VALUE_MAX + 100, 'l'), ReaderGet("ro.long"));
+
+  EXPECT_EQ(nullptr, pa->find_sealed("ro.missing", prop_name_hash("ro.missing", 10)));
+  EXPECT_EQ(nullptr, reader_.Find("ro.missing"));
+  prop_area* other = ReaderArea("test.a");
+  ASSERT_NE(nullptr, other);
+  EXPECT_EQ(nullptr, other->find_sealed("ro.n1.x", prop_name_hash("ro.n1.x", 7)));
+}
+
+TEST_F(SystemPropertiesTest, SealedReadOnlyPropertiesStay) {
+  Add("ro.a", "1");
+  Add("test.b", "1");
+  ASSERT_EQ(0, writer_.SealReadOnly());
+
+  // 密封之后不能删除只读属性，新的只读属性仍然按普通方式找到
+  EXPECT_EQ(-1, writer_.Delete("ro.a", false));
+  EXPECT_EQ("1", ReaderGet("ro.a"));
+  Add("ro.c", "2");
+  EXPECT_EQ("2", ReaderGet("ro.c"));
+  EXPECT_EQ(0, writer_.Delete("test.b", false));
+  EXPECT_EQ("<none>", ReaderGet("test.b"));
+}
+
+TEST_F(SystemPropertiesTest, MutableLongValues) {
+  const std::string long_value(1000, 'l');
+  Add("test.long", long_value);
+  EXPECT_EQ(long_value, ReaderGet("test.long"));
+
+  // 长值和短值可以互相替换
+  prop_info* pi = WriterFind("test.long");
+  ASSERT_EQ(0, writer_.Update(pi, "s", 1));
+  EXPECT_EQ("s", ReaderGet("test.long"));
+  const std::string longest(prop_info::kMutableLongValueMax - 1, 'm');
+  ASSERT_EQ(0, writer_.Update(pi, longest.c_str(), longest.size()));
+  EXPECT_EQ(longest, ReaderGet("test.long"));
+
+  // 可变属性的值由读取者复制，长度有上限；只读属性没有
+  const std::string too_long(prop_info::kMutableLongValueMax, 't');
+  EXPECT_EQ(-1, writer_.Update(pi, too_long.c_str(), too_long.size()));
+  EXPECT_EQ(-1, writer_.Add("test.too_long", 13, too_long.c_str(), too_long.size()));
+  const std::string read_only(3 * prop_info::kMutableLongValueMax, 'r');
+  Add("ro.long", read_only);
+  EXPECT_EQ(read_only, ReaderGet("ro.long"));
+}
+
+TEST_F(SystemPropertiesTest, MutableLongValuesAreNeverTorn) {
+  Add("test.long", std::string(PROP_VALUE_MAX, 'a'));
+  const prop_info* pi = reader_.Find("test.long");
+  ASSERT_NE(nullptr, pi);
+
+  // 每个值都由同一个字符重复组成，读到不同的字符说明读到了写了一半或者被重用的值块
+  std::atomic<bool> done(false);
+  std::thread thread([this, &done]() {
+    prop_info* pi = WriterFind("test.long");
+    for (int j = 0; !done; ++j) {
+      const std::string value(j % 3 ? PROP_VALUE_MAX + j % 3000 : 1 + j % 90, 'a' + j % 26);
+      writer_.Update(pi, value.c_str(), value.size());
+    }
+  });
+  int torn = 0;
+  for (int i = 0; i < 20000; ++i) {
+    const std::string value = Read(reader_, pi);
+    if (value.find_first_not_of(value[0]) != std::string::npos) ++torn;
+  }
+  done = true;
+  thread.join();
+  EXPECT_EQ(0, torn);
+}
+
+TEST_F(SystemPropertiesTest, DeletedPropInfoOnlyComesBackForItsName) {
+  Add("test.a", "1");
+  const prop_info* writer_pi = WriterFind("test.a");
+  const prop_info* reader_pi = reader_.Find("test.a");
+  ASSERT_NE(nullptr, reader_pi);
+  const uint32_t serial = Serial(reader_, reader_pi);
+
+  // 被删除的prop_info保留名称，值变为空，序列号继续增加
+  ASSERT_EQ(0, writer_.Delete("test.a", true));
+  EXPECT_EQ(nullptr, reader_.Find("test.a"));
+  EXPECT_STREQ("test.a", reader_pi->name);
+  EXPECT_EQ("", Read(reader_, reader_pi));
+  EXPECT_NE(serial, Serial(reader_, reader_pi));
+
+  // 其它属性不会得到它的内存
+  for (int i = 0; i < 100; ++i) {
+    const std::string name = "test.n" + std::to_string(i);
+    Add(name, "v");
+    EXPECT_NE(writer_pi, WriterFind(name.c_str()));
+  }
+
+  // 同名属性再次添加时重新使用它，之前拿到的指针也能读到新值
+  Add("test.a", std::string(PROP_VALUE_MAX + 10, 'x'));
+  EXPECT_EQ(writer_pi, WriterFind("test.a"));
+  EXPECT_EQ(reader_pi, reader_.Find("test.a"));
+  EXPECT_EQ(std::string(PROP_VALUE_MAX + 10, 'x'), Read(reader_, reader_pi));
+}
+
+TEST_F(SystemPropertiesTest, DeleteWakesWaiters) {
+  Add("test.a", "1");
+  const prop_info* pi = reader_.Find("test.a");
+  const uint32_t serial = Serial(reader_, pi);
+
+  std::thread thread([this]() {
+    usleep(50 * 1000);
+    writer_.Delete("test.a", false);
+  });
+  const timespec timeout = {5, 0};
+  uint32_t new_serial;
+  EXPECT_TRUE(reader_.Wait(pi, serial, &new_serial, &timeout));
+  EXPECT_NE(serial, new_serial);
+  thread.join();
+}